@@ -0,0 +1,56 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "bench_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+volatile uint32_t bench_sink = 0;
+
+static uint64_t alloc_count = 0;
+
+// Only calls made from the code under test are redirected here by the linker
+// (-Wl,--wrap=malloc ...), so the counter reflects the probe sources alone.
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    alloc_count++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+uint64_t bench_alloc_count(void) {
+    return alloc_count;
+}
+
+void bench_report_header(void) {
+    printf("%-32s %12s %12s %12s %12s\n", "benchmark", "frames", "ns/frame", "MB/s", "allocs/frame");
+}
+
+void bench_report(const BenchResult *r) {
+    double ns_per_frame = r->frames ? (double) r->elapsed_ns / (double) r->frames : 0.0;
+    double mb_per_s = r->elapsed_ns ? (double) r->bytes * 1000.0 / (double) r->elapsed_ns : 0.0;
+    double allocs = r->frames ? (double) r->allocs / (double) r->frames : 0.0;
+    printf("%-32s %12llu %12.1f %12.2f %12.3f\n", r->name, (unsigned long long) r->frames, ns_per_frame, mb_per_s,
+           allocs);
+}
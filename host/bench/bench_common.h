@@ -0,0 +1,36 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Shared helpers for host benchmarks: monotonic clock, allocation counters
+ * (fed by the -Wl,--wrap hooks in bench_common.c) and result reporting.
+ */
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *name;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+    uint64_t allocs;
+} BenchResult;
+
+uint64_t bench_now_ns(void);
+
+uint64_t bench_alloc_count(void);
+
+void bench_report_header(void);
+
+void bench_report(const BenchResult *r);
+
+// Keeps the optimizer from discarding results of the measured calls
+extern volatile uint32_t bench_sink;
+
+#endif // BENCH_COMMON_H
@@ -0,0 +1,230 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Benchmark of the /info JSON formatter on a Linux host.
+ *
+ * "legacy" is the snprintf/strcat implementation that mqtt_format_info_payload
+ * used before the JSON writer, kept here as the reference.
+ * "writer" is the current mqtt_format_info_payload. Both run over 16- and
+ * 32-cell battery status records and their output is compared before timing.
+ * "binary" is mqtt_format_info_binary_payload over the same records; the
+ * payload sizes of both encodings are printed first.
+ *
+ * Usage: bench_mqtt_formatter [iterations]
+ */
+#include "bench_common.h"
+#include "mqtt_formatter.h"
+#include "sdkconfig.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_ITERATIONS 200000
+#define BENCH_STATUS_COUNT 8
+
+#define MQTT_PREFIX CONFIG_PROBE_MQTT_BROKER_TOPIC_PREFIX "/" CONFIG_PROBE_DEVICE_NAME "/battery"
+
+static bool legacy_get_iso8601(time_t now, char *buffer, size_t len) {
+    struct tm timeinfo;
+    if (!gmtime_r(&now, &timeinfo)) {
+        return false;
+    }
+    if (strftime(buffer, len, "%Y-%m-%dT%H:%M:%SZ", &timeinfo) == 0) {
+        return false; // not enough space
+    }
+    return true;
+}
+
+// bus is unused: like the topics of a single-bus probe, the legacy ones have no bus level
+static bool legacy_format_info_payload(uint8_t bus, const PylonBatteryStatus *s, uint32_t unix_time,
+                                       MQTTPayload *out) {
+    if (!s || !out) return false;
+
+    char timestamp[32];
+    if (!legacy_get_iso8601(unix_time, timestamp, sizeof(timestamp))) {
+        snprintf(timestamp, sizeof(timestamp), "1970-00-00T00H:00M:00Z");
+    }
+
+    snprintf(out->topic, sizeof(out->topic), "%s/%02X/info", MQTT_PREFIX, s->user_defined_number);
+    out->payload_len = 0; // field added later, the reference must not see a stale binary length
+    out->qos = 1;
+    out->retain = 0;
+
+    char cell_voltages[512] = {0};
+    strcat(cell_voltages, "[");
+    for (int i = 0; i < s->cell_count; ++i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u%s", s->cell_voltage_mV[i], i < s->cell_count - 1 ? "," : "");
+        strncat(cell_voltages, buf, sizeof(cell_voltages) - strlen(cell_voltages) - 1);
+    }
+    strcat(cell_voltages, "]");
+
+    char temps[256] = {0};
+    strcat(temps, "[");
+    for (int i = 0; i < s->temperature_count; ++i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d%s", s->temperatures_c[i], i < s->temperature_count - 1 ? "," : "");
+        strncat(temps, buf, sizeof(temps) - strlen(temps) - 1);
+    }
+    strcat(temps, "]");
+
+    int len = snprintf(out->payload, sizeof(out->payload),
+                       "{\"timestamp\":\"%s\",\"modules\":%u,\"cell_count\":%u,\"temperature_count\":%u,"
+                       "\"cell_voltage_mV\":%s,\"temperatures_c\":%s,"
+                       "\"current_mA\":%d,\"total_voltage_mV\":%u,\"remaining_capacity_ah\":%u,"
+                       "\"user_defined_number\":%u,\"total_capacity_ah\":%u,\"cycle_count\":%u,"
+                       "\"batteryCapacity\":%u,\"currentCapacity\":%u,\"userVoltage0\":%u,\""
+                       "userVoltage1\":%u,\"userVoltage2\":%u,\"userVoltage3\":%u,\"userVoltage4\":%u,\""
+                       "unknown\":%u}",
+                       timestamp,
+                       s->modules,
+                       s->cell_count,
+                       s->temperature_count,
+                       cell_voltages,
+                       temps,
+                       s->current_mA,
+                       s->total_voltage_mV,
+                       s->remaining_capacity_ah,
+                       s->user_defined_number,
+                       s->total_capacity_ah,
+                       s->cycle_count,
+                       s->batteryCapacity,
+                       s->currentCapacity,
+                       s->userVoltage0,
+                       s->userVoltage1,
+                       s->userVoltage2,
+                       s->userVoltage3,
+                       s->userVoltage4,
+                       s->unknown
+    );
+
+    return len > 0 && len < sizeof(out->payload);
+}
+
+typedef bool (*InfoFormatter)(uint8_t bus, const PylonBatteryStatus *s, uint32_t unix_time, MQTTPayload *out);
+
+static void build_status(PylonBatteryStatus *s, uint8_t cells, unsigned seed) {
+    memset(s, 0, sizeof(*s));
+    s->modules = 1;
+    s->cell_count = cells;
+    for (uint8_t i = 0; i < cells; i++) {
+        s->cell_voltage_mV[i] = (uint16_t) (3300 + (seed + i * 7) % 40);
+    }
+    s->temperature_count = 6;
+    for (uint8_t i = 0; i < 6; i++) {
+        s->temperatures_c[i] = (int16_t) (-50 + (int) ((seed * 31 + i * 97) % 500));
+    }
+    s->current_mA = (int16_t) (-350 + (int) (seed % 700));
+    s->total_voltage_mV = (uint16_t) (cells * 3310);
+    s->remaining_capacity_ah = 13295;
+    s->user_defined_number = (uint8_t) (2 + seed % 14);
+    s->total_capacity_ah = 13705;
+    s->cycle_count = (uint16_t) (17 + seed % 100);
+    s->batteryCapacity = 0x59D8;
+    s->currentCapacity = 0x59D9;
+    s->userVoltage0 = 0x59DA;
+    s->userVoltage1 = 0x59DB;
+    s->userVoltage2 = 0x59DC;
+    s->userVoltage3 = 0x59DD;
+    s->userVoltage4 = 0x59DE;
+    s->unknown = 0x59DF;
+}
+
+/**
+ * Both formatters must produce the same topic and payload
+ */
+static bool check_same_output(const PylonBatteryStatus *s) {
+    static MQTTPayload legacy, writer;
+    uint32_t now = (uint32_t) time(NULL);
+    if (!legacy_format_info_payload(0, s, now, &legacy) || !mqtt_format_info_payload(0, s, now, &writer)) {
+        return false;
+    }
+#if PYLON_BUS_COUNT > 1
+    strcpy(legacy.topic, writer.topic); // only the payloads compare with the bus level in the topic
+#endif
+    if (strcmp(legacy.topic, writer.topic) == 0 && strcmp(legacy.payload, writer.payload) == 0) {
+        return true;
+    }
+    fprintf(stderr, "output mismatch:\n  legacy: %s %s\n  writer: %s %s\n",
+            legacy.topic, legacy.payload, writer.topic, writer.payload);
+    return false;
+}
+
+static void bench_format(const char *impl, InfoFormatter format, uint8_t cells, unsigned iterations) {
+    static PylonBatteryStatus statuses[BENCH_STATUS_COUNT];
+    static MQTTPayload out;
+    for (unsigned i = 0; i < BENCH_STATUS_COUNT; i++) {
+        build_status(&statuses[i], cells, i * 13u);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "info/%s/cells%u", impl, cells);
+
+    uint32_t now = (uint32_t) time(NULL);
+    uint64_t bytes = 0;
+    uint64_t allocs = bench_alloc_count();
+    uint64_t start = bench_now_ns();
+    for (unsigned it = 0; it < iterations; it++) {
+        const PylonBatteryStatus *s = &statuses[it % BENCH_STATUS_COUNT];
+        bench_sink += format(0, s, now, &out);
+        bytes += out.payload_len ? (uint64_t) out.payload_len : strlen(out.payload);
+    }
+    BenchResult r = {
+        .name = name,
+        .frames = iterations,
+        .bytes = bytes,
+        .elapsed_ns = bench_now_ns() - start,
+        .allocs = bench_alloc_count() - allocs,
+    };
+    bench_report(&r);
+}
+
+int main(int argc, char **argv) {
+    unsigned iterations = BENCH_DEFAULT_ITERATIONS;
+    if (argc > 1) {
+        iterations = (unsigned) strtoul(argv[1], NULL, 10);
+        if (iterations == 0) iterations = 1;
+    }
+
+    const uint8_t cell_counts[] = {16, PYLON_MAX_CELLS};
+    for (size_t i = 0; i < sizeof(cell_counts); i++) {
+        PylonBatteryStatus s;
+        for (unsigned seed = 0; seed < BENCH_STATUS_COUNT; seed++) {
+            build_status(&s, cell_counts[i], seed * 13u);
+            if (!check_same_output(&s)) {
+                return 1;
+            }
+        }
+    }
+
+    static MQTTPayload msg;
+    for (size_t i = 0; i < sizeof(cell_counts); i++) {
+        PylonBatteryStatus s;
+        build_status(&s, cell_counts[i], 0);
+        mqtt_format_info_payload(0, &s, (uint32_t) time(NULL), &msg);
+        size_t json_len = strlen(msg.payload);
+        mqtt_format_info_binary_payload(0, &s, (uint32_t) time(NULL), &msg);
+        printf("payload bytes, %u cells: json %zu, binary %d\n", cell_counts[i], json_len, msg.payload_len);
+    }
+    if (!mqtt_format_info_binary_schema(&msg)) {
+        fprintf(stderr, "binary schema does not fit MQTTPayload\n");
+        return 1;
+    }
+    printf("binary schema: %zu bytes on %s\n", strlen(msg.payload), msg.topic);
+
+    printf("iterations per case: %u\n", iterations);
+    bench_report_header();
+    for (size_t i = 0; i < sizeof(cell_counts); i++) {
+        bench_format("legacy", legacy_format_info_payload, cell_counts[i], iterations);
+        bench_format("writer", mqtt_format_info_payload, cell_counts[i], iterations);
+        bench_format("binary", mqtt_format_info_binary_payload, cell_counts[i], iterations);
+    }
+
+    return 0;
+}
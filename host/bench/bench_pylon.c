@@ -0,0 +1,320 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Throughput/latency benchmark for the Pylon decoder on a Linux host.
+ *
+ * Frame sets:
+ *   sample    - every line of main/sample_data.h (mixed bus traffic, EOI appended)
+ *   cells16   - synthetic 0x4600 analog response with 16 cells
+ *   cells32   - synthetic 0x4600 analog response with 32 cells
+ *   bus       - synthetic poll cycles of 8 packs, every command, 2% of the
+ *               frames damaged (main/pylon_synth.h)
+ *
+ * "hex" compares pylon_hex_to_bin with the old per-character branch chain on
+ * a 2 KB INFO payload.
+ * "decode" runs pylon_decode_ascii_hex over complete ASCII frames,
+ * "decode_inplace" converts them in their own buffer, "stream" feeds the same
+ * frames byte by byte through the incremental decoder.
+ *
+ * Usage: bench_pylon [iterations]
+ */
+#include "bench_common.h"
+#include "pylon_packet.h"
+#include "pylon_stream.h"
+#include "pylon_synth.h"
+#include "sample_data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_DEFAULT_ITERATIONS 20000
+#define BENCH_MAX_FRAMES 128
+#define BENCH_FRAME_SIZE 1024
+#define BENCH_BUS_CORRUPT_PER_MILLE 20
+
+typedef struct {
+    const char *name;
+    size_t count;
+    char frames[BENCH_MAX_FRAMES][BENCH_FRAME_SIZE];
+    size_t lengths[BENCH_MAX_FRAMES];
+} FrameSet;
+
+static FrameSet sample_set = {.name = "sample"};
+static FrameSet cells16_set = {.name = "cells16"};
+static FrameSet cells32_set = {.name = "cells32"};
+static FrameSet bus_set = {.name = "bus"};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static void load_sample_set(FrameSet *set) {
+    for (size_t i = 0; i < mock_data_lines_count && set->count < BENCH_MAX_FRAMES; i++) {
+        size_t len = strlen(mock_data_lines[i]);
+        if (len + 1 >= BENCH_FRAME_SIZE) continue;
+        memcpy(set->frames[set->count], mock_data_lines[i], len);
+        set->frames[set->count][len] = 0x0D;
+        set->lengths[set->count] = len + 1;
+        set->count++;
+    }
+}
+
+/**
+ * Analog responses of packs 0x02..0x0F with the given cell count
+ */
+static void load_synthetic_set(FrameSet *set, uint8_t cells) {
+    static PylonSynth synth;
+    PylonSynthConfig config = {.packs = 14, .cells = cells, .temperatures = 6, .seed = cells};
+    pylon_synth_init(&synth, &config);
+    for (uint8_t pack = 0; pack < config.packs && set->count < BENCH_MAX_FRAMES; pack++) {
+        set->lengths[set->count] = pylon_synth_frame(&synth, pack, PYLON_SYNTH_ANALOG, true, set->frames[set->count]);
+        set->count++;
+    }
+}
+
+/**
+ * Poll cycles of 8 packs: requests and responses for every command, some of them damaged
+ */
+static void load_bus_set(FrameSet *set) {
+    static PylonSynth synth;
+    PylonSynthConfig config = {
+        .packs = 8, .cells = 16, .temperatures = 6, .corrupt_per_mille = BENCH_BUS_CORRUPT_PER_MILLE, .seed = 1,
+    };
+    pylon_synth_init(&synth, &config);
+    while (set->count < BENCH_MAX_FRAMES) {
+        set->lengths[set->count] = pylon_synth_next(&synth, set->frames[set->count]);
+        set->count++;
+    }
+}
+
+static size_t frame_set_bytes(const FrameSet *set) {
+    size_t total = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        total += set->lengths[i];
+    }
+    return total;
+}
+
+static void bench_decode(const FrameSet *set, unsigned iterations) {
+    PylonPacketRaw raw;
+    char name[64];
+    snprintf(name, sizeof(name), "decode/%s", set->name);
+
+    uint64_t allocs = bench_alloc_count();
+    uint64_t start = bench_now_ns();
+    for (unsigned it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < set->count; i++) {
+            bench_sink += pylon_decode_ascii_hex(set->frames[i], set->lengths[i], &raw);
+        }
+    }
+    BenchResult r = {
+        .name = name,
+        .frames = (uint64_t) iterations * set->count,
+        .bytes = (uint64_t) iterations * frame_set_bytes(set),
+        .elapsed_ns = bench_now_ns() - start,
+        .allocs = bench_alloc_count() - allocs,
+    };
+    bench_report(&r);
+}
+
+/**
+ * Per-character branch chain that pylon_hex_to_bin replaced, kept as the
+ * reference. Vectorization is disabled to match the scalar Xtensa core.
+ */
+__attribute__((optimize("no-tree-vectorize")))
+static uint8_t reference_hex_nibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return 0xFF;
+}
+
+__attribute__((optimize("no-tree-vectorize")))
+static size_t reference_hex_to_bin(const char *in, size_t ascii_len, uint8_t *out) {
+    size_t hex_len = ascii_len / 2;
+    for (size_t i = 0; i < hex_len; i++) {
+        out[i] = reference_hex_nibble(in[i * 2]) << 4 | reference_hex_nibble(in[i * 2 + 1]);
+    }
+    return hex_len;
+}
+
+static void bench_hex(unsigned iterations) {
+    static char ascii[PYLON_MAX_DATA_BYTES * 2];
+    static uint8_t bin[PYLON_MAX_DATA_BYTES];
+    const size_t ascii_len = 4096; // 2 KB INFO payload
+    for (size_t i = 0; i < ascii_len; i++) {
+        ascii[i] = hex_digits[(i * 7 + i / 3) & 0x0F];
+    }
+
+    uint64_t start = bench_now_ns();
+    for (unsigned it = 0; it < iterations; it++) {
+        bench_sink += reference_hex_to_bin(ascii, ascii_len, bin) + bin[it % (ascii_len / 2)];
+    }
+    BenchResult r = {
+        .name = "hex/branch_chain_2KB",
+        .frames = iterations,
+        .bytes = (uint64_t) iterations * ascii_len,
+        .elapsed_ns = bench_now_ns() - start,
+    };
+    bench_report(&r);
+
+    start = bench_now_ns();
+    for (unsigned it = 0; it < iterations; it++) {
+        uint8_t invalid = 0;
+        bench_sink += pylon_hex_to_bin(ascii, ascii_len, bin, &invalid) + bin[it % (ascii_len / 2)] + invalid;
+    }
+    r.name = "hex/pylon_hex_to_bin_2KB";
+    r.elapsed_ns = bench_now_ns() - start;
+    bench_report(&r);
+}
+
+/**
+ * In-place decode; the frame is first copied into a scratch line buffer the
+ * way an RX buffer would hold it, and that copy is part of the measurement.
+ */
+static void bench_decode_inplace(const FrameSet *set, unsigned iterations) {
+    char line[BENCH_FRAME_SIZE];
+    PylonFrameView frame;
+    char name[64];
+    snprintf(name, sizeof(name), "decode_inplace/%s", set->name);
+
+    uint64_t allocs = bench_alloc_count();
+    uint64_t start = bench_now_ns();
+    for (unsigned it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < set->count; i++) {
+            memcpy(line, set->frames[i], set->lengths[i]);
+            bench_sink += pylon_decode_ascii_hex_inplace(line, set->lengths[i], &frame);
+        }
+    }
+    BenchResult r = {
+        .name = name,
+        .frames = (uint64_t) iterations * set->count,
+        .bytes = (uint64_t) iterations * frame_set_bytes(set),
+        .elapsed_ns = bench_now_ns() - start,
+        .allocs = bench_alloc_count() - allocs,
+    };
+    bench_report(&r);
+}
+
+static void bench_stream(const FrameSet *set, unsigned iterations) {
+    static PylonPacketRaw raw;
+    PylonStreamDecoder dec;
+    pylon_stream_init(&dec);
+    char name[64];
+    snprintf(name, sizeof(name), "stream/%s", set->name);
+
+    uint64_t allocs = bench_alloc_count();
+    uint64_t start = bench_now_ns();
+    for (unsigned it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < set->count; i++) {
+            const char *frame = set->frames[i];
+            pylon_stream_start(&dec, &raw);
+            for (size_t j = 1; j < set->lengths[i]; j++) {
+                if (pylon_stream_feed(&dec, (uint8_t) frame[j]) == PYLON_STREAM_FRAME) {
+                    bench_sink += raw.data_length;
+                }
+            }
+        }
+    }
+    BenchResult r = {
+        .name = name,
+        .frames = (uint64_t) iterations * set->count,
+        .bytes = (uint64_t) iterations * frame_set_bytes(set),
+        .elapsed_ns = bench_now_ns() - start,
+        .allocs = bench_alloc_count() - allocs,
+    };
+    bench_report(&r);
+}
+
+static void bench_parse(const FrameSet *set, unsigned iterations) {
+    static PylonPacketRaw decoded[BENCH_MAX_FRAMES];
+    size_t decoded_count = 0;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        if (pylon_decode_ascii_hex(set->frames[i], set->lengths[i], &decoded[decoded_count])) {
+            bytes += decoded[decoded_count].data_length;
+            decoded_count++;
+        }
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "parse_info/%s", set->name);
+    if (decoded_count == 0) {
+        printf("%-32s %12s\n", name, "no frames");
+        return;
+    }
+
+    PylonBatteryStatus status;
+    uint64_t allocs = bench_alloc_count();
+    uint64_t start = bench_now_ns();
+    for (unsigned it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < decoded_count; i++) {
+            PylonFrameView frame = pylon_frame_view(&decoded[i]);
+            bench_sink += pylon_parse_info_payload(&frame, &status);
+        }
+    }
+    BenchResult r = {
+        .name = name,
+        .frames = (uint64_t) iterations * decoded_count,
+        .bytes = (uint64_t) iterations * bytes,
+        .elapsed_ns = bench_now_ns() - start,
+        .allocs = bench_alloc_count() - allocs,
+    };
+    bench_report(&r);
+}
+
+static void bench_decode_and_parse(const FrameSet *set, unsigned iterations) {
+    PylonPacketRaw raw;
+    PylonBatteryStatus status;
+    char name[64];
+    snprintf(name, sizeof(name), "decode+parse/%s", set->name);
+
+    uint64_t allocs = bench_alloc_count();
+    uint64_t start = bench_now_ns();
+    for (unsigned it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < set->count; i++) {
+            if (pylon_decode_ascii_hex(set->frames[i], set->lengths[i], &raw)) {
+                PylonFrameView frame = pylon_frame_view(&raw);
+                bench_sink += pylon_parse_info_payload(&frame, &status);
+            }
+        }
+    }
+    BenchResult r = {
+        .name = name,
+        .frames = (uint64_t) iterations * set->count,
+        .bytes = (uint64_t) iterations * frame_set_bytes(set),
+        .elapsed_ns = bench_now_ns() - start,
+        .allocs = bench_alloc_count() - allocs,
+    };
+    bench_report(&r);
+}
+
+int main(int argc, char **argv) {
+    unsigned iterations = BENCH_DEFAULT_ITERATIONS;
+    if (argc > 1) {
+        iterations = (unsigned) strtoul(argv[1], NULL, 10);
+        if (iterations == 0) iterations = 1;
+    }
+
+    load_sample_set(&sample_set);
+    load_synthetic_set(&cells16_set, 16);
+    load_synthetic_set(&cells32_set, PYLON_MAX_CELLS);
+    load_bus_set(&bus_set);
+
+    const FrameSet *sets[] = {&sample_set, &cells16_set, &cells32_set, &bus_set};
+    const size_t set_count = sizeof(sets) / sizeof(sets[0]);
+
+    printf("iterations per set: %u\n", iterations);
+    bench_report_header();
+    bench_hex(iterations);
+    for (size_t i = 0; i < set_count; i++) bench_decode(sets[i], iterations);
+    for (size_t i = 0; i < set_count; i++) bench_decode_inplace(sets[i], iterations);
+    for (size_t i = 0; i < set_count; i++) bench_stream(sets[i], iterations);
+    for (size_t i = 0; i < set_count; i++) bench_parse(sets[i], iterations);
+    for (size_t i = 0; i < set_count; i++) bench_decode_and_parse(sets[i], iterations);
+
+    return 0;
+}
@@ -0,0 +1,335 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Standalone driver for the fuzz target, for compilers without libFuzzer.
+ *
+ * Input files are run once each, which reproduces a crash and lets AFL run
+ * the driver with @@. With -n or -t, inputs derived from the seed corpus by
+ * random mutations are run and the rate is reported in exec/s. The seeds are
+ * the lines of main/sample_data.h, synthetic frames of every command
+ * (main/pylon_synth.h) and the input files. One mutation repairs LENID and
+ * the checksum, so mutated payloads also reach the parsers through the
+ * decoder.
+ *
+ * -l appends the rate to a CSV history and compares it with the previous
+ * entry. With -r, a rate that fell by more than the given percentage makes
+ * the driver exit with status 3.
+ *
+ * Usage: fuzz_pylon_driver [-n runs] [-t sec] [-s seed] [-l history.csv] [-r pct] [-w dir] [file ...]
+ */
+#define _GNU_SOURCE
+#include "fuzz_pylon.h"
+#include "pylon_synth.h"
+#include "sample_data.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FUZZ_MAX_SEEDS 1024
+#define FUZZ_MAX_MUTATIONS 8 // stacked on one seed
+#define FUZZ_CHECK_EVERY 1024 // runs between clock reads
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} FuzzInput;
+
+typedef struct {
+    uint64_t runs;
+    uint32_t seconds;
+    uint32_t seed;
+    const char *history;
+    double max_drop_pct;
+    const char *write_dir;
+} FuzzOptions;
+
+static FuzzInput seeds[FUZZ_MAX_SEEDS];
+static size_t seed_count;
+static uint32_t rng;
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static uint32_t fuzz_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void add_seed(const void *data, size_t size) {
+    if (seed_count == FUZZ_MAX_SEEDS || size > FUZZ_PYLON_MAX_INPUT) return;
+    uint8_t *copy = malloc(size ? size : 1);
+    if (!copy) return;
+    memcpy(copy, data, size);
+    seeds[seed_count++] = (FuzzInput) {copy, size};
+}
+
+static void load_builtin_seeds(void) {
+    char frame[PYLON_SYNTH_MAX_FRAME + 1];
+    for (size_t i = 0; i < mock_data_lines_count; i++) {
+        size_t len = strlen(mock_data_lines[i]);
+        if (len >= sizeof(frame)) continue;
+        memcpy(frame, mock_data_lines[i], len);
+        frame[len] = PYLON_EOI; // stored without it
+        add_seed(frame, len + 1);
+    }
+
+    static PylonSynth synth;
+    const uint8_t cells[] = {1, 16, PYLON_MAX_CELLS};
+    for (size_t c = 0; c < sizeof(cells); c++) {
+        PylonSynthConfig config = {.packs = 1, .cells = cells[c], .temperatures = PYLON_MAX_TEMPS, .seed = c + 1};
+        pylon_synth_init(&synth, &config);
+        for (int command = 0; command < PYLON_SYNTH_COMMAND_COUNT; command++) {
+            for (int response = 0; response < 2; response++) {
+                add_seed(frame, pylon_synth_frame(&synth, 0, (PylonSynthCommand) command, response, frame));
+            }
+        }
+    }
+}
+
+static bool read_file(const char *path, FuzzInput *out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    static uint8_t buf[FUZZ_PYLON_MAX_INPUT];
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    out->data = malloc(n ? n : 1);
+    if (!out->data) return false;
+    memcpy(out->data, buf, n);
+    out->size = n;
+    return true;
+}
+
+static bool write_seeds(const char *dir) {
+    mkdir(dir, 0755);
+    for (size_t i = 0; i < seed_count; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/seed_%03zu", dir, i);
+        FILE *f = fopen(path, "wb");
+        if (!f) {
+            perror(path);
+            return false;
+        }
+        fwrite(seeds[i].data, 1, seeds[i].size, f);
+        fclose(f);
+    }
+    printf("%zu seeds written to %s\n", seed_count, dir);
+    return true;
+}
+
+/**
+ * Give a frame-shaped input the LENID and checksum of its actual length, so it gets past them
+ */
+static void repair_frame(uint8_t *buf, size_t size) {
+    if (size < PYLON_FRAME_OVERHEAD_ASCII || size - PYLON_FRAME_OVERHEAD_ASCII > 0x0FFF) return;
+    uint16_t len_id = (uint16_t) (size - PYLON_FRAME_OVERHEAD_ASCII);
+    uint16_t field = (uint16_t) (pylon_length_checksum(len_id) << 12 | len_id);
+    buf[0] = PYLON_SOI;
+    for (int i = 0; i < 4; i++) {
+        buf[9 + i] = (uint8_t) hex_digits[(field >> (12 - 4 * i)) & 0x0F];
+    }
+    uint16_t checksum = compute_checksum_ascii((const char *) &buf[1], size - 6);
+    for (int i = 0; i < 4; i++) {
+        buf[size - 5 + i] = (uint8_t) hex_digits[(checksum >> (12 - 4 * i)) & 0x0F];
+    }
+    buf[size - 1] = PYLON_EOI;
+}
+
+/**
+ * Apply one random mutation to buf holding *size bytes, FUZZ_PYLON_MAX_INPUT available
+ */
+static void mutate(uint8_t *buf, size_t *size) {
+    size_t n = *size;
+    size_t pos = n ? fuzz_random() % n : 0;
+    switch (fuzz_random() % 9) {
+        case 0: // flip a bit
+            if (n) buf[pos] ^= (uint8_t) (1u << (fuzz_random() % 8));
+            break;
+        case 1: // any byte
+            if (n) buf[pos] = (uint8_t) fuzz_random();
+            break;
+        case 2: // another hex digit, the frame stays well formed
+            if (n) buf[pos] = (uint8_t) hex_digits[fuzz_random() % 16];
+            break;
+        case 3: // insert a hex digit
+            if (n < FUZZ_PYLON_MAX_INPUT) {
+                memmove(&buf[pos + 1], &buf[pos], n - pos);
+                buf[pos] = (uint8_t) hex_digits[fuzz_random() % 16];
+                n++;
+            }
+            break;
+        case 4: // delete a byte
+            if (n) {
+                memmove(&buf[pos], &buf[pos + 1], n - pos - 1);
+                n--;
+            }
+            break;
+        case 5: // cut the end off
+            n = pos;
+            break;
+        case 6: { // splice the tail of another seed
+            const FuzzInput *other = &seeds[fuzz_random() % seed_count];
+            size_t from = other->size ? fuzz_random() % other->size : 0;
+            size_t take = other->size - from;
+            if (pos + take > FUZZ_PYLON_MAX_INPUT) take = FUZZ_PYLON_MAX_INPUT - pos;
+            memcpy(&buf[pos], &other->data[from], take);
+            n = pos + take;
+            break;
+        }
+        case 7: // a count or length byte at its extremes
+            if (n) buf[pos] = (fuzz_random() & 1) ? 0xFF : 0x00;
+            break;
+        default:
+            repair_frame(buf, n);
+            break;
+    }
+    *size = n;
+}
+
+/**
+ * One derived input, run from a buffer of exactly its size
+ */
+static void run_mutation(uint8_t *work) {
+    const FuzzInput *seed = &seeds[fuzz_random() % seed_count];
+    size_t size = seed->size;
+    memcpy(work, seed->data, size);
+    int mutations = 1 + (int) (fuzz_random() % FUZZ_MAX_MUTATIONS);
+    for (int i = 0; i < mutations; i++) mutate(work, &size);
+
+    uint8_t *exact = malloc(size ? size : 1);
+    if (!exact) return;
+    memcpy(exact, work, size);
+    LLVMFuzzerTestOneInput(exact, size);
+    free(exact);
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/**
+ * exec/s of the last entry of the history, 0 if there is none
+ */
+static double last_recorded_rate(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[256];
+    double rate = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long when, runs;
+        double seconds, r;
+        if (sscanf(line, "%llu,%llu,%lf,%lf", &when, &runs, &seconds, &r) == 4) rate = r;
+    }
+    fclose(f);
+    return rate;
+}
+
+/**
+ * Append the rate to the history; false if it fell by more than the allowed percentage
+ */
+static bool track_rate(const FuzzOptions *opt, uint64_t runs, double seconds, double rate) {
+    double previous = last_recorded_rate(opt->history);
+    FILE *f = fopen(opt->history, "a");
+    if (!f) {
+        perror(opt->history);
+        return true;
+    }
+    if (ftell(f) == 0) fprintf(f, "unix_time,runs,seconds,exec_per_s\n");
+    fprintf(f, "%llu,%llu,%.3f,%.0f\n", (unsigned long long) time(NULL), (unsigned long long) runs, seconds, rate);
+    fclose(f);
+
+    if (previous <= 0) return true;
+    double change_pct = (rate - previous) / previous * 100;
+    printf("previous %.0f exec/s, %+.1f%%\n", previous, change_pct);
+    return !(opt->max_drop_pct > 0 && -change_pct > opt->max_drop_pct);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] [file ...]\n"
+            "Runs every file through the Pylon fuzz target, then random mutations of the seed corpus.\n"
+            "  -n runs    mutated inputs to run\n"
+            "  -t sec     run mutated inputs for sec seconds\n"
+            "  -s seed    random seed (default 1)\n"
+            "  -l file    append exec/s to a CSV history and compare with the previous entry\n"
+            "  -r pct     exit with status 3 when exec/s fell by more than pct percent\n"
+            "  -w dir     write the built-in seed corpus to dir and exit\n",
+            argv0);
+}
+
+static bool parse_options(int argc, char **argv, FuzzOptions *opt) {
+    *opt = (FuzzOptions) {.seed = 1};
+    int c;
+    while ((c = getopt(argc, argv, "n:t:s:l:r:w:h")) != -1) {
+        switch (c) {
+            case 'n': opt->runs = strtoull(optarg, NULL, 10); break;
+            case 't': opt->seconds = (uint32_t) atoi(optarg); break;
+            case 's': opt->seed = (uint32_t) strtoul(optarg, NULL, 0); break;
+            case 'l': opt->history = optarg; break;
+            case 'r': opt->max_drop_pct = atof(optarg); break;
+            case 'w': opt->write_dir = optarg; break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    FuzzOptions opt;
+    if (!parse_options(argc, argv, &opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+    load_builtin_seeds();
+    if (opt.write_dir) return write_seeds(opt.write_dir) ? 0 : 1;
+
+    for (int i = optind; i < argc; i++) {
+        FuzzInput input;
+        if (!read_file(argv[i], &input)) {
+            perror(argv[i]);
+            return 1;
+        }
+        LLVMFuzzerTestOneInput(input.data, input.size);
+        if (seed_count < FUZZ_MAX_SEEDS && input.size <= FUZZ_PYLON_MAX_INPUT) {
+            seeds[seed_count++] = input;
+        } else {
+            free(input.data);
+        }
+    }
+    if (optind < argc) printf("%d inputs run\n", argc - optind);
+    if (!opt.runs && !opt.seconds) return 0;
+
+    static uint8_t work[FUZZ_PYLON_MAX_INPUT];
+    rng = opt.seed ? opt.seed : 1;
+    uint64_t runs = 0;
+    double start = now_s();
+    double elapsed = 0;
+    while (1) {
+        run_mutation(work);
+        runs++;
+        if (opt.runs && runs >= opt.runs) break;
+        if (runs % FUZZ_CHECK_EVERY == 0) {
+            elapsed = now_s() - start;
+            if (opt.seconds && elapsed >= opt.seconds) break;
+        }
+    }
+    elapsed = now_s() - start;
+    double rate = elapsed > 0 ? (double) runs / elapsed : 0;
+    printf("%llu runs over %zu seeds in %.2f s: %.0f exec/s\n", (unsigned long long) runs, seed_count, elapsed, rate);
+    if (opt.history && !track_rate(&opt, runs, elapsed, rate)) {
+        printf("exec/s fell by more than %.1f%%\n", opt.max_drop_pct);
+        return 3;
+    }
+    return 0;
+}
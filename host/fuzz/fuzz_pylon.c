@@ -0,0 +1,73 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Fuzz target over the Pylon decoder and INFO parsers.
+ *
+ * Every input is decoded as a complete ASCII frame, decoded again in place in
+ * a copy, and fed byte by byte through the stream decoder; decoded frames go
+ * to every parser. Random bytes rarely carry a valid checksum, so the input is
+ * also handed to the parsers as a raw INFO payload.
+ */
+#include "fuzz_pylon.h"
+#include "pylon_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void parse_all(const PylonFrameView *frame) {
+    PylonBatteryStatus status;
+    PylonAlarmInfo alarm;
+    PylonSystemParams params;
+    PylonManufacturerInfo manufacturer;
+    PylonChargeManagement charge;
+
+    pylon_parse_info_payload(frame, &status);
+    pylon_parse_alarm_payload(frame, &alarm);
+    pylon_parse_system_params(frame, &params);
+    pylon_parse_manufacturer_info(frame, &manufacturer);
+    pylon_parse_charge_management(frame, &charge);
+}
+
+static void fuzz_stream(const uint8_t *data, size_t size, PylonPacketRaw *raw) {
+    PylonStreamDecoder dec;
+    pylon_stream_init(&dec);
+    for (size_t i = 0; i < size; i++) {
+        if (pylon_stream_idle(&dec)) {
+            if (data[i] == PYLON_SOI) pylon_stream_start(&dec, raw);
+            continue;
+        }
+        if (pylon_stream_feed(&dec, data[i]) == PYLON_STREAM_FRAME) {
+            PylonFrameView frame = pylon_frame_view(raw);
+            parse_all(&frame);
+        }
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static PylonPacketRaw raw;
+    if (size > FUZZ_PYLON_MAX_INPUT) return 0;
+
+    if (pylon_decode_ascii_hex((const char *) data, size, &raw)) {
+        PylonFrameView frame = pylon_frame_view(&raw);
+        parse_all(&frame);
+    }
+
+    // exactly size bytes, so a sanitizer catches a read past the frame
+    char *copy = malloc(size ? size : 1);
+    if (copy) {
+        memcpy(copy, data, size);
+        PylonFrameView frame;
+        if (pylon_decode_ascii_hex_inplace(copy, size, &frame)) parse_all(&frame);
+        free(copy);
+    }
+
+    fuzz_stream(data, size, &raw);
+
+    PylonFrameView info = {.info = data, .info_length = (uint16_t) size};
+    parse_all(&info);
+    return 0;
+}
@@ -0,0 +1,21 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef FUZZ_PYLON_H
+#define FUZZ_PYLON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pylon_packet.h"
+
+// Longest input worth trying: a frame with the largest INFO the decoder accepts
+#define FUZZ_PYLON_MAX_INPUT (2 * PYLON_MAX_DATA_BYTES + PYLON_FRAME_OVERHEAD_ASCII)
+
+/**
+ * libFuzzer entry point, also called by the standalone driver. data is exactly size bytes.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif // FUZZ_PYLON_H
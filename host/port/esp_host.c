@@ -0,0 +1,213 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#define _GNU_SOURCE
+#include "host_port.h"
+#include "esp_rom_crc.h"
+#include "esp_partition.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "esp_host";
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+#define HOST_ERASED_CHUNK 4096
+#define HOST_PARTITIONS 4
+
+typedef struct {
+    esp_partition_t partition;
+    int fd;
+} HostPartition;
+
+static HostPartition partitions[HOST_PARTITIONS]; // unused while the label is empty
+
+static bool fill_erased(int fd, off_t from, off_t to) {
+    static uint8_t erased[HOST_ERASED_CHUNK];
+    memset(erased, 0xFF, sizeof(erased));
+    while (from < to) {
+        size_t n = (size_t) (to - from) < sizeof(erased) ? (size_t) (to - from) : sizeof(erased);
+        if (pwrite(fd, erased, n, from) != (ssize_t) n) return false;
+        from += (off_t) n;
+    }
+    return true;
+}
+
+static HostPartition *find_partition(const char *label) {
+    for (size_t i = 0; i < HOST_PARTITIONS; i++) {
+        if (strcmp(partitions[i].partition.label, label) == 0) return &partitions[i];
+    }
+    return NULL;
+}
+
+bool host_partition_attach(const char *label, const char *path, uint32_t size) {
+    if (!label[0]) return false;
+    HostPartition *p = find_partition(label);
+    HostPartition *slot = p ? p : find_partition("");
+    if (!slot) {
+        ESP_LOGE(TAG, "No room for partition %s", label);
+        return false;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        ESP_LOGE(TAG, "Cannot open %s: %s", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    if (st.st_size < (off_t) size && !fill_erased(fd, st.st_size, (off_t) size)) {
+        ESP_LOGE(TAG, "Cannot erase %s: %s", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (p) close(p->fd);
+    slot->fd = fd;
+    slot->partition = (esp_partition_t) {
+        .type = ESP_PARTITION_TYPE_DATA,
+        .subtype = ESP_PARTITION_SUBTYPE_ANY,
+        .size = size,
+    };
+    strncpy(slot->partition.label, label, sizeof(slot->partition.label) - 1);
+    return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    for (size_t i = 0; i < HOST_PARTITIONS; i++) {
+        const esp_partition_t *p = &partitions[i].partition;
+        if (!p->label[0]) continue;
+        if (type != ESP_PARTITION_TYPE_ANY && type != p->type) continue;
+        if (label && strcmp(label, p->label) != 0) continue;
+        return p;
+    }
+    return NULL;
+}
+
+/**
+ * File descriptor of the partition if the range lies within it, -1 otherwise
+ */
+static int partition_fd(const esp_partition_t *partition, size_t offset, size_t size) {
+    for (size_t i = 0; i < HOST_PARTITIONS; i++) {
+        if (partition == &partitions[i].partition && partition->label[0]) {
+            return offset <= partition->size && size <= partition->size - offset ? partitions[i].fd : -1;
+        }
+    }
+    return -1;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size) {
+    int fd = partition_fd(partition, offset, size);
+    if (fd < 0) return ESP_ERR_INVALID_ARG;
+    return pread(fd, dst, size, (off_t) offset) == (ssize_t) size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size) {
+    int fd = partition_fd(partition, offset, size);
+    if (fd < 0) return ESP_ERR_INVALID_ARG;
+    uint8_t buf[256];
+    const uint8_t *in = src;
+    while (size) {
+        size_t n = size < sizeof(buf) ? size : sizeof(buf);
+        if (pread(fd, buf, n, (off_t) offset) != (ssize_t) n) return ESP_FAIL;
+        for (size_t i = 0; i < n; i++) {
+            buf[i] &= in[i];
+        }
+        if (pwrite(fd, buf, n, (off_t) offset) != (ssize_t) n) return ESP_FAIL;
+        in += n;
+        offset += n;
+        size -= n;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    int fd = partition_fd(partition, offset, size);
+    if (fd < 0) return ESP_ERR_INVALID_ARG;
+    return fill_erased(fd, (off_t) offset, (off_t) (offset + size)) ? ESP_OK : ESP_FAIL;
+}
+
+#define HOST_NVS_NAMESPACES 8
+#define HOST_NVS_ENTRIES 32
+#define HOST_NVS_KEY_LEN 16 // including NUL, as on the ESP32
+
+typedef struct {
+    nvs_handle_t ns; // namespace index + 1
+    char key[HOST_NVS_KEY_LEN];
+    uint32_t value;
+} NvsEntry;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static char nvs_namespaces[HOST_NVS_NAMESPACES][HOST_NVS_KEY_LEN];
+static NvsEntry nvs_entries[HOST_NVS_ENTRIES];
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out) {
+    if (!name || strlen(name) >= HOST_NVS_KEY_LEN) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    pthread_mutex_lock(&nvs_lock);
+    for (size_t i = 0; i < HOST_NVS_NAMESPACES; i++) {
+        if (!nvs_namespaces[i][0] && mode == NVS_READWRITE) {
+            strcpy(nvs_namespaces[i], name);
+        }
+        if (strcmp(nvs_namespaces[i], name) == 0) {
+            *out = (nvs_handle_t) (i + 1);
+            err = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+static NvsEntry *nvs_find(nvs_handle_t handle, const char *key, bool create) {
+    NvsEntry *free_entry = NULL;
+    for (size_t i = 0; i < HOST_NVS_ENTRIES; i++) {
+        NvsEntry *e = &nvs_entries[i];
+        if (e->ns == handle && strcmp(e->key, key) == 0) return e;
+        if (!e->ns && !free_entry) free_entry = e;
+    }
+    if (!create || !free_entry) return NULL;
+    free_entry->ns = handle;
+    strcpy(free_entry->key, key);
+    return free_entry;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out) {
+    pthread_mutex_lock(&nvs_lock);
+    NvsEntry *e = nvs_find(handle, key, false);
+    if (e) *out = e->value;
+    pthread_mutex_unlock(&nvs_lock);
+    return e ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    if (!key || strlen(key) >= HOST_NVS_KEY_LEN) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&nvs_lock);
+    NvsEntry *e = nvs_find(handle, key, true);
+    if (e) e->value = value;
+    pthread_mutex_unlock(&nvs_lock);
+    return e ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
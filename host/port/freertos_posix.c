@@ -0,0 +1,266 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#define _GNU_SOURCE
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *TAG = "freertos";
+
+struct HostTask {
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_value;
+    TaskFunction_t function;
+    void *param;
+    char name[16];
+};
+
+struct HostQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t length;
+    size_t item_size;
+    size_t head;
+    size_t count;
+    uint8_t items[];
+};
+
+static __thread struct HostTask *current_task;
+static pthread_once_t clock_once = PTHREAD_ONCE_INIT;
+static pthread_condattr_t monotonic_cond;
+
+static void clock_init(void) {
+    pthread_condattr_init(&monotonic_cond);
+    pthread_condattr_setclock(&monotonic_cond, CLOCK_MONOTONIC);
+}
+
+static void cond_init(pthread_cond_t *cond) {
+    pthread_once(&clock_once, clock_init);
+    pthread_cond_init(cond, &monotonic_cond);
+}
+
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ms = (uint64_t) ticks * portTICK_PERIOD_MS;
+    ts.tv_sec += (time_t) (ms / 1000);
+    ts.tv_nsec += (long) (ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+/**
+ * Wait on cond with the lock held, false once the deadline has passed. portMAX_DELAY waits forever.
+ */
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline) {
+    if (ticks == 0) return false;
+    if (ticks == portMAX_DELAY) return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static struct HostTask *task_new(TaskFunction_t function, const char *name, void *param) {
+    struct HostTask *task = calloc(1, sizeof(*task));
+    if (!task) return NULL;
+    pthread_mutex_init(&task->lock, NULL);
+    cond_init(&task->notified);
+    task->function = function;
+    task->param = param;
+    strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+    return task;
+}
+
+static void *task_entry(void *arg) {
+    current_task = arg;
+    pthread_setname_np(pthread_self(), current_task->name);
+    current_task->function(current_task->param);
+    return NULL; // a FreeRTOS task must not return, but a host thread may
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core) {
+    struct HostTask *task = task_new(function, name, param);
+    if (!task) return pdFAIL;
+    // the handle is published before the task runs, as tasks notify each other through it right away
+    if (created) *created = task;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        ESP_LOGE(TAG, "Cannot start task %s: %s", task->name, strerror(err));
+        if (created) *created = NULL;
+        free(task);
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task && task != current_task) {
+        ESP_LOGE(TAG, "Deleting another task is not supported");
+        return;
+    }
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (!ticks) {
+        sched_yield();
+        return;
+    }
+    uint64_t ms = (uint64_t) ticks * portTICK_PERIOD_MS;
+    struct timespec ts = {.tv_sec = (time_t) (ms / 1000), .tv_nsec = (long) (ms % 1000) * 1000000};
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+static struct timespec tick_start;
+
+static void tick_start_init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &tick_start);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+    pthread_once(&start_once, tick_start_init);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t ms = (int64_t) (now.tv_sec - tick_start.tv_sec) * 1000 + (now.tv_nsec - tick_start.tv_nsec) / 1000000;
+    return (TickType_t) (ms / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (!current_task) {
+        // a thread not started by xTaskCreate, such as main()
+        current_task = task_new(NULL, "host", NULL);
+    }
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    struct HostTask *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&task->lock);
+    while (!task->notify_value && wait_until(&task->notified, &task->lock, ticks, &deadline)) {
+    }
+    uint32_t value = task->notify_value;
+    if (value) task->notify_value = clear_on_exit ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    if (!length) return NULL;
+    struct HostQueue *queue = calloc(1, sizeof(*queue) + (size_t) length * item_size);
+    if (!queue) return NULL;
+    pthread_mutex_init(&queue->lock, NULL);
+    cond_init(&queue->not_empty);
+    cond_init(&queue->not_full);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (!queue) return;
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void *item, TickType_t ticks, bool to_front) {
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (!wait_until(&queue->not_full, &queue->lock, ticks, &deadline) && queue->count == queue->length) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    size_t slot;
+    if (to_front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    } else {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+    if (queue->item_size) memcpy(&queue->items[slot * queue->item_size], item, queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    return queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    return queue_send(queue, item, ticks, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->count) {
+        if (!wait_until(&queue->not_empty, &queue->lock, ticks, &deadline) && !queue->count) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->item_size) memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    size_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return (UBaseType_t) count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    size_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return (UBaseType_t) spaces;
+}
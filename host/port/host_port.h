@@ -0,0 +1,68 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_PORT_H
+#define HOST_PORT_H
+
+/*
+ * Host-only controls of the simulated peripherals behind the ESP-IDF stubs.
+ * Call them before the probe code initializes the peripheral.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "driver/uart.h"
+
+/**
+ * Feed the RX side of port from source: a file, a FIFO, a pty or a memory
+ * stream. A capture (main/bus_capture.h), recognized by its header, is
+ * delivered one receive event at a time with its recorded timing; any other
+ * source is taken as raw bus bytes paced at the configured baud rate. speed
+ * multiplies the pace, 0 delivers as fast as the receiver takes the bytes.
+ * With loop, a seekable source is restarted at its end. Takes effect in
+ * uart_driver_install().
+ */
+void host_uart_attach(uart_port_t port, FILE *source, double speed, bool loop);
+
+/**
+ * The source of port has ended and every byte was handed to the receiver
+ */
+bool host_uart_finished(uart_port_t port);
+
+/**
+ * Bytes fed to port so far
+ */
+uint64_t host_uart_bytes(uart_port_t port);
+
+/**
+ * Back the data partition label with the file at path, created and erased
+ * (0xFF) up to size bytes if it is shorter. The content survives restarts.
+ * Up to four partitions can be attached.
+ */
+bool host_partition_attach(const char *label, const char *path, uint32_t size);
+
+typedef struct {
+    uint32_t messages; // accepted by the client
+    uint64_t bytes; // payload bytes of accepted messages
+    uint32_t acked; // QoS 1 messages acknowledged
+    uint32_t refused; // publish failed, -1
+    uint32_t outbox_full; // publish failed, -2
+} HostMqttStats;
+
+/**
+ * Delay between publishing a QoS 1 message and its PUBACK when there is no broker
+ */
+void host_mqtt_set_ack_delay_ms(uint32_t ms);
+
+/**
+ * Print every published message to out as "topic payload", NULL to stop.
+ * Binary payloads are shown by their length.
+ */
+void host_mqtt_set_echo(FILE *out);
+
+void host_mqtt_get_stats(HostMqttStats *out);
+
+#endif // HOST_PORT_H
@@ -0,0 +1,335 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#define _GNU_SOURCE
+#include "host_port.h"
+#include "mqtt_client.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef PROBE_HOST_MOSQUITTO
+#include <mosquitto.h>
+#endif
+
+static const char *TAG = "mqtt_host";
+
+#define MQTT_HOST_EVENT_BASE "MQTT_EVENTS"
+#define MQTT_HOST_DEFAULT_PORT 1883
+#define MQTT_HOST_KEEPALIVE_S 60
+
+// QoS 1 message in the outbox, waiting for its PUBACK
+typedef struct PendingMessage {
+    struct PendingMessage *next;
+    int msg_id;
+    int len;
+    int64_t due_us; // sink only: when the PUBACK arrives
+} PendingMessage;
+
+struct esp_mqtt_client {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    esp_event_handler_t handler;
+    void *handler_args;
+    uint64_t outbox_limit;
+    int outbox_bytes;
+    PendingMessage *pending_head;
+    PendingMessage *pending_tail;
+    int next_msg_id;
+    bool started;
+#ifdef PROBE_HOST_MOSQUITTO
+    struct mosquitto *mosq; // NULL - no broker, the sink acknowledges
+    char host[128];
+    int port;
+#endif
+};
+
+static atomic_uint ack_delay_ms;
+static FILE *_Atomic echo_out;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static HostMqttStats stats;
+
+void host_mqtt_set_ack_delay_ms(uint32_t ms) {
+    atomic_store(&ack_delay_ms, ms);
+}
+
+void host_mqtt_set_echo(FILE *out) {
+    atomic_store(&echo_out, out);
+}
+
+void host_mqtt_get_stats(HostMqttStats *out) {
+    pthread_mutex_lock(&stats_lock);
+    *out = stats;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id) {
+    if (!client->handler) return;
+    esp_mqtt_event_t event = {.event_id = id, .client = client, .msg_id = msg_id};
+    client->handler(client->handler_args, MQTT_HOST_EVENT_BASE, id, &event);
+}
+
+static void echo(const char *topic, const char *data, int len) {
+    FILE *out = atomic_load(&echo_out);
+    if (!out) return;
+    bool text = true;
+    for (int i = 0; i < len && text; i++) {
+        text = data[i] >= 0x20 || data[i] == '\n' || data[i] == '\t';
+    }
+    flockfile(out);
+    if (text) {
+        fprintf(out, "%s %.*s\n", topic, len, data);
+    } else {
+        fprintf(out, "%s <%d bytes>\n", topic, len);
+    }
+    funlockfile(out);
+}
+
+static void pending_push(esp_mqtt_client_handle_t client, PendingMessage *m) {
+    m->next = NULL;
+    if (client->pending_tail) {
+        client->pending_tail->next = m;
+    } else {
+        client->pending_head = m;
+    }
+    client->pending_tail = m;
+    client->outbox_bytes += m->len;
+}
+
+/**
+ * Take the pending message msg_id off the outbox, NULL if it is not there (QoS 0)
+ */
+static PendingMessage *pending_take(esp_mqtt_client_handle_t client, int msg_id) {
+    PendingMessage *prev = NULL;
+    for (PendingMessage *m = client->pending_head; m; prev = m, m = m->next) {
+        if (m->msg_id != msg_id) continue;
+        if (prev) {
+            prev->next = m->next;
+        } else {
+            client->pending_head = m->next;
+        }
+        if (client->pending_tail == m) client->pending_tail = prev;
+        client->outbox_bytes -= m->len;
+        return m;
+    }
+    return NULL;
+}
+
+static void count_acked(void) {
+    pthread_mutex_lock(&stats_lock);
+    stats.acked++;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * Broker stand-in: acknowledges QoS 1 messages in order once their delay has passed
+ */
+static void *sink_ack_thread(void *arg) {
+    esp_mqtt_client_handle_t client = arg;
+    pthread_mutex_lock(&client->lock);
+    while (1) {
+        PendingMessage *m = client->pending_head;
+        if (!m) {
+            pthread_cond_wait(&client->changed, &client->lock);
+            continue;
+        }
+        int64_t wait = m->due_us - esp_timer_get_time();
+        if (wait > 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            int64_t ns = ts.tv_nsec + wait * 1000;
+            ts.tv_sec += (time_t) (ns / 1000000000);
+            ts.tv_nsec = (long) (ns % 1000000000);
+            pthread_cond_timedwait(&client->changed, &client->lock, &ts);
+            continue;
+        }
+        pending_take(client, m->msg_id);
+        pthread_mutex_unlock(&client->lock);
+        count_acked();
+        dispatch(client, MQTT_EVENT_PUBLISHED, m->msg_id);
+        free(m);
+        pthread_mutex_lock(&client->lock);
+    }
+    return NULL;
+}
+
+#ifdef PROBE_HOST_MOSQUITTO
+static void on_connect(struct mosquitto *mosq, void *obj, int rc) {
+    if (rc == 0) {
+        dispatch(obj, MQTT_EVENT_CONNECTED, 0);
+    } else {
+        ESP_LOGW(TAG, "Broker refused the connection: %s", mosquitto_connack_string(rc));
+    }
+}
+
+static void on_disconnect(struct mosquitto *mosq, void *obj, int rc) {
+    dispatch(obj, MQTT_EVENT_DISCONNECTED, 0);
+}
+
+static void on_publish(struct mosquitto *mosq, void *obj, int mid) {
+    esp_mqtt_client_handle_t client = obj;
+    pthread_mutex_lock(&client->lock);
+    PendingMessage *m = pending_take(client, mid);
+    pthread_mutex_unlock(&client->lock);
+    if (!m) return; // QoS 0, nothing to acknowledge
+    count_acked();
+    dispatch(client, MQTT_EVENT_PUBLISHED, mid);
+    free(m);
+}
+
+/**
+ * host[:port] of mqtt://host:port, tcp://host:port or a bare host, as esp-mqtt accepts
+ */
+static void parse_uri(esp_mqtt_client_handle_t client, const char *uri) {
+    const char *host = strstr(uri, "://");
+    host = host ? host + 3 : uri;
+    size_t len = strcspn(host, ":/");
+    if (len >= sizeof(client->host)) len = sizeof(client->host) - 1;
+    memcpy(client->host, host, len);
+    client->host[len] = '\0';
+    client->port = host[len] == ':' ? atoi(host + len + 1) : MQTT_HOST_DEFAULT_PORT;
+}
+
+static bool broker_init(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *config) {
+    mosquitto_lib_init();
+    parse_uri(client, config->broker.address.uri);
+    client->mosq = mosquitto_new(config->credentials.client_id, true, client);
+    if (!client->mosq) return false;
+    if (config->credentials.username) {
+        mosquitto_username_pw_set(client->mosq, config->credentials.username,
+                                  config->credentials.authentication.password);
+    }
+    mosquitto_connect_callback_set(client->mosq, on_connect);
+    mosquitto_disconnect_callback_set(client->mosq, on_disconnect);
+    mosquitto_publish_callback_set(client->mosq, on_publish);
+    mosquitto_reconnect_delay_set(client->mosq, 1, 10, false);
+    return true;
+}
+#endif
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(*client));
+    if (!client) return NULL;
+    pthread_mutex_init(&client->lock, NULL);
+    pthread_cond_init(&client->changed, NULL);
+    client->outbox_limit = config ? config->outbox.limit : 0;
+#ifdef PROBE_HOST_MOSQUITTO
+    if (config && config->broker.address.uri && config->broker.address.uri[0] && !broker_init(client, config)) {
+        ESP_LOGE(TAG, "Cannot create the mosquitto client");
+        free(client);
+        return NULL;
+    }
+#endif
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args) {
+    if (!client || event != (esp_mqtt_event_id_t) ESP_EVENT_ANY_ID) return ESP_ERR_INVALID_ARG;
+    client->handler = handler;
+    client->handler_args = handler_args;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    if (!client || client->started) return ESP_ERR_INVALID_STATE;
+    client->started = true;
+#ifdef PROBE_HOST_MOSQUITTO
+    if (client->mosq) {
+        ESP_LOGI(TAG, "Connecting to %s:%d", client->host, client->port);
+        int rc = mosquitto_connect_async(client->mosq, client->host, client->port, MQTT_HOST_KEEPALIVE_S);
+        if (rc != MOSQ_ERR_SUCCESS) {
+            ESP_LOGW(TAG, "Broker not reachable yet: %s", mosquitto_strerror(rc));
+        }
+        // the loop thread keeps reconnecting, as the ESP client does
+        return mosquitto_loop_start(client->mosq) == MOSQ_ERR_SUCCESS ? ESP_OK : ESP_FAIL;
+    }
+#endif
+    ESP_LOGI(TAG, "No broker, the sink acknowledges QoS 1 messages after %u ms", atomic_load(&ack_delay_ms));
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, sink_ack_thread, client) != 0) return ESP_FAIL;
+    pthread_detach(thread);
+    dispatch(client, MQTT_EVENT_CONNECTED, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) {
+#ifdef PROBE_HOST_MOSQUITTO
+    if (client && client->mosq) {
+        mosquitto_disconnect(client->mosq);
+        mosquitto_loop_stop(client->mosq, false);
+        return ESP_OK;
+    }
+#endif
+    return ESP_ERR_INVALID_STATE;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain) {
+    if (!client || !topic || !client->started) return -1;
+    if (len <= 0) len = data ? (int) strlen(data) : 0;
+
+    PendingMessage *m = NULL;
+    if (qos > 0) {
+        m = calloc(1, sizeof(*m));
+        if (!m) return -1;
+    }
+
+    int msg_id = 0;
+    pthread_mutex_lock(&client->lock);
+    if (m && client->outbox_limit && (uint64_t) (client->outbox_bytes + len) > client->outbox_limit) {
+        pthread_mutex_unlock(&client->lock);
+        free(m);
+        pthread_mutex_lock(&stats_lock);
+        stats.outbox_full++;
+        pthread_mutex_unlock(&stats_lock);
+        return -2;
+    }
+#ifdef PROBE_HOST_MOSQUITTO
+    if (client->mosq) {
+        // the lock is held so that the PUBACK cannot be handled before the message is pending
+        if (mosquitto_publish(client->mosq, &msg_id, topic, len, data, qos, retain) != MOSQ_ERR_SUCCESS) {
+            msg_id = -1;
+        }
+    } else
+#endif
+    if (m) {
+        msg_id = ++client->next_msg_id;
+        if (msg_id <= 0) msg_id = client->next_msg_id = 1;
+        m->due_us = esp_timer_get_time() + (int64_t) atomic_load(&ack_delay_ms) * 1000;
+    }
+    if (m && msg_id >= 0) {
+        m->msg_id = msg_id;
+        m->len = len;
+        pending_push(client, m);
+        m = NULL;
+        pthread_cond_signal(&client->changed);
+    }
+    pthread_mutex_unlock(&client->lock);
+    free(m);
+
+    pthread_mutex_lock(&stats_lock);
+    if (msg_id >= 0) {
+        stats.messages++;
+        stats.bytes += (uint64_t) len;
+    } else {
+        stats.refused++;
+    }
+    pthread_mutex_unlock(&stats_lock);
+    if (msg_id >= 0) echo(topic, data, len);
+    return msg_id;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client) {
+    if (!client) return 0;
+    pthread_mutex_lock(&client->lock);
+    int size = client->outbox_bytes;
+    pthread_mutex_unlock(&client->lock);
+    return size;
+}
@@ -0,0 +1,316 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#define _GNU_SOURCE
+#include "host_port.h"
+#include "bus_capture.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *TAG = "uart_host";
+
+#define UART_HOST_FIFO_SIZE 128 // hardware RX FIFO of the ESP32
+#define UART_HOST_DEFAULT_THRESHOLD 120 // IDF driver default of the RX full threshold
+
+typedef struct {
+    bool installed;
+    QueueHandle_t events;
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // bytes added to or taken from the ring
+    uint8_t *ring;
+    size_t ring_size;
+    size_t ring_head;
+    size_t ring_count;
+    atomic_uint baudrate;
+    atomic_int threshold;
+
+    FILE *source;
+    double speed;
+    bool loop;
+    atomic_bool finished;
+    atomic_uint_fast64_t fed;
+    pthread_t feeder;
+    BusCaptureReader capture;
+} HostUart;
+
+static HostUart uarts[UART_NUM_MAX];
+
+static HostUart *uart_get(uart_port_t port) {
+    return port >= 0 && port < UART_NUM_MAX ? &uarts[port] : NULL;
+}
+
+void host_uart_attach(uart_port_t port, FILE *source, double speed, bool loop) {
+    HostUart *u = uart_get(port);
+    if (!u) return;
+    u->source = source;
+    u->speed = speed;
+    u->loop = loop;
+}
+
+bool host_uart_finished(uart_port_t port) {
+    HostUart *u = uart_get(port);
+    if (!u || !atomic_load(&u->finished)) return false;
+    pthread_mutex_lock(&u->lock);
+    bool empty = u->ring_count == 0;
+    pthread_mutex_unlock(&u->lock);
+    return empty && uxQueueMessagesWaiting(u->events) == 0;
+}
+
+uint64_t host_uart_bytes(uart_port_t port) {
+    HostUart *u = uart_get(port);
+    return u ? atomic_load(&u->fed) : 0;
+}
+
+/**
+ * Up to size bytes of the source, fewer when a pty or FIFO has no more right now, 0 at its end
+ */
+static size_t source_read(HostUart *u, uint8_t *buf, size_t size) {
+    int fd = fileno(u->source);
+    if (fd < 0) {
+        return fread(buf, 1, size, u->source); // memory stream
+    }
+    while (1) {
+        ssize_t n = read(fd, buf, size);
+        if (n >= 0) return (size_t) n;
+        if (errno != EINTR) return 0; // EIO: the other side of a pty was closed
+    }
+}
+
+static bool source_rewind(HostUart *u) {
+    int fd = fileno(u->source);
+    if (fd < 0) {
+        rewind(u->source);
+        return true;
+    }
+    return lseek(fd, 0, SEEK_SET) == 0;
+}
+
+static void sleep_until(int64_t due_us) {
+    int64_t wait = due_us - esp_timer_get_time();
+    if (wait <= 0) return;
+    struct timespec ts = {.tv_sec = (time_t) (wait / 1000000), .tv_nsec = (long) (wait % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+/**
+ * Copy a chunk into the RX ring, waiting for the receiver to make room rather than overrunning
+ */
+static void ring_put(HostUart *u, const uint8_t *data, size_t len) {
+    pthread_mutex_lock(&u->lock);
+    while (u->ring_size - u->ring_count < len) {
+        pthread_cond_wait(&u->changed, &u->lock);
+    }
+    for (size_t i = 0; i < len; i++) {
+        u->ring[(u->ring_head + u->ring_count + i) % u->ring_size] = data[i];
+    }
+    u->ring_count += len;
+    pthread_cond_broadcast(&u->changed);
+    pthread_mutex_unlock(&u->lock);
+}
+
+/**
+ * Hand a chunk to the receiver the way the UART ISR does: into the RX ring,
+ * announced with a UART_DATA event
+ */
+static void deliver(HostUart *u, const uint8_t *data, size_t len, bool timeout) {
+    ring_put(u, data, len);
+    atomic_fetch_add(&u->fed, len);
+    uart_event_t event = {.type = UART_DATA, .size = len, .timeout_flag = timeout};
+    xQueueSend(u->events, &event, portMAX_DELAY);
+}
+
+/**
+ * Raw bytes: every chunk arrives once its last character would have been on
+ * the wire, flagged as a timeout flush when the source paused before a full
+ * threshold. chunk holds n bytes already read from the source.
+ */
+static void feed_raw(HostUart *u, uint8_t *chunk, size_t n, size_t want) {
+    int64_t due_us = esp_timer_get_time();
+    while (n) {
+        if (u->speed > 0) {
+            // 8N1: ten bits per character
+            due_us += (int64_t) ((double) n * 10 * 1000000 / (atomic_load(&u->baudrate) * u->speed));
+            sleep_until(due_us);
+        }
+        deliver(u, chunk, n, n < want);
+        want = (size_t) atomic_load(&u->threshold);
+        n = source_read(u, chunk, want);
+    }
+}
+
+typedef struct {
+    HostUart *u;
+    const uint8_t *head; // bytes read to recognize the capture
+    size_t head_len;
+} CaptureSource;
+
+static size_t capture_read(void *ctx, uint8_t *buf, size_t size) {
+    CaptureSource *src = ctx;
+    if (src->head_len) {
+        size_t n = size < src->head_len ? size : src->head_len;
+        memcpy(buf, src->head, n);
+        src->head += n;
+        src->head_len -= n;
+        return n;
+    }
+    return source_read(src->u, buf, size);
+}
+
+/**
+ * A capture: every recorded receive event arrives at its recorded time, relative to the first one
+ */
+static void feed_capture(HostUart *u, const uint8_t *head, size_t head_len) {
+    CaptureSource src = {.u = u, .head = head, .head_len = head_len};
+    BusCaptureChunk chunk;
+    int64_t start_us = esp_timer_get_time();
+    int64_t first_us = 0;
+    uint32_t chunks = 0;
+
+    bus_capture_reader_init(&u->capture, capture_read, &src);
+    while (bus_capture_next(&u->capture, &chunk)) {
+        if (!chunks++) first_us = chunk.last_us;
+        if (u->speed > 0) sleep_until(start_us + (int64_t) ((double) (chunk.last_us - first_us) / u->speed));
+        deliver(u, chunk.data, chunk.length, false);
+    }
+    ESP_LOGI(TAG, "Replayed %lu receive events of the capture", (unsigned long) chunks);
+}
+
+/**
+ * Plays the role of the UART ISR, fed from the attached source
+ */
+static void *feeder_thread(void *arg) {
+    HostUart *u = arg;
+    uint8_t chunk[UART_HOST_FIFO_SIZE];
+
+    while (1) {
+        size_t want = (size_t) atomic_load(&u->threshold);
+        size_t n = source_read(u, chunk, want);
+        if (n && bus_capture_detect(chunk, n)) {
+            feed_capture(u, chunk, n);
+        } else if (n) {
+            feed_raw(u, chunk, n, want);
+        }
+        if (!n || !u->loop || !source_rewind(u)) break;
+    }
+    atomic_store(&u->finished, true);
+    ESP_LOGI(TAG, "Feed ended after %llu bytes", (unsigned long long) atomic_load(&u->fed));
+    return NULL;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags) {
+    HostUart *u = uart_get(port);
+    if (!u || u->installed || rx_buffer_size <= UART_HOST_FIFO_SIZE) return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_init(&u->lock, NULL);
+    pthread_cond_init(&u->changed, NULL);
+    u->ring = malloc((size_t) rx_buffer_size);
+    u->events = xQueueCreate(queue_size > 0 ? (UBaseType_t) queue_size : 1, sizeof(uart_event_t));
+    if (!u->ring || !u->events) return ESP_ERR_NO_MEM;
+    u->ring_size = (size_t) rx_buffer_size;
+    if (!atomic_load(&u->threshold)) atomic_store(&u->threshold, UART_HOST_DEFAULT_THRESHOLD);
+    if (!atomic_load(&u->baudrate)) atomic_store(&u->baudrate, 115200);
+    if (uart_queue) *uart_queue = u->events;
+    u->installed = true;
+
+    if (!u->source) {
+        ESP_LOGW(TAG, "UART%d has no source attached, nothing will be received", port);
+        atomic_store(&u->finished, true);
+        return ESP_OK;
+    }
+    if (pthread_create(&u->feeder, NULL, feeder_thread, u) != 0) return ESP_FAIL;
+    pthread_detach(u->feeder);
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port) {
+    return ESP_ERR_INVALID_STATE; // the feeder owns the ring until the process exits
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config) {
+    HostUart *u = uart_get(port);
+    if (!u || !config || config->baud_rate <= 0) return ESP_ERR_INVALID_ARG;
+    atomic_store(&u->baudrate, (unsigned) config->baud_rate);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num) {
+    return uart_get(port) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baudrate) {
+    HostUart *u = uart_get(port);
+    if (!u || !baudrate) return ESP_ERR_INVALID_ARG;
+    atomic_store(&u->baudrate, baudrate);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold) {
+    HostUart *u = uart_get(port);
+    if (!u || threshold <= 0 || threshold > UART_HOST_FIFO_SIZE) return ESP_ERR_INVALID_ARG;
+    atomic_store(&u->threshold, threshold); // taken by the feeder for the next chunk
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t symbols) {
+    return uart_get(port) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks) {
+    HostUart *u = uart_get(port);
+    if (!u || !u->installed) return -1;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t ns = (uint64_t) deadline.tv_nsec + (uint64_t) ticks * portTICK_PERIOD_MS * 1000000;
+    deadline.tv_sec += (time_t) (ns / 1000000000);
+    deadline.tv_nsec = (long) (ns % 1000000000);
+
+    pthread_mutex_lock(&u->lock);
+    while (u->ring_count < length && ticks) {
+        int err = ticks == portMAX_DELAY ? pthread_cond_wait(&u->changed, &u->lock)
+                                         : pthread_cond_timedwait(&u->changed, &u->lock, &deadline);
+        if (err == ETIMEDOUT) break;
+    }
+    size_t n = u->ring_count < length ? u->ring_count : length;
+    uint8_t *out = buf;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = u->ring[(u->ring_head + i) % u->ring_size];
+    }
+    u->ring_head = (u->ring_head + n) % u->ring_size;
+    u->ring_count -= n;
+    pthread_cond_broadcast(&u->changed);
+    pthread_mutex_unlock(&u->lock);
+    return (int) n;
+}
+
+esp_err_t uart_flush_input(uart_port_t port) {
+    HostUart *u = uart_get(port);
+    if (!u || !u->installed) return ESP_ERR_INVALID_STATE;
+    pthread_mutex_lock(&u->lock);
+    u->ring_head = 0;
+    u->ring_count = 0;
+    pthread_cond_broadcast(&u->changed);
+    pthread_mutex_unlock(&u->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size) {
+    HostUart *u = uart_get(port);
+    if (!u || !u->installed || !size) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&u->lock);
+    *size = u->ring_count;
+    pthread_mutex_unlock(&u->lock);
+    return ESP_OK;
+}
@@ -0,0 +1,380 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * The probe pipeline on a Linux host: UART framing, packet router, record
+ * pool, offline store and MQTT publisher, wired as app_main() does on the
+ * ESP32. Bus traffic comes from a capture (main/bus_capture.h), raw bytes in
+ * a file, a FIFO or a pty, synthetic poll cycles (main/pylon_synth.h) or the
+ * built-in mock lines of main/sample_data.h, optionally at a multiple of its
+ * pace. Messages go to a local broker (-b) or
+ * to an acknowledging sink. The received bus can be recorded as a capture (-c).
+ * A build with PROBE_HOST_BUS_COUNT 2 receives two buses, each fed from its own input.
+ */
+#define _GNU_SOURCE
+#include "host_port.h"
+#include "uart_listener.h"
+#include "packet_router.h"
+#include "mqtt_queue.h"
+#include "probe_diag.h"
+#include "record_pool.h"
+#include "flash_store.h"
+#include "bus_recorder.h"
+#include "hot_log.h"
+#include "pylon_synth.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+static const char *TAG = "probe_sim";
+
+#define SIM_STORE_SIZE (512 * 1024) // "store" partition of partitions.csv
+#define SIM_CAPTURE_SIZE (1024 * 1024) // "capture" partition of partitions.csv
+#define SIM_POLL_MS 100
+#define SIM_IDLE_POLLS 5 // nothing moved for this long after the feed ended: done
+#define SIM_SYNTH_CYCLES 1000 // poll cycles of synthetic traffic fed before the input ends
+
+// Defined by uart_listener.c, which includes main/sample_data.h
+extern const char *mock_data_lines[];
+extern const size_t mock_data_lines_count;
+
+static const PylonBusPort bus_ports[] = PYLON_BUS_PORTS;
+
+typedef struct {
+    const char *inputs[PYLON_BUS_COUNT]; // NULL: the mock lines
+    const char *broker;
+    const char *store;
+    const char *capture;
+    PylonSynthConfig synth;
+    double speed;
+    bool loop;
+    bool echo;
+    uint32_t ack_delay_ms;
+    uint32_t duration_s;
+    uint32_t report_s;
+} SimOptions;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] [capture | raw bytes | fifo | pty]...\n"
+            "Replays RS-485 traffic through the probe pipeline, one input per bus (%d);\n"
+            "a bus without an input gets the mock lines.\n"
+            "  -s speed   multiple of the recorded pace or the %d baud bus rate, 0 - as fast as possible (default 1)\n"
+            "  -l         restart the input at its end\n"
+            "  -t sec     stop after sec seconds (default: when the input ends)\n"
+            "  -r sec     print statistics every sec seconds\n"
+            "  -b uri     publish to an MQTT broker, e.g. mqtt://localhost:1883\n"
+            "  -a ms      PUBACK delay of the built-in sink when there is no broker (default 0)\n"
+            "  -f file    back the \"store\" flash partition with file\n"
+            "  -c file    record the bus to the \"capture\" flash partition backed by file\n"
+            "  -g packs[:cells[:bad]]  feed %d poll cycles of synthetic packs to every bus instead of inputs,\n"
+            "             cells per pack (default 16), bad frames per thousand (default 0)\n"
+            "  -p         print published messages to stdout\n",
+            argv0, PYLON_BUS_COUNT, CONFIG_PROBE_UART_BAUDRATE, SIM_SYNTH_CYCLES);
+}
+
+static bool parse_options(int argc, char **argv, SimOptions *opt) {
+    *opt = (SimOptions) {.speed = 1};
+    int c;
+    while ((c = getopt(argc, argv, "s:lt:r:b:a:f:c:g:ph")) != -1) {
+        switch (c) {
+            case 's': opt->speed = atof(optarg); break;
+            case 'l': opt->loop = true; break;
+            case 't': opt->duration_s = (uint32_t) atoi(optarg); break;
+            case 'r': opt->report_s = (uint32_t) atoi(optarg); break;
+            case 'b': opt->broker = optarg; break;
+            case 'a': opt->ack_delay_ms = (uint32_t) atoi(optarg); break;
+            case 'f': opt->store = optarg; break;
+            case 'c': opt->capture = optarg; break;
+            case 'g': {
+                unsigned packs = 0, cells = 16, bad = 0;
+                if (sscanf(optarg, "%u:%u:%u", &packs, &cells, &bad) < 1) return false;
+                opt->synth = (PylonSynthConfig) {
+                    .packs = (uint8_t) packs, .cells = (uint8_t) cells, .temperatures = 6,
+                    .corrupt_per_mille = (uint16_t) bad, .seed = 1,
+                };
+                PylonSynth check;
+                if (packs > UINT8_MAX || cells > UINT8_MAX || !pylon_synth_init(&check, &opt->synth)) return false;
+                break;
+            }
+            case 'p': opt->echo = true; break;
+            default: return false;
+        }
+    }
+    for (size_t b = 0; b < PYLON_BUS_COUNT && optind < argc && !opt->synth.packs; b++) {
+        opt->inputs[b] = argv[optind++];
+    }
+    return optind == argc && opt->speed >= 0;
+}
+
+typedef struct {
+    PylonSynth synth;
+    uint32_t end_cycle;
+    char frame[PYLON_SYNTH_MAX_FRAME];
+    size_t pos;
+    size_t len;
+} SynthSource;
+
+static SynthSource synth_sources[PYLON_BUS_COUNT];
+
+/**
+ * The generated frames, SIM_SYNTH_CYCLES poll cycles from the start or the last rewind
+ */
+static ssize_t synth_read(void *cookie, char *buf, size_t size) {
+    SynthSource *src = cookie;
+    size_t n = 0;
+    while (n < size) {
+        if (src->pos == src->len) {
+            if (src->synth.cycles == src->end_cycle) break;
+            src->len = pylon_synth_next(&src->synth, src->frame);
+            src->pos = 0;
+        }
+        size_t take = src->len - src->pos < size - n ? src->len - src->pos : size - n;
+        memcpy(&buf[n], &src->frame[src->pos], take);
+        src->pos += take;
+        n += take;
+    }
+    return (ssize_t) n;
+}
+
+/**
+ * Rewinding continues the traffic with the packs as they are, it does not repeat it
+ */
+static int synth_seek(void *cookie, off64_t *offset, int whence) {
+    SynthSource *src = cookie;
+    if (*offset != 0 || whence != SEEK_SET) return -1;
+    src->end_cycle = src->synth.cycles + SIM_SYNTH_CYCLES;
+    return 0;
+}
+
+/**
+ * Synthetic traffic of a bus, every bus with its own packs
+ */
+static FILE *open_synth(size_t bus, const PylonSynthConfig *config) {
+    SynthSource *src = &synth_sources[bus];
+    PylonSynthConfig bus_config = *config;
+    bus_config.seed += (uint32_t) bus;
+    if (!pylon_synth_init(&src->synth, &bus_config)) return NULL;
+    src->end_cycle = SIM_SYNTH_CYCLES;
+    return fopencookie(src, "r", (cookie_io_functions_t) {.read = synth_read, .seek = synth_seek});
+}
+
+/**
+ * The bus bytes: the input path, or the mock lines with the EOI they are stored without
+ */
+static FILE *open_input(const char *path) {
+    if (!path) {
+        char *buf = NULL;
+        size_t size = 0;
+        FILE *mem = open_memstream(&buf, &size);
+        for (size_t i = 0; i < mock_data_lines_count; i++) {
+            fputs(mock_data_lines[i], mem);
+            fputc(PYLON_EOI, mem);
+        }
+        fclose(mem);
+        return fmemopen(buf, size, "r");
+    }
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) return NULL;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio); // a pty: bytes as they come, no line discipline
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fdopen(fd, "rb");
+}
+
+// Same as in main.c
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = event_data;
+    switch ((esp_mqtt_event_id_t) event_id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "MQTT connected");
+            mqtt_publish_set_connected(true);
+            packet_router_set_online(true);
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            ESP_LOGW(TAG, "MQTT disconnected");
+            packet_router_set_online(false);
+            mqtt_publish_set_connected(false);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            mqtt_publish_completed(true);
+            break;
+        case MQTT_EVENT_DELETED:
+            ESP_LOGW(TAG, "MQTT message %d expired in the outbox", event->msg_id);
+            mqtt_publish_completed(false);
+            break;
+        default:
+            break;
+    }
+}
+
+static esp_mqtt_client_handle_t mqtt_init(const char *broker) {
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = broker,
+        .credentials.client_id = "probe_sim",
+        .outbox.limit = CONFIG_PROBE_MQTT_OUTBOX_LIMIT_KB * 1024,
+        .buffer.size = 1024,
+        .buffer.out_size = MQTT_MAX_PAYLOAD_LEN,
+    };
+    esp_mqtt_client_handle_t mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
+    if (!mqtt_client) return NULL;
+    esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    mqtt_publish_set_client(mqtt_client);
+    return mqtt_client;
+}
+
+static void print_stats(int64_t elapsed_us) {
+    double s = (double) elapsed_us / 1e6;
+    double bus_bytes_per_s = CONFIG_PROBE_UART_BAUDRATE / 10.0;
+    HostMqttStats mqtt;
+    host_mqtt_get_stats(&mqtt);
+    RecordPoolStats pool;
+    record_pool_stats(&pool);
+    MqttPublishStats publisher;
+    mqtt_publish_stats(&publisher);
+
+    for (uint8_t b = 0; b < PYLON_BUS_COUNT; b++) {
+        uint64_t fed = host_uart_bytes(bus_ports[b].port);
+        PylonRxStats rx;
+        pylon_uart_get_stats(b, &rx);
+        fprintf(stderr, "%.1f s: bus %u fed %llu bytes, %.0f B/s, %.1fx a %d baud bus\n", s, b + 1,
+                (unsigned long long) fed, fed / s, fed / s / bus_bytes_per_s, CONFIG_PROBE_UART_BAUDRATE);
+        fprintf(stderr, "  frames %lu (%.1f/s), dropped %lu, overruns %lu\n", (unsigned long) rx.frames,
+                rx.frames / s, (unsigned long) rx.dropped, (unsigned long) rx.overruns);
+    }
+    fprintf(stderr, "  mqtt %lu messages (%.1f/s), %llu payload bytes, acked %lu, refused %lu, outbox full %lu\n",
+            (unsigned long) mqtt.messages, mqtt.messages / s, (unsigned long long) mqtt.bytes,
+            (unsigned long) mqtt.acked, (unsigned long) mqtt.refused, (unsigned long) mqtt.outbox_full);
+    fprintf(stderr, "  in flight %lu, outbox %lu bytes, pool %lu/%lu free, min %lu, stored pending %lu\n",
+            (unsigned long) publisher.in_flight, (unsigned long) publisher.outbox_bytes, (unsigned long) pool.free,
+            (unsigned long) pool.size, (unsigned long) pool.min_free, (unsigned long) flash_store_pending());
+    BusRecorderStats recorder;
+    bus_recorder_stats(&recorder);
+    if (recorder.chunks || recorder.dropped) {
+        fprintf(stderr, "  capture %lu events, %lu bytes, %lu dropped, %lu blocks, %lu bytes of flash\n",
+                (unsigned long) recorder.chunks, (unsigned long) recorder.bytes, (unsigned long) recorder.dropped,
+                (unsigned long) recorder.blocks, (unsigned long) recorder.flash_used);
+    }
+    for (size_t b = 0; b < PYLON_BUS_COUNT; b++) {
+        const PylonSynth *synth = &synth_sources[b].synth;
+        if (!synth->frames) continue;
+        fprintf(stderr, "  bus %u synthetic %lu frames, %lu poll cycles, damaged:", (unsigned) b + 1,
+                (unsigned long) synth->frames, (unsigned long) synth->cycles);
+        for (int k = 0; k < PYLON_SYNTH_CORRUPTION_COUNT; k++) {
+            fprintf(stderr, " %s=%lu", pylon_synth_corruption_key((PylonSynthCorruption) k),
+                    (unsigned long) synth->corrupted[k]);
+        }
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "  counters:");
+#define SIM_PRINT_COUNTER(id, key) fprintf(stderr, " %s=%lu", key, (unsigned long) probe_diag_get(id));
+    PROBE_DIAG_COUNTERS(SIM_PRINT_COUNTER)
+#undef SIM_PRINT_COUNTER
+    fprintf(stderr, "\n");
+}
+
+/**
+ * Nothing left to move: the feed has ended, every frame is dispatched and
+ * acknowledged, the capture is written, and neither the pool nor the counters
+ * changed for a while.
+ * A batch waiting for the next poll cycle stays open, so the pool is not
+ * required to be full. active_us is the last time anything moved.
+ */
+static bool pipeline_settled(int64_t now, int64_t *active_us) {
+    static uint32_t last_free, last_published, idle_polls;
+    bool buses_done = true;
+    for (uint8_t b = 0; b < PYLON_BUS_COUNT; b++) {
+        PylonRxStats rx;
+        pylon_uart_get_stats(b, &rx);
+        buses_done = buses_done && host_uart_finished(bus_ports[b].port) && !rx.queued;
+    }
+    MqttPublishStats publisher;
+    mqtt_publish_stats(&publisher);
+    RecordPoolStats pool;
+    record_pool_stats(&pool);
+    BusRecorderStats recorder;
+    bus_recorder_stats(&recorder);
+    uint32_t published = probe_diag_get(DIAG_PUBLISHED) + probe_diag_get(DIAG_PUBLISH_DEFERRED);
+
+    bool quiet = buses_done && !publisher.in_flight && !recorder.pending_blocks &&
+                 pool.free == last_free && published == last_published;
+    last_free = pool.free;
+    last_published = published;
+    if (quiet) {
+        idle_polls++;
+    } else {
+        idle_polls = 0;
+        *active_us = now;
+    }
+    return idle_polls >= SIM_IDLE_POLLS;
+}
+
+int main(int argc, char **argv) {
+    SimOptions opt;
+    if (!parse_options(argc, argv, &opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+    FILE *inputs[PYLON_BUS_COUNT];
+    for (size_t b = 0; b < PYLON_BUS_COUNT; b++) {
+        inputs[b] = opt.synth.packs ? open_synth(b, &opt.synth) : open_input(opt.inputs[b]);
+        if (!inputs[b]) {
+            perror(opt.inputs[b]);
+            return 1;
+        }
+    }
+    if (opt.store && !host_partition_attach(FLASH_STORE_PARTITION_LABEL, opt.store, SIM_STORE_SIZE)) {
+        return 1;
+    }
+    if (opt.capture && !host_partition_attach(BUS_CAPTURE_PARTITION_LABEL, opt.capture, SIM_CAPTURE_SIZE)) {
+        return 1;
+    }
+    host_mqtt_set_ack_delay_ms(opt.ack_delay_ms);
+    host_mqtt_set_echo(opt.echo ? stdout : NULL);
+
+    hot_log_start();
+    mqtt_publish_queue_init(packet_router_defer);
+    packet_router_init();
+    esp_mqtt_client_handle_t mqtt_client = mqtt_init(opt.broker);
+    if (!mqtt_client) return 1;
+    for (size_t b = 0; b < PYLON_BUS_COUNT; b++) {
+        host_uart_attach(bus_ports[b].port, inputs[b], opt.speed, opt.loop);
+    }
+    esp_mqtt_client_start(mqtt_client);
+
+    int64_t start = esp_timer_get_time();
+    if (opt.capture) bus_recorder_start();
+    pylon_uart_init(my_packet_handler, packet_router_tick);
+    probe_diag_start();
+
+    int64_t next_report = start + (int64_t) opt.report_s * 1000000;
+    int64_t end = start;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(SIM_POLL_MS));
+        int64_t now = esp_timer_get_time();
+        if (opt.duration_s && now - start >= (int64_t) opt.duration_s * 1000000) {
+            end = now;
+            break;
+        }
+        if (!opt.loop && pipeline_settled(now, &end)) break;
+        if (opt.report_s && now >= next_report) {
+            print_stats(now - start);
+            next_report += (int64_t) opt.report_s * 1000000;
+        }
+    }
+    print_stats(end - start);
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_DRIVER_UART_H
+#define HOST_STUB_DRIVER_UART_H
+
+/*
+ * Host replacement for the IDF UART driver, implemented in host/port/uart_host.c.
+ *
+ * The receive side behaves like the driver with an event queue: bytes of the
+ * source attached with host_uart_attach() land in the RX ring buffer in
+ * FIFO-sized chunks, each announced by a UART_DATA event, paced at the
+ * configured baud rate times the attach speed factor. There is no transmit side.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "hal/gpio_types.h"
+
+typedef enum {
+    UART_NUM_0,
+    UART_NUM_1,
+    UART_NUM_2,
+    UART_NUM_MAX
+} uart_port_t;
+
+typedef enum {
+    UART_DATA_5_BITS,
+    UART_DATA_6_BITS,
+    UART_DATA_7_BITS,
+    UART_DATA_8_BITS
+} uart_word_length_t;
+
+typedef enum {
+    UART_PARITY_DISABLE = 0,
+    UART_PARITY_EVEN = 2,
+    UART_PARITY_ODD = 3
+} uart_parity_t;
+
+typedef enum {
+    UART_STOP_BITS_1 = 1,
+    UART_STOP_BITS_1_5 = 2,
+    UART_STOP_BITS_2 = 3
+} uart_stop_bits_t;
+
+typedef enum {
+    UART_HW_FLOWCTRL_DISABLE = 0
+} uart_hw_flowcontrol_t;
+
+typedef enum {
+    UART_SCLK_APB = 0,
+    UART_SCLK_DEFAULT = 0
+} uart_sclk_t;
+
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+#define UART_PIN_NO_CHANGE (-1)
+
+typedef enum {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t type;
+    size_t size; // bytes announced by UART_DATA
+    bool timeout_flag; // the chunk was flushed by the RX timeout, the line went idle
+} uart_event_t;
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags);
+
+esp_err_t uart_driver_delete(uart_port_t port);
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+
+esp_err_t uart_set_pin(uart_port_t port, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num);
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baudrate);
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold);
+
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t symbols);
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks);
+
+esp_err_t uart_flush_input(uart_port_t port);
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size);
+
+#endif // HOST_STUB_DRIVER_UART_H
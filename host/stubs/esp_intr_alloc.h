@@ -0,0 +1,12 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_ESP_INTR_ALLOC_H
+#define HOST_STUB_ESP_INTR_ALLOC_H
+
+// Interrupt allocation flags, accepted and ignored by the host drivers
+#define ESP_INTR_FLAG_IRAM (1 << 10)
+
+#endif // HOST_STUB_ESP_INTR_ALLOC_H
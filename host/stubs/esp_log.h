@@ -0,0 +1,73 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Host replacement for ESP-IDF esp_log.h.
+ *
+ * Log calls are compiled but filtered by HOST_LOG_LEVEL (0 = silent), so
+ * benchmarks measure the parser and not stderr. Arguments are still
+ * type-checked by the compiler.
+ */
+#ifndef HOST_STUB_ESP_LOG_H
+#define HOST_STUB_ESP_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifndef HOST_LOG_LEVEL
+#define HOST_LOG_LEVEL ESP_LOG_NONE
+#endif
+
+static inline uint32_t esp_log_timestamp(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+#define HOST_LOG(level, letter, tag, format, ...) \
+    do { \
+        if ((level) <= HOST_LOG_LEVEL) { \
+            fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
+
+#define ESP_LOG_LEVEL(level, tag, format, ...) \
+    do { \
+        if ((level) <= HOST_LOG_LEVEL) { \
+            fprintf(stderr, "%c (%s) " format "\n", "NEWIDV"[level], tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buffer, buff_len, level) \
+    do { \
+        if ((level) <= HOST_LOG_LEVEL) { \
+            const uint8_t *host_log_buf_ = (const uint8_t *) (buffer); \
+            fprintf(stderr, "H (%s)", tag); \
+            for (size_t host_log_i_ = 0; host_log_i_ < (size_t) (buff_len); host_log_i_++) { \
+                fprintf(stderr, " %02X", host_log_buf_[host_log_i_]); \
+            } \
+            fprintf(stderr, "\n"); \
+        } \
+    } while (0)
+
+#endif // HOST_STUB_ESP_LOG_H
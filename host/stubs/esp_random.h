@@ -0,0 +1,16 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_ESP_RANDOM_H
+#define HOST_STUB_ESP_RANDOM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static inline uint32_t esp_random(void) {
+    return ((uint32_t) random() << 16) ^ (uint32_t) random();
+}
+
+#endif // HOST_STUB_ESP_RANDOM_H
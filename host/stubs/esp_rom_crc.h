@@ -0,0 +1,16 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_ESP_ROM_CRC_H
+#define HOST_STUB_ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+/**
+ * CRC32 (IEEE 802.3, reflected) continuing from crc, the same values as the ROM function
+ */
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif // HOST_STUB_ESP_ROM_CRC_H
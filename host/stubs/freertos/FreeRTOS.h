@@ -0,0 +1,51 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_FREERTOS_H
+#define HOST_STUB_FREERTOS_H
+
+/*
+ * Host replacement for the FreeRTOS kernel headers, implemented on POSIX
+ * threads in host/port/freertos_posix.c.
+ *
+ * Tasks are detached threads, priorities, stack sizes and cores are ignored.
+ * A tick is one millisecond. A portMUX is a mutex, so critical sections exclude
+ * each other between tasks but do not mask anything, and must not nest.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE ((BaseType_t) 1)
+#define pdFALSE ((BaseType_t) 0)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t) 0xFFFFFFFFu)
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000))
+
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {PTHREAD_MUTEX_INITIALIZER}
+
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(&(mux)->mutex)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(&(mux)->mutex)
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(...) do { } while (0)
+
+#define IRAM_ATTR
+
+#endif // HOST_STUB_FREERTOS_H
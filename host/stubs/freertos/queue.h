@@ -0,0 +1,36 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_FREERTOS_QUEUE_H
+#define HOST_STUB_FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+
+typedef struct HostQueue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+void vQueueDelete(QueueHandle_t queue);
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#define xQueueSend(queue, item, ticks) xQueueSendToBack(queue, item, ticks)
+
+static inline BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken) {
+    if (woken) *woken = pdFALSE;
+    return xQueueSendToBack(queue, item, 0);
+}
+
+#endif // HOST_STUB_FREERTOS_QUEUE_H
@@ -0,0 +1,25 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_FREERTOS_SEMPHR_H
+#define HOST_STUB_FREERTOS_SEMPHR_H
+
+#include "queue.h"
+
+// As in FreeRTOS, a mutex is a queue of one empty item that starts full
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    QueueHandle_t queue = xQueueCreate(1, 0);
+    if (queue) xQueueSendToBack(queue, NULL, 0);
+    return queue;
+}
+
+#define xSemaphoreTake(semaphore, ticks) xQueueReceive(semaphore, NULL, ticks)
+#define xSemaphoreGive(semaphore) xQueueSendToBack(semaphore, NULL, 0)
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+
+#endif // HOST_STUB_FREERTOS_SEMPHR_H
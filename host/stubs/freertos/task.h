@@ -0,0 +1,42 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_FREERTOS_TASK_H
+#define HOST_STUB_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct HostTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *param);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core);
+
+static inline BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *param,
+                                     UBaseType_t priority, TaskHandle_t *created) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, param, priority, created, 0);
+}
+
+/**
+ * Only a task deleting itself (NULL) is supported
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount(void);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+
+static inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+    xTaskNotifyGive(task);
+    if (woken) *woken = pdFALSE;
+}
+
+#endif // HOST_STUB_FREERTOS_TASK_H
@@ -0,0 +1,17 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_GPIO_TYPES_H
+#define HOST_STUB_GPIO_TYPES_H
+
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_16 = 16,
+    GPIO_NUM_17 = 17,
+    GPIO_NUM_25 = 25,
+    GPIO_NUM_26 = 26,
+} gpio_num_t;
+
+#endif // HOST_STUB_GPIO_TYPES_H
@@ -0,0 +1,11 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_UART_HAL_H
+#define HOST_STUB_UART_HAL_H
+
+// Nothing of the UART HAL is used directly, see driver/uart.h
+
+#endif // HOST_STUB_UART_HAL_H
@@ -0,0 +1,90 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+/*
+ * Host replacement for the esp-mqtt client, implemented in host/port/mqtt_host.c.
+ *
+ * Only the part of the API the probe uses. Messages go to a local broker
+ * through libmosquitto when the host build found it, otherwise to a sink that
+ * acknowledges QoS 1 messages after a configurable delay. Both keep the outbox
+ * accounting of the real client: QoS 1 messages count until their PUBACK and
+ * publishing beyond outbox.limit fails with -2.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+// from esp_event.h
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
+#define ESP_EVENT_ANY_ID (-1)
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef struct {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    int msg_id;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+    struct {
+        struct {
+            const char *uri;
+        } address;
+    } broker;
+    struct {
+        const char *username;
+        const char *client_id;
+        struct {
+            const char *password;
+        } authentication;
+    } credentials;
+    struct {
+        uint64_t limit; // bytes of unacknowledged messages, 0 - unlimited
+    } outbox;
+    struct {
+        int size;
+        int out_size;
+    } buffer;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args);
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+
+/**
+ * Message id, 0 for QoS 0, -1 on failure, -2 when the outbox is full
+ */
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain);
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client);
+
+#endif // MQTT_CLIENT_H
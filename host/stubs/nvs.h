@@ -0,0 +1,31 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOST_STUB_NVS_H
+#define HOST_STUB_NVS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Non-volatile storage kept in memory for the lifetime of the process
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out);
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out);
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value);
+
+esp_err_t nvs_commit(nvs_handle_t handle);
+
+void nvs_close(nvs_handle_t handle);
+
+#endif // HOST_STUB_NVS_H
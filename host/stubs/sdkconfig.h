@@ -0,0 +1,101 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// Kconfig defaults from main/Kconfig for host builds; override with -D
+
+#ifndef CONFIG_PROBE_DEVICE_NAME
+#define CONFIG_PROBE_DEVICE_NAME "probe1"
+#endif
+
+#ifndef CONFIG_PROBE_MQTT_BROKER_TOPIC_PREFIX
+#define CONFIG_PROBE_MQTT_BROKER_TOPIC_PREFIX "sl"
+#endif
+
+#ifndef CONFIG_PROBE_RESPONSE_TIMEOUT_MS
+#define CONFIG_PROBE_RESPONSE_TIMEOUT_MS 2000
+#endif
+
+#ifndef CONFIG_PROBE_OFFLINE_STORE
+#define CONFIG_PROBE_OFFLINE_STORE 1
+#endif
+
+// selected by PROBE_OFFLINE_STORE and PROBE_CAPTURE_FLASH
+#ifndef CONFIG_UART_ISR_IN_IRAM
+#define CONFIG_UART_ISR_IN_IRAM 1
+#endif
+
+#ifndef CONFIG_PROBE_EMULATE_UART
+#define CONFIG_PROBE_EMULATE_UART 0
+#endif
+
+// probe_sim records to the "capture" partition when a file backs it
+#if !defined(CONFIG_PROBE_CAPTURE_NONE) && !defined(CONFIG_PROBE_CAPTURE_MQTT)
+#define CONFIG_PROBE_CAPTURE_FLASH 1
+#endif
+
+#ifndef CONFIG_PROBE_BUS_COUNT
+#define CONFIG_PROBE_BUS_COUNT 1
+#endif
+
+#ifndef CONFIG_PROBE_UART_BAUDRATE
+#define CONFIG_PROBE_UART_BAUDRATE 9600
+#endif
+
+// PROBE_UART_AUTOBAUD is left out: the host feed has no line rate to detect
+
+#ifndef CONFIG_PROBE_RX_FRAME_SLOTS
+#define CONFIG_PROBE_RX_FRAME_SLOTS 8
+#endif
+
+#ifndef CONFIG_PROBE_DIAG_INTERVAL_S
+#define CONFIG_PROBE_DIAG_INTERVAL_S 60
+#endif
+
+#ifndef CONFIG_PROBE_RECORD_POOL_SIZE
+#if defined(CONFIG_PROBE_BATCH_PUBLISH) && CONFIG_PROBE_BUS_COUNT > 1
+#define CONFIG_PROBE_RECORD_POOL_SIZE 72
+#elif defined(CONFIG_PROBE_BATCH_PUBLISH)
+#define CONFIG_PROBE_RECORD_POOL_SIZE 48
+#else
+#define CONFIG_PROBE_RECORD_POOL_SIZE 24
+#endif
+#endif
+
+#if defined(CONFIG_PROBE_BATCH_PUBLISH) && !defined(CONFIG_PROBE_BATCH_TIMEOUT_S)
+#define CONFIG_PROBE_BATCH_TIMEOUT_S 10
+#endif
+
+#ifndef CONFIG_PROBE_STORE_DRAIN_BATCH
+#define CONFIG_PROBE_STORE_DRAIN_BATCH 5
+#endif
+
+#ifndef CONFIG_PROBE_STORE_DRAIN_INTERVAL_MS
+#define CONFIG_PROBE_STORE_DRAIN_INTERVAL_MS 100
+#endif
+
+#ifndef CONFIG_PROBE_MQTT_MAX_IN_FLIGHT
+#define CONFIG_PROBE_MQTT_MAX_IN_FLIGHT 8
+#endif
+
+#ifndef CONFIG_PROBE_MQTT_OUTBOX_LIMIT_KB
+#ifdef CONFIG_PROBE_BATCH_PUBLISH
+#define CONFIG_PROBE_MQTT_OUTBOX_LIMIT_KB 32
+#else
+#define CONFIG_PROBE_MQTT_OUTBOX_LIMIT_KB 16
+#endif
+#endif
+
+#ifndef CONFIG_PROBE_HOT_LOG_LEVEL
+#define CONFIG_PROBE_HOT_LOG_LEVEL 0
+#endif
+
+#ifndef CONFIG_PROBE_HOT_LOG_RING_SIZE
+#define CONFIG_PROBE_HOT_LOG_RING_SIZE 128
+#endif
+
+#endif // SDKCONFIG_H
@@ -0,0 +1,38 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Minimal checks for the host tests: a failed CHECK prints the condition and
+ * its line and the test goes on, TEST_RUN runs one test function and
+ * test_result turns the failures into the exit status for ctest.
+ */
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <stdio.h>
+
+static int test_failures; // each test is a single source file
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            test_failures++; \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+#define TEST_RUN(test) \
+    do { \
+        int failures_before_ = test_failures; \
+        test(); \
+        printf("%s %s\n", test_failures == failures_before_ ? "pass" : "FAIL", #test); \
+    } while (0)
+
+static inline int test_result(void) {
+    return test_failures ? 1 : 0;
+}
+
+#endif // TEST_COMMON_H
@@ -0,0 +1,195 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Recovery and ring behaviour of the flash store (main/flash_store.c) on a
+ * file-backed partition. A second flash_store_init on the same file stands in
+ * for a reboot. Torn writes are made by clearing bits in place, as a write cut
+ * short by a reset would leave them.
+ *
+ * Usage: test_flash_store [partition file]
+ */
+#include "flash_store.h"
+#include "host_port.h"
+#include "esp_partition.h"
+#include "test_common.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_SECTORS 4
+#define SECTOR_HEADER_SIZE 8 // SectorHeader of flash_store.c
+#define RECORD_HEADER_SIZE 12 // RecordHeader of flash_store.c
+
+static const char *store_path = "test_flash_store.bin";
+
+static uint32_t record_span(void) {
+    MqttRecord r = {.kind = MQTT_RECORD_INFO};
+    return (RECORD_HEADER_SIZE + (uint32_t) mqtt_record_size(&r) + 3) & ~3u;
+}
+
+static uint32_t records_per_sector(void) {
+    return (FLASH_STORE_SECTOR_SIZE - SECTOR_HEADER_SIZE) / record_span();
+}
+
+/**
+ * Erased partition of TEST_SECTORS sectors with the store mounted on it
+ */
+static bool mount_fresh(void) {
+    unlink(store_path);
+    return host_partition_attach(FLASH_STORE_PARTITION_LABEL, store_path, TEST_SECTORS * FLASH_STORE_SECTOR_SIZE) &&
+           flash_store_init();
+}
+
+static bool append_id(uint32_t id) {
+    MqttRecord r;
+    memset(&r, 0, sizeof(r));
+    r.kind = MQTT_RECORD_INFO;
+    r.address = (uint8_t) (2 + id % 15);
+    r.time = id;
+    r.data.status.cell_count = 16;
+    r.data.status.cycle_count = (uint16_t) id;
+    return flash_store_append(&r);
+}
+
+/**
+ * Id of the oldest pending record, 0 if there is none
+ */
+static uint32_t peek_id(void) {
+    MqttRecord r;
+    return flash_store_peek(&r) ? r.time : 0;
+}
+
+/**
+ * Clear bytes of the partition at offset, like a write interrupted by a reset
+ */
+static void clear_bytes(uint32_t offset, const void *bits, size_t size) {
+    const esp_partition_t *p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                        FLASH_STORE_PARTITION_LABEL);
+    CHECK(p && esp_partition_write(p, offset, bits, size) == ESP_OK);
+}
+
+static void test_order_survives_reboot(void) {
+    CHECK(mount_fresh());
+    for (uint32_t id = 1; id <= 10; id++) {
+        CHECK(append_id(id));
+    }
+    for (uint32_t id = 1; id <= 3; id++) {
+        CHECK(peek_id() == id);
+        flash_store_consume();
+    }
+
+    CHECK(flash_store_init());
+    CHECK(flash_store_pending() == 7);
+    for (uint32_t id = 4; id <= 10; id++) {
+        CHECK(peek_id() == id);
+        flash_store_consume();
+    }
+    CHECK(flash_store_pending() == 0);
+    CHECK(peek_id() == 0);
+}
+
+static void test_torn_record(void) {
+    CHECK(mount_fresh());
+    for (uint32_t id = 1; id <= 3; id++) {
+        CHECK(append_id(id));
+    }
+    // record 3 lost part of its data, the header of record 4 was cut short after its size
+    uint32_t third = SECTOR_HEADER_SIZE + 2 * record_span();
+    const uint8_t zero = 0;
+    clear_bytes(third + RECORD_HEADER_SIZE + offsetof(MqttRecord, time), &zero, 1);
+    MqttRecord info = {.kind = MQTT_RECORD_INFO};
+    const uint16_t size = (uint16_t) mqtt_record_size(&info);
+    clear_bytes(third + record_span(), &size, sizeof(size));
+
+    uint32_t dropped = flash_store_dropped();
+    CHECK(flash_store_init());
+    CHECK(flash_store_pending() == 4);
+    CHECK(peek_id() == 1);
+    flash_store_consume();
+    CHECK(peek_id() == 2);
+    flash_store_consume();
+    CHECK(peek_id() == 0); // both torn records are skipped as unreadable
+    CHECK(flash_store_dropped() - dropped == 2);
+    CHECK(flash_store_pending() == 0);
+
+    CHECK(append_id(5));
+    CHECK(peek_id() == 5);
+}
+
+static void test_torn_header(void) {
+    CHECK(mount_fresh());
+    CHECK(append_id(1));
+    CHECK(append_id(2));
+    // a size no record has ends the sector's data, the writer moves on to the next sector
+    const uint16_t garbage = 0x0777;
+    clear_bytes(SECTOR_HEADER_SIZE + 2 * record_span(), &garbage, sizeof(garbage));
+
+    CHECK(flash_store_init());
+    CHECK(flash_store_pending() == 2);
+    CHECK(append_id(3));
+    for (uint32_t id = 1; id <= 3; id++) {
+        CHECK(peek_id() == id);
+        flash_store_consume();
+    }
+    CHECK(flash_store_pending() == 0);
+}
+
+static void test_wrap_drops_oldest(void) {
+    CHECK(mount_fresh());
+    uint32_t dropped = flash_store_dropped();
+    uint32_t appended = TEST_SECTORS * records_per_sector() + records_per_sector() / 2;
+    for (uint32_t id = 1; id <= appended; id++) {
+        CHECK(append_id(id));
+    }
+    uint32_t lost = flash_store_dropped() - dropped;
+    uint32_t pending = flash_store_pending();
+    CHECK(lost > 0);
+    CHECK(pending + lost == appended);
+
+    // the newest sector is no longer the last one of the partition
+    CHECK(flash_store_init());
+    CHECK(flash_store_pending() == pending);
+    for (uint32_t id = appended - pending + 1; id <= appended; id++) {
+        CHECK(peek_id() == id);
+        flash_store_consume();
+    }
+    CHECK(peek_id() == 0);
+}
+
+static void test_reader_overtaken(void) {
+    CHECK(mount_fresh());
+    uint32_t per_sector = records_per_sector();
+    uint32_t dropped = flash_store_dropped();
+    for (uint32_t id = 1; id <= per_sector; id++) {
+        CHECK(append_id(id));
+    }
+    CHECK(peek_id() == 1);
+
+    // the writer comes around and reuses the sector the peeked record is in
+    uint32_t appended = TEST_SECTORS * per_sector + 1;
+    for (uint32_t id = per_sector + 1; id <= appended; id++) {
+        CHECK(append_id(id));
+    }
+    uint32_t pending = flash_store_pending();
+    flash_store_consume(); // the peeked record is gone, nothing else may be marked
+    CHECK(flash_store_pending() == pending);
+    CHECK(pending + flash_store_dropped() - dropped == appended);
+    CHECK(peek_id() == appended - pending + 1);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) store_path = argv[1];
+
+    TEST_RUN(test_order_survives_reboot);
+    TEST_RUN(test_torn_record);
+    TEST_RUN(test_torn_header);
+    TEST_RUN(test_wrap_drops_oldest);
+    TEST_RUN(test_reader_overtaken);
+
+    unlink(store_path);
+    return test_result();
+}
@@ -0,0 +1,108 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+
+/*
+ * Slot accounting of the record pool (main/record_pool.c): exhaustion, batch
+ * records returning their packs and the reserve kept for open batches.
+ * Every test leaves the pool with all slots free.
+ */
+#include "record_pool.h"
+#include "probe_diag.h"
+#include "test_common.h"
+
+#include <string.h>
+
+/**
+ * Batch record holding packs newly taken INFO records, NULL if the pool has too few
+ */
+static MqttRecord *alloc_batch(size_t packs) {
+    MqttRecord *batch = record_pool_alloc();
+    if (!batch) return NULL;
+    batch->kind = MQTT_RECORD_BATCH;
+    batch->data.batch.count = 0;
+    while (batch->data.batch.count < packs) {
+        MqttRecord *pack = record_pool_alloc();
+        if (!pack) {
+            record_pool_free(batch);
+            return NULL;
+        }
+        pack->kind = MQTT_RECORD_INFO;
+        batch->data.batch.packs[batch->data.batch.count++] = pack;
+    }
+    return batch;
+}
+
+static void test_alloc_until_exhausted(void) {
+    static MqttRecord *taken[RECORD_POOL_SIZE];
+    for (size_t i = 0; i < RECORD_POOL_SIZE; i++) {
+        taken[i] = record_pool_alloc();
+        CHECK(taken[i] != NULL);
+        for (size_t j = 0; j < i; j++) {
+            CHECK(taken[j] != taken[i]);
+        }
+    }
+    uint32_t exhausted = probe_diag_get(DIAG_POOL_EXHAUSTED);
+    CHECK(record_pool_alloc() == NULL);
+    CHECK(probe_diag_get(DIAG_POOL_EXHAUSTED) == exhausted + 1);
+
+    RecordPoolStats stats;
+    record_pool_stats(&stats);
+    CHECK(stats.size == RECORD_POOL_SIZE && stats.free == 0 && stats.min_free == 0);
+
+    for (size_t i = 0; i < RECORD_POOL_SIZE; i++) {
+        record_pool_free(taken[i]);
+    }
+    CHECK(record_pool_available() == RECORD_POOL_SIZE);
+}
+
+static void test_free_ignores_foreign_records(void) {
+    MqttRecord outside;
+    memset(&outside, 0, sizeof(outside));
+    record_pool_free(&outside);
+    record_pool_free(NULL);
+    CHECK(record_pool_available() == RECORD_POOL_SIZE);
+}
+
+static void test_batch_free_releases_packs(void) {
+    size_t packs = RECORD_POOL_SIZE >= RECORD_POOL_BATCH_SLOTS ? MQTT_RECORD_BATCH_MAX_PACKS : RECORD_POOL_SIZE - 1;
+    for (size_t n = 0; n <= packs; n++) {
+        MqttRecord *batch = alloc_batch(n);
+        CHECK(batch != NULL);
+        CHECK(record_pool_available() == RECORD_POOL_SIZE - n - 1); // a batch of n packs holds n + 1 slots
+        record_pool_free(batch);
+        CHECK(record_pool_available() == RECORD_POOL_SIZE);
+    }
+}
+
+static void test_batch_reserve(void) {
+    MqttRecord *batches[2] = {NULL, NULL};
+    CHECK(record_pool_batch_reserve_left(batches, 2) == 2 * RECORD_POOL_BATCH_SLOTS);
+
+    // what an open batch takes comes off the reserve, the rest of the pool stays untouched
+    batches[1] = alloc_batch(3);
+    CHECK(batches[1] != NULL);
+    CHECK(record_pool_batch_reserve_left(batches, 2) == 2 * RECORD_POOL_BATCH_SLOTS - 4);
+    CHECK(record_pool_available() + 2 * RECORD_POOL_BATCH_SLOTS ==
+          RECORD_POOL_SIZE + record_pool_batch_reserve_left(batches, 2));
+    record_pool_free(batches[1]);
+
+    if (RECORD_POOL_SIZE >= RECORD_POOL_BATCH_SLOTS) {
+        batches[1] = alloc_batch(MQTT_RECORD_BATCH_MAX_PACKS);
+        CHECK(batches[1] != NULL);
+        CHECK(record_pool_batch_reserve_left(batches, 2) == RECORD_POOL_BATCH_SLOTS);
+        CHECK(record_pool_batch_reserve_left(&batches[1], 1) == 0); // a full batch has nothing left to take
+        record_pool_free(batches[1]);
+    }
+    CHECK(record_pool_available() == RECORD_POOL_SIZE);
+}
+
+int main(void) {
+    TEST_RUN(test_alloc_until_exhausted);
+    TEST_RUN(test_free_ignores_foreign_records);
+    TEST_RUN(test_batch_free_releases_packs);
+    TEST_RUN(test_batch_reserve);
+    return test_result();
+}
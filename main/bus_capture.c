@@ -0,0 +1,165 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "bus_capture.h"
+#include <string.h>
+
+#define VARINT_MAX_BYTES_U32 5
+#define VARINT_MAX_BYTES_LENGTH 2 // BUS_CAPTURE_MAX_CHUNK fits in 14 bits
+
+static size_t put_varint(uint8_t *out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t) value;
+    return n;
+}
+
+/**
+ * Decode a varint of at most max_bytes, false if it is longer, overflows 32 bits or is cut off
+ */
+static bool get_varint(const uint8_t *in, size_t avail, size_t max_bytes, uint32_t *value, size_t *used) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < max_bytes && i < avail; i++) {
+        v |= (uint64_t) (in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            if (v > UINT32_MAX) return false;
+            *value = (uint32_t) v;
+            *used = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void bus_capture_writer_init(BusCaptureWriter *w, uint8_t *buf, size_t size) {
+    *w = (BusCaptureWriter) {.buf = buf, .size = size, .segment = size};
+}
+
+void bus_capture_writer_reset(BusCaptureWriter *w, uint8_t *buf) {
+    w->buf = buf;
+    w->used = 0;
+    w->segment = w->size;
+}
+
+bool bus_capture_begin(BusCaptureWriter *w, uint32_t baudrate, uint32_t unix_time, int64_t start_us) {
+    if (w->size - w->used < sizeof(BusCaptureSegment)) return false;
+    BusCaptureSegment h = {
+        .magic = BUS_CAPTURE_MAGIC,
+        .baudrate = baudrate,
+        .length = BUS_CAPTURE_OPEN_LENGTH,
+        .unix_time = unix_time,
+        .start_us = start_us,
+    };
+    memcpy(&w->buf[w->used], &h, sizeof(h));
+    w->segment = w->used;
+    w->used += sizeof(h);
+    w->last_us = start_us;
+    w->started = true;
+    return true;
+}
+
+bool bus_capture_append(BusCaptureWriter *w, const uint8_t *data, size_t len, int64_t last_rx_us) {
+    if (!w->started || len == 0 || len > BUS_CAPTURE_MAX_CHUNK) return false;
+    int64_t gap = last_rx_us - w->last_us;
+    if (gap < 0) gap = 0;
+    if (gap > UINT32_MAX) gap = UINT32_MAX; // a silence of over an hour is shortened
+
+    uint8_t prefix[VARINT_MAX_BYTES_U32 + VARINT_MAX_BYTES_LENGTH];
+    size_t n = put_varint(prefix, (uint32_t) gap);
+    n += put_varint(&prefix[n], (uint32_t) len);
+    if (w->size - w->used < n + len) return false;
+
+    memcpy(&w->buf[w->used], prefix, n);
+    memcpy(&w->buf[w->used + n], data, len);
+    w->used += n + len;
+    w->last_us = last_rx_us;
+    return true;
+}
+
+void bus_capture_close(BusCaptureWriter *w) {
+    if (w->segment >= w->size) return;
+    uint32_t length = (uint32_t) (w->used - w->segment - sizeof(BusCaptureSegment));
+    memcpy(&w->buf[w->segment + offsetof(BusCaptureSegment, length)], &length, sizeof(length));
+}
+
+void bus_capture_reader_init(BusCaptureReader *r, bus_capture_read_t read, void *ctx) {
+    memset(r, 0, sizeof(*r));
+    r->read = read;
+    r->ctx = ctx;
+}
+
+/**
+ * At least n unread bytes in the buffer, unless the capture ends first
+ */
+static bool reader_ensure(BusCaptureReader *r, size_t n) {
+    if (r->end - r->pos >= n) return true;
+    memmove(r->buf, &r->buf[r->pos], r->end - r->pos);
+    r->end -= r->pos;
+    r->pos = 0;
+    while (!r->eof && r->end < sizeof(r->buf)) {
+        size_t got = r->read(r->ctx, &r->buf[r->end], sizeof(r->buf) - r->end);
+        if (!got) r->eof = true;
+        r->end += got;
+    }
+    return r->end - r->pos >= n;
+}
+
+static bool reader_segment(BusCaptureReader *r) {
+    if (!reader_ensure(r, sizeof(BusCaptureSegment))) return false;
+    memcpy(&r->segment, &r->buf[r->pos], sizeof(r->segment));
+    if (r->segment.magic != BUS_CAPTURE_MAGIC || !r->segment.baudrate) return false;
+    r->pos += sizeof(r->segment);
+    r->segment_left = r->segment.length;
+    r->last_us = r->segment.start_us;
+    r->in_segment = true;
+    return true;
+}
+
+bool bus_capture_next(BusCaptureReader *r, BusCaptureChunk *out) {
+    while (1) {
+        if (!r->in_segment && !reader_segment(r)) return false;
+        bool open = r->segment.length == BUS_CAPTURE_OPEN_LENGTH;
+        if (!open && !r->segment_left) {
+            r->in_segment = false;
+            continue;
+        }
+
+        reader_ensure(r, BUS_CAPTURE_MAX_RECORD);
+        const uint8_t *p = &r->buf[r->pos];
+        size_t avail = r->end - r->pos;
+        if (!open && avail > r->segment_left) avail = r->segment_left;
+        uint32_t gap, length;
+        size_t gap_bytes, length_bytes;
+        if (!get_varint(p, avail, VARINT_MAX_BYTES_U32, &gap, &gap_bytes) ||
+            !get_varint(&p[gap_bytes], avail - gap_bytes, VARINT_MAX_BYTES_LENGTH, &length, &length_bytes) ||
+            length == 0 || length > BUS_CAPTURE_MAX_CHUNK || avail - gap_bytes - length_bytes < length) {
+            // the end of an open segment, or a damaged one: nothing after it can be trusted
+            return false;
+        }
+
+        size_t record = gap_bytes + length_bytes + length;
+        r->pos += record;
+        if (!open) r->segment_left -= (uint32_t) record;
+        r->last_us += gap;
+        *out = (BusCaptureChunk) {
+            .last_us = r->last_us,
+            .char_time_us = 10 * 1000000LL / r->segment.baudrate, // 8N1
+            .baudrate = r->segment.baudrate,
+            .data = &p[gap_bytes + length_bytes],
+            .length = length,
+        };
+        return true;
+    }
+}
+
+bool bus_capture_detect(const uint8_t *data, size_t len) {
+    uint32_t magic;
+    if (len < sizeof(magic)) return false;
+    memcpy(&magic, data, sizeof(magic));
+    return magic == BUS_CAPTURE_MAGIC;
+}
@@ -0,0 +1,120 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef BUS_CAPTURE_H
+#define BUS_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Capture of raw RS-485 bus bytes with the time they were received.
+ *
+ * A capture is a sequence of segments. A segment is a BusCaptureSegment header
+ * followed by one record per UART receive event:
+ *
+ *   varint gap_us   time of the last byte after the last byte of the previous
+ *                   record, or after start_us for the first one
+ *   varint length   1..BUS_CAPTURE_MAX_CHUNK
+ *   length bytes    as received, back to back at the segment baud rate
+ *
+ * Varints are unsigned LEB128, so a record costs two to four bytes on top of
+ * its data. A segment of unknown length (still being recorded, or cut short by
+ * a reset) ends at the first record that does not decode; erased flash reads
+ * as 0xFF and never does. Multi-byte header fields are little-endian.
+ */
+
+#define BUS_CAPTURE_MAGIC 0x31434250u // "PBC1"
+#define BUS_CAPTURE_OPEN_LENGTH 0xFFFFFFFFu // segment length not written yet
+#define BUS_CAPTURE_MAX_CHUNK 256
+#define BUS_CAPTURE_MAX_RECORD (5 + 2 + BUS_CAPTURE_MAX_CHUNK) // varint gap, varint length, data
+
+typedef struct {
+    uint32_t magic;
+    uint32_t baudrate;
+    uint32_t length; // bytes of records after the header, BUS_CAPTURE_OPEN_LENGTH if unknown
+    uint32_t unix_time; // wall clock at start_us, as set at the time of recording
+    int64_t start_us; // esp_timer time the first gap counts from
+} BusCaptureSegment;
+
+_Static_assert(sizeof(BusCaptureSegment) == 24, "BusCaptureSegment is stored as is");
+
+/**
+ * Builds segments in a caller-provided buffer. A segment may span several
+ * buffers: after bus_capture_writer_reset the records go to a new buffer and
+ * continue the timeline of the previous one without a new header.
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t used;
+    size_t segment; // offset of the open segment header in buf, size if it is in an earlier buffer
+    int64_t last_us; // receive time of the last byte of the previous record
+    bool started;
+} BusCaptureWriter;
+
+void bus_capture_writer_init(BusCaptureWriter *w, uint8_t *buf, size_t size);
+
+/**
+ * Switch to an empty buffer of the same size; records appended next continue the current segment
+ */
+void bus_capture_writer_reset(BusCaptureWriter *w, uint8_t *buf);
+
+/**
+ * Start a segment with an open length at the current position, false if the header does not fit
+ */
+bool bus_capture_begin(BusCaptureWriter *w, uint32_t baudrate, uint32_t unix_time, int64_t start_us);
+
+/**
+ * Append the bytes of one receive event whose last byte arrived at last_rx_us,
+ * false if the record does not fit or no segment was begun
+ */
+bool bus_capture_append(BusCaptureWriter *w, const uint8_t *data, size_t len, int64_t last_rx_us);
+
+/**
+ * Write the length of the open segment if its header is in this buffer
+ */
+void bus_capture_close(BusCaptureWriter *w);
+
+/**
+ * Supplies up to size bytes of a capture, 0 at its end
+ */
+typedef size_t (*bus_capture_read_t)(void *ctx, uint8_t *buf, size_t size);
+
+typedef struct {
+    int64_t last_us; // receive time of the last byte on the timeline of the capture
+    int64_t char_time_us; // time of one character at the segment baud rate
+    uint32_t baudrate;
+    const uint8_t *data; // valid until the next bus_capture_next
+    size_t length;
+} BusCaptureChunk;
+
+typedef struct {
+    bus_capture_read_t read;
+    void *ctx;
+    uint8_t buf[2 * BUS_CAPTURE_MAX_RECORD];
+    size_t pos;
+    size_t end;
+    bool eof;
+    bool in_segment;
+    BusCaptureSegment segment;
+    uint32_t segment_left; // record bytes left in a segment of known length
+    int64_t last_us;
+} BusCaptureReader;
+
+void bus_capture_reader_init(BusCaptureReader *r, bus_capture_read_t read, void *ctx);
+
+/**
+ * The next record of the capture, false at its end or at the first byte that is not a capture
+ */
+bool bus_capture_next(BusCaptureReader *r, BusCaptureChunk *out);
+
+/**
+ * Whether the first bytes of a file are a capture
+ */
+bool bus_capture_detect(const uint8_t *data, size_t len);
+
+#endif // BUS_CAPTURE_H
@@ -0,0 +1,264 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "bus_recorder.h"
+#include "mqtt_formatter.h"
+#include "mqtt_queue.h"
+#include "packet_router.h"
+#include "probe_diag.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+static const char *TAG = "bus_recorder";
+
+#if defined(CONFIG_PROBE_CAPTURE_FLASH) || defined(CONFIG_PROBE_CAPTURE_MQTT)
+#define BUS_RECORDER_ENABLED 1
+#endif
+
+#define BUS_RECORDER_SECTOR_SIZE 4096
+#define BUS_RECORDER_NO_SEGMENT UINT32_MAX
+
+typedef struct {
+    uint8_t data[BUS_RECORDER_BLOCK_SIZE];
+    size_t used;
+    bool segment_start; // data begins with a segment header
+} RecorderBlock;
+
+_Static_assert(BUS_RECORDER_BLOCK_SIZE >= sizeof(BusCaptureSegment) + BUS_CAPTURE_MAX_RECORD,
+               "a block must hold a segment header and the largest record");
+
+static atomic_uint stat_chunks;
+static atomic_uint stat_bytes;
+static atomic_uint stat_dropped;
+static atomic_uint stat_blocks;
+static atomic_uint stat_flash_used;
+
+#ifdef BUS_RECORDER_ENABLED
+static atomic_bool recording;
+static RecorderBlock blocks[BUS_RECORDER_BLOCKS];
+static QueueHandle_t free_blocks;
+static QueueHandle_t full_blocks;
+
+// Owned by the UART task
+static RecorderBlock *current;
+static BusCaptureWriter writer;
+static uint32_t current_baudrate;
+static int64_t current_opened_us;
+
+static void hand_over(void) {
+    if (!current) return;
+#ifdef CONFIG_PROBE_CAPTURE_MQTT
+    bus_capture_close(&writer);
+#endif
+    current->used = writer.used;
+    xQueueSend(full_blocks, &current, 0); // has room for every block
+    current = NULL;
+}
+
+/**
+ * Take a free block to record into. A segment starts in it when the baud rate
+ * changed and, for MQTT, in every block, so each message decodes on its own.
+ */
+static bool open_block(uint32_t baudrate, int64_t now_us) {
+    if (xQueueReceive(free_blocks, &current, 0) != pdTRUE) {
+        current = NULL;
+        return false;
+    }
+    bus_capture_writer_reset(&writer, current->data);
+#ifdef CONFIG_PROBE_CAPTURE_MQTT
+    current->segment_start = true;
+#else
+    current->segment_start = !writer.started || baudrate != current_baudrate;
+#endif
+    if (current->segment_start) {
+        int64_t start_us = writer.started ? writer.last_us : now_us;
+        time_t unix_time = time(NULL) - (time_t) ((now_us - start_us) / 1000000);
+        bus_capture_begin(&writer, baudrate, (uint32_t) unix_time, start_us);
+        current_baudrate = baudrate;
+    }
+    current_opened_us = now_us;
+    return true;
+}
+#endif
+
+void bus_recorder_chunk(const uint8_t *data, size_t len, int64_t last_rx_us, uint32_t baudrate) {
+#ifdef BUS_RECORDER_ENABLED
+    if (!atomic_load_explicit(&recording, memory_order_relaxed)) return;
+    if (current &&
+        (baudrate != current_baudrate || last_rx_us - current_opened_us >= BUS_RECORDER_FLUSH_MS * 1000LL)) {
+        hand_over();
+    }
+    // a fresh block always has room for a record, so the second attempt only fails without one
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!current && !open_block(baudrate, last_rx_us)) break;
+        if (bus_capture_append(&writer, data, len, last_rx_us)) {
+            atomic_fetch_add_explicit(&stat_chunks, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&stat_bytes, (unsigned) len, memory_order_relaxed);
+            return;
+        }
+        hand_over();
+    }
+    atomic_fetch_add_explicit(&stat_dropped, 1, memory_order_relaxed);
+#endif
+}
+
+void bus_recorder_idle(int64_t now_us) {
+#ifdef BUS_RECORDER_ENABLED
+    if (current && now_us - current_opened_us >= BUS_RECORDER_FLUSH_MS * 1000LL) hand_over();
+#endif
+}
+
+#ifdef CONFIG_PROBE_CAPTURE_FLASH
+static const esp_partition_t *partition;
+static uint32_t write_pos; // end of the capture
+static uint32_t erased_to; // sectors below are erased
+static uint32_t segment_pos = BUS_RECORDER_NO_SEGMENT; // header of the open segment
+
+static bool flash_open(void) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         BUS_CAPTURE_PARTITION_LABEL);
+    if (!partition) {
+        ESP_LOGW(TAG, "No \"%s\" partition, the bus is not recorded", BUS_CAPTURE_PARTITION_LABEL);
+        return false;
+    }
+    uint8_t head[sizeof(BusCaptureSegment)];
+    if (esp_partition_read(partition, 0, head, sizeof(head)) != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot read the \"%s\" partition", BUS_CAPTURE_PARTITION_LABEL);
+        return false;
+    }
+    if (bus_capture_detect(head, sizeof(head))) {
+        ESP_LOGW(TAG, "The \"%s\" partition already holds a capture, erase it to record again",
+                 BUS_CAPTURE_PARTITION_LABEL);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Write the length of the open segment, which ends at end
+ */
+static void flash_close_segment(uint32_t end) {
+    if (segment_pos == BUS_RECORDER_NO_SEGMENT) return;
+    uint32_t length = end - segment_pos - sizeof(BusCaptureSegment);
+    // the field was left erased, writing it only clears bits
+    esp_partition_write(partition, segment_pos + offsetof(BusCaptureSegment, length), &length, sizeof(length));
+    segment_pos = BUS_RECORDER_NO_SEGMENT;
+}
+
+static void flash_stop(void) {
+    flash_close_segment(write_pos);
+    atomic_store(&recording, false);
+}
+
+static bool write_block(const RecorderBlock *b) {
+    if (b->used > partition->size - write_pos) {
+        flash_stop();
+        ESP_LOGW(TAG, "Capture partition full after %lu bytes, recording stopped", (unsigned long) write_pos);
+        return false;
+    }
+    // the cache is off during the erase, the UART interrupt runs from IRAM (PROBE_CAPTURE_FLASH selects it)
+    while (erased_to < write_pos + b->used) {
+        if (esp_partition_erase_range(partition, erased_to, BUS_RECORDER_SECTOR_SIZE) != ESP_OK) {
+            flash_stop();
+            ESP_LOGE(TAG, "Cannot erase the capture partition at 0x%lx, recording stopped",
+                     (unsigned long) erased_to);
+            return false;
+        }
+        erased_to += BUS_RECORDER_SECTOR_SIZE;
+    }
+    if (b->segment_start) {
+        flash_close_segment(write_pos);
+        segment_pos = write_pos;
+    }
+    if (esp_partition_write(partition, write_pos, b->data, b->used) != ESP_OK) {
+        flash_stop();
+        ESP_LOGE(TAG, "Cannot write the capture partition at 0x%lx, recording stopped", (unsigned long) write_pos);
+        return false;
+    }
+    write_pos += (uint32_t) b->used;
+    atomic_store(&stat_flash_used, write_pos);
+    return true;
+}
+#elif defined(CONFIG_PROBE_CAPTURE_MQTT)
+static bool write_block(const RecorderBlock *b) {
+    static MQTTPayload msg;
+    // like diagnostics, a capture is streamed live and not kept while offline
+    if (!packet_router_is_online() || !mqtt_format_capture_payload(b->data, b->used, &msg)) return false;
+    if (!mqtt_publish_now(&msg)) {
+        probe_diag_count(DIAG_PUBLISH_FAILED, 1);
+        return false;
+    }
+    probe_diag_count(DIAG_PUBLISHED, 1);
+    return true;
+}
+#endif
+
+#ifdef BUS_RECORDER_ENABLED
+static void bus_recorder_task(void *param) {
+    uint32_t reported_drops = 0;
+    RecorderBlock *block;
+
+    while (1) {
+        if (xQueueReceive(full_blocks, &block, portMAX_DELAY) != pdTRUE) continue;
+        if (atomic_load(&recording) && write_block(block)) {
+            atomic_fetch_add(&stat_blocks, 1);
+        }
+        xQueueSend(free_blocks, &block, 0);
+
+        uint32_t drops = atomic_load(&stat_dropped);
+        if (drops != reported_drops) {
+            ESP_LOGW(TAG, "%lu receive events not recorded, no free block", (unsigned long) (drops - reported_drops));
+            reported_drops = drops;
+        }
+    }
+}
+#endif
+
+void bus_recorder_start(void) {
+#ifdef BUS_RECORDER_ENABLED
+#ifdef CONFIG_PROBE_CAPTURE_FLASH
+    if (!flash_open()) return;
+#endif
+    free_blocks = xQueueCreate(BUS_RECORDER_BLOCKS, sizeof(RecorderBlock *));
+    full_blocks = xQueueCreate(BUS_RECORDER_BLOCKS, sizeof(RecorderBlock *));
+    if (!free_blocks || !full_blocks) {
+        ESP_LOGE(TAG, "Cannot create the block queues, the bus is not recorded");
+        return;
+    }
+    for (size_t i = 0; i < BUS_RECORDER_BLOCKS; i++) {
+        RecorderBlock *block = &blocks[i];
+        xQueueSend(free_blocks, &block, 0);
+    }
+    bus_capture_writer_init(&writer, NULL, BUS_RECORDER_BLOCK_SIZE);
+    xTaskCreatePinnedToCore(bus_recorder_task, "bus_recorder", 3072, NULL, 2, NULL, 0);
+    atomic_store(&recording, true);
+#ifdef CONFIG_PROBE_CAPTURE_FLASH
+    ESP_LOGI(TAG, "Recording the bus to the \"%s\" partition, %lu KB", BUS_CAPTURE_PARTITION_LABEL,
+             (unsigned long) (partition->size / 1024));
+#else
+    ESP_LOGI(TAG, "Streaming the bus to MQTT");
+#endif
+#else
+    ESP_LOGI(TAG, "Bus capture not configured");
+#endif
+}
+
+void bus_recorder_stats(BusRecorderStats *out) {
+    out->chunks = atomic_load(&stat_chunks);
+    out->bytes = atomic_load(&stat_bytes);
+    out->dropped = atomic_load(&stat_dropped);
+    out->blocks = atomic_load(&stat_blocks);
+    out->flash_used = atomic_load(&stat_flash_used);
+    out->pending_blocks = 0;
+#ifdef BUS_RECORDER_ENABLED
+    if (free_blocks) out->pending_blocks = BUS_RECORDER_BLOCKS - uxQueueMessagesWaiting(free_blocks);
+#endif
+}
@@ -0,0 +1,62 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef BUS_RECORDER_H
+#define BUS_RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bus_capture.h"
+#include "sdkconfig.h"
+
+/*
+ * Records the bytes received on the RS-485 bus as a capture (bus_capture.h),
+ * either to the "capture" flash partition or as binary messages on
+ * <prefix>/<device>/capture.
+ *
+ * The UART task appends every receive event to a RAM block. Blocks are handed
+ * to a low-priority task when full, when the baud rate changes or
+ * BUS_RECORDER_FLUSH_MS after they were started, and that task writes or
+ * publishes them. The UART task never waits: events arriving while every
+ * block is still queued are dropped and counted.
+ *
+ * The flash partition holds one capture. Recording stops when it is full, and
+ * a partition that already holds a capture is left alone until it is erased,
+ * so a reboot after an incident does not overwrite the recording.
+ */
+
+#define BUS_CAPTURE_PARTITION_LABEL "capture"
+#define BUS_RECORDER_BLOCK_SIZE 512 // fits an MQTT payload in every configuration
+#define BUS_RECORDER_BLOCKS 4
+#define BUS_RECORDER_FLUSH_MS 1000
+
+typedef struct {
+    uint32_t chunks; // receive events recorded
+    uint32_t bytes; // bus bytes recorded
+    uint32_t dropped; // receive events lost because no block was free
+    uint32_t blocks; // blocks written to flash or published
+    uint32_t flash_used; // bytes of the partition taken by the capture
+    uint32_t pending_blocks; // being filled or waiting to be written
+} BusRecorderStats;
+
+/**
+ * Start recording as configured by CONFIG_PROBE_CAPTURE_*; does nothing without a capture destination
+ */
+void bus_recorder_start(void);
+
+/**
+ * Record the bytes of one receive event whose last byte arrived at last_rx_us. UART task only.
+ */
+void bus_recorder_chunk(const uint8_t *data, size_t len, int64_t last_rx_us, uint32_t baudrate);
+
+/**
+ * Hand over a block started BUS_RECORDER_FLUSH_MS before now_us, so a quiet bus
+ * does not hold back what was recorded. UART task only, while it waits for events.
+ */
+void bus_recorder_idle(int64_t now_us);
+
+void bus_recorder_stats(BusRecorderStats *out);
+
+#endif // BUS_RECORDER_H
@@ -0,0 +1,307 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "flash_store.h"
+#include "probe_diag.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stddef.h>
+
+static const char *TAG = "flash_store";
+
+#define SECTOR_MAGIC 0x32465350u // "PSF2"
+#define RECORD_END 0xFFFF // size field of erased flash
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq; // grows by one for every sector started, orders the ring
+} SectorHeader;
+
+typedef struct {
+    uint16_t size; // bytes of the MqttRecord, mqtt_record_size()
+    uint8_t version; // MQTT_RECORD_VERSION of the writer
+    uint8_t reserved;
+    uint32_t crc; // CRC32 of the record bytes
+    uint32_t consumed; // erased (all ones) until sent, then zeroed in place
+} RecordHeader;
+
+_Static_assert(sizeof(SectorHeader) == 8 && sizeof(RecordHeader) == 12, "flash layout changed");
+
+static const esp_partition_t *partition = NULL;
+static SemaphoreHandle_t lock = NULL;
+static uint32_t sector_count;
+
+static uint32_t write_sector;
+static uint32_t write_offset;
+static uint32_t write_seq;
+static uint32_t read_sector;
+static uint32_t read_offset;
+static uint32_t pending;
+static uint32_t dropped;
+static uint32_t peeked_span; // 0 - nothing peeked
+
+static inline uint32_t record_span(uint32_t size) {
+    return (sizeof(RecordHeader) + size + 3) & ~3u;
+}
+
+static inline uint32_t sector_address(uint32_t sector, uint32_t offset) {
+    return sector * FLASH_STORE_SECTOR_SIZE + offset;
+}
+
+/**
+ * Read the record header at offset, false at the end of the sector's data.
+ * A header that cannot be right (torn write, foreign data) also ends the sector.
+ */
+static bool read_record(uint32_t sector, uint32_t offset, RecordHeader *h) {
+    if (offset + sizeof(*h) > FLASH_STORE_SECTOR_SIZE) return false;
+    if (esp_partition_read(partition, sector_address(sector, offset), h, sizeof(*h)) != ESP_OK) return false;
+    return h->size != RECORD_END &&
+           offset + record_span(h->size) <= FLASH_STORE_SECTOR_SIZE &&
+           h->size <= sizeof(MqttRecord);
+}
+
+static bool read_sector_header(uint32_t sector, SectorHeader *h) {
+    return esp_partition_read(partition, sector_address(sector, 0), h, sizeof(*h)) == ESP_OK &&
+           h->magic == SECTOR_MAGIC;
+}
+
+static bool start_sector(uint32_t sector, uint32_t seq) {
+    SectorHeader h = {.magic = SECTOR_MAGIC, .seq = seq};
+    if (esp_partition_erase_range(partition, sector_address(sector, 0), FLASH_STORE_SECTOR_SIZE) != ESP_OK ||
+        esp_partition_write(partition, sector_address(sector, 0), &h, sizeof(h)) != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot prepare sector %lu", (unsigned long) sector);
+        return false;
+    }
+    write_sector = sector;
+    write_offset = sizeof(h);
+    write_seq = seq;
+    return true;
+}
+
+static bool erased_at(uint32_t sector, uint32_t offset) {
+    RecordHeader h;
+    if (offset + sizeof(h) > FLASH_STORE_SECTOR_SIZE) return true; // no record fits there anyway
+    return esp_partition_read(partition, sector_address(sector, offset), &h, sizeof(h)) == ESP_OK &&
+           h.size == RECORD_END;
+}
+
+/**
+ * Unsent records of a sector from offset on
+ */
+static uint32_t count_unsent(uint32_t sector, uint32_t offset) {
+    RecordHeader h;
+    uint32_t n = 0;
+    while (read_record(sector, offset, &h)) {
+        if (h.consumed) n++;
+        offset += record_span(h.size);
+    }
+    return n;
+}
+
+/**
+ * Move the writer into the next sector, dropping what the reader has not sent yet from it
+ */
+static bool advance_write_sector(void) {
+    uint32_t next = (write_sector + 1) % sector_count;
+    if (pending && next == read_sector) {
+        uint32_t lost = count_unsent(read_sector, read_offset);
+        lost = lost < pending ? lost : pending;
+        pending -= lost;
+        dropped += lost;
+        probe_diag_count(DIAG_DEFERRED_DROPPED, lost);
+        ESP_LOGW(TAG, "Store full, dropped %lu oldest messages", (unsigned long) lost);
+        read_sector = (next + 1) % sector_count;
+        read_offset = sizeof(SectorHeader);
+        peeked_span = 0;
+    }
+    if (!start_sector(next, write_seq + 1)) return false;
+    if (!pending) {
+        read_sector = write_sector;
+        read_offset = write_offset;
+    }
+    return true;
+}
+
+/**
+ * Recover writer and reader positions: the newest sector holds the write
+ * position, the first unsent record after it in ring order is the read position.
+ */
+static void recover(void) {
+    SectorHeader h;
+    bool found = false;
+    uint32_t newest = 0;
+    pending = 0;
+    peeked_span = 0;
+    for (uint32_t s = 0; s < sector_count; s++) {
+        if (read_sector_header(s, &h) && (!found || h.seq > write_seq)) {
+            found = true;
+            newest = s;
+            write_seq = h.seq;
+        }
+    }
+    if (!found) {
+        start_sector(0, 1);
+        read_sector = write_sector;
+        read_offset = write_offset;
+        return;
+    }
+
+    write_sector = newest;
+    bool reader_set = false;
+    for (uint32_t i = 1; i <= sector_count; i++) {
+        uint32_t s = (newest + i) % sector_count; // oldest first, newest last
+        if (!read_sector_header(s, &h)) continue;
+        RecordHeader r;
+        uint32_t offset = sizeof(SectorHeader);
+        while (read_record(s, offset, &r)) {
+            if (r.consumed) {
+                if (!reader_set) {
+                    read_sector = s;
+                    read_offset = offset;
+                    reader_set = true;
+                }
+                pending++;
+            }
+            offset += record_span(r.size);
+        }
+        if (s == newest) {
+            // anything unreadable after the last record is a torn write, start afresh in the next sector
+            write_offset = erased_at(s, offset) ? offset : FLASH_STORE_SECTOR_SIZE;
+        }
+    }
+    if (!reader_set) {
+        read_sector = write_sector;
+        read_offset = write_offset;
+    }
+}
+
+bool flash_store_init(void) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         FLASH_STORE_PARTITION_LABEL);
+    if (!partition) {
+        ESP_LOGW(TAG, "No \"%s\" partition, messages are kept in RAM while offline", FLASH_STORE_PARTITION_LABEL);
+        return false;
+    }
+    sector_count = partition->size / FLASH_STORE_SECTOR_SIZE;
+    if (sector_count < 2) {
+        ESP_LOGE(TAG, "Partition \"%s\" is too small", FLASH_STORE_PARTITION_LABEL);
+        partition = NULL;
+        return false;
+    }
+    lock = xSemaphoreCreateMutex();
+    recover();
+    ESP_LOGI(TAG, "%lu sectors, %lu messages pending", (unsigned long) sector_count, (unsigned long) pending);
+    return true;
+}
+
+bool flash_store_available(void) {
+    return partition != NULL;
+}
+
+_Static_assert(sizeof(RecordHeader) + sizeof(MqttRecord) <= FLASH_STORE_SECTOR_SIZE - sizeof(SectorHeader),
+               "a record must fit an empty sector");
+
+bool flash_store_append(const MqttRecord *record) {
+    if (!partition || !record) return false;
+
+    // only the part of the union used by the record's kind is stored
+    uint32_t size = mqtt_record_size(record);
+    if (!size || record->kind == MQTT_RECORD_BATCH) return false; // a batch only points to its records
+
+    RecordHeader h = {
+        .size = (uint16_t) size,
+        .version = MQTT_RECORD_VERSION,
+        .reserved = 0xFF,
+        .crc = esp_rom_crc32_le(0, (const uint8_t *) record, size),
+        .consumed = UINT32_MAX,
+    };
+
+    bool ok = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (write_offset + record_span(size) <= FLASH_STORE_SECTOR_SIZE || advance_write_sector()) {
+        // header first: a record cut short by a reset fails its CRC instead of ending the sector early
+        uint32_t addr = sector_address(write_sector, write_offset);
+        ok = esp_partition_write(partition, addr, &h, sizeof(h)) == ESP_OK &&
+             esp_partition_write(partition, addr + sizeof(h), record, size) == ESP_OK;
+        write_offset += record_span(size);
+        if (ok) pending++;
+    }
+    xSemaphoreGive(lock);
+    return ok;
+}
+
+bool flash_store_peek(MqttRecord *out) {
+    if (!partition || !out) return false;
+
+    bool found = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    peeked_span = 0;
+    while (pending) {
+        RecordHeader h;
+        if (!read_record(read_sector, read_offset, &h)) {
+            if (read_sector == write_sector) break;
+            read_sector = (read_sector + 1) % sector_count;
+            read_offset = sizeof(SectorHeader);
+            continue;
+        }
+        uint32_t addr = sector_address(read_sector, read_offset) + sizeof(h);
+        if (h.consumed && h.version == MQTT_RECORD_VERSION &&
+            esp_partition_read(partition, addr, out, h.size) == ESP_OK &&
+            esp_rom_crc32_le(0, (const uint8_t *) out, h.size) == h.crc &&
+            mqtt_record_size(out) == h.size) {
+            peeked_span = record_span(h.size);
+            found = true;
+            break;
+        }
+        if (h.consumed) {
+            // a write cut short by a reset, or a record of an older firmware
+            ESP_LOGW(TAG, "Skipping unreadable record in sector %lu", (unsigned long) read_sector);
+            pending--;
+            dropped++;
+            probe_diag_count(DIAG_DEFERRED_DROPPED, 1);
+        }
+        read_offset += record_span(h.size);
+    }
+    xSemaphoreGive(lock);
+    return found;
+}
+
+void flash_store_consume(void) {
+    if (!partition) return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (peeked_span) {
+        uint32_t sent = 0;
+        esp_partition_write(partition,
+                            sector_address(read_sector, read_offset) + offsetof(RecordHeader, consumed),
+                            &sent, sizeof(sent));
+        read_offset += peeked_span;
+        peeked_span = 0;
+        pending--;
+    }
+    xSemaphoreGive(lock);
+}
+
+/**
+ * A counter read under the lock, the writer and the drain task update them
+ */
+static uint32_t read_counter(const uint32_t *counter) {
+    if (!partition) return 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t value = *counter;
+    xSemaphoreGive(lock);
+    return value;
+}
+
+uint32_t flash_store_pending(void) {
+    return read_counter(&pending);
+}
+
+uint32_t flash_store_dropped(void) {
+    return read_counter(&dropped);
+}
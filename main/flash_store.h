@@ -0,0 +1,58 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mqtt_record.h"
+
+/*
+ * Store-and-forward queue of MQTT records on the "store" data partition.
+ *
+ * Records are appended, each only as long as its kind needs, to a ring of flash
+ * sectors, so every sector is erased once per lap and wear is spread evenly.
+ * Consumed records are marked in place (bits only go from 1 to 0) and the
+ * sector is erased when the writer comes around again; if the writer catches
+ * up with unread data, the oldest sector is dropped. The queue survives
+ * reboots: positions are recovered by scanning sector and record headers.
+ * All functions are thread-safe.
+ */
+
+#define FLASH_STORE_PARTITION_LABEL "store"
+#define FLASH_STORE_SECTOR_SIZE 4096
+
+/**
+ * Mount the partition, false if it is missing or unusable
+ */
+bool flash_store_init(void);
+
+bool flash_store_available(void);
+
+/**
+ * Append a record; may erase a sector and block for tens of milliseconds
+ */
+bool flash_store_append(const MqttRecord *record);
+
+/**
+ * Copy the oldest pending record into out without consuming it.
+ * Only the bytes of its kind are written, the rest of out is left as it was.
+ */
+bool flash_store_peek(MqttRecord *out);
+
+/**
+ * Mark the record returned by the last flash_store_peek as sent
+ */
+void flash_store_consume(void);
+
+uint32_t flash_store_pending(void);
+
+/**
+ * Records lost since boot because the writer had to reuse a sector holding them
+ */
+uint32_t flash_store_dropped(void);
+
+#endif // FLASH_STORE_H
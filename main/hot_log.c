@@ -0,0 +1,103 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "hot_log.h"
+#include <stdio.h>
+#include <stdatomic.h>
+
+_Static_assert((HOT_LOG_RING_SIZE & (HOT_LOG_RING_SIZE - 1)) == 0, "HOT_LOG_RING_SIZE must be a power of two");
+
+#define HOT_LOG_MESSAGE_FORMAT(id, level, tag, format) [id] = format,
+#define HOT_LOG_MESSAGE_TAG(id, level, tag, format) [id] = tag,
+#define HOT_LOG_MESSAGE_LEVELS(id, level, tag, format) [id] = level,
+
+static const char *const message_formats[HOT_LOG_MESSAGE_COUNT] = {HOT_LOG_MESSAGES(HOT_LOG_MESSAGE_FORMAT)};
+static const char *const message_tags[HOT_LOG_MESSAGE_COUNT] = {HOT_LOG_MESSAGES(HOT_LOG_MESSAGE_TAG)};
+static const uint8_t message_levels[HOT_LOG_MESSAGE_COUNT] = {HOT_LOG_MESSAGES(HOT_LOG_MESSAGE_LEVELS)};
+
+/*
+ * Bounded multi-producer/single-consumer ring. A producer claims position
+ * pos by advancing head, fills the slot and then marks it ready for the
+ * consumer; the consumer marks it free for the producer one lap later.
+ * Slot i holds its turn relative to i, so the zeroed ring starts out free
+ * for positions 0..HOT_LOG_RING_SIZE-1 without an init call:
+ *   turn + i == pos      free for the producer at pos
+ *   turn + i == pos + 1  ready for the consumer at pos
+ */
+typedef struct {
+    atomic_uint turn;
+    HotLogRecord record;
+} HotLogSlot;
+
+static HotLogSlot ring[HOT_LOG_RING_SIZE];
+static atomic_uint head;
+static unsigned tail; // consumer only
+static atomic_uint dropped;
+
+void hot_log_push(HotLogMessage id, const uint32_t *args, size_t argc) {
+    unsigned pos = atomic_load_explicit(&head, memory_order_relaxed);
+    HotLogSlot *slot;
+    for (;;) {
+        unsigned index = pos & (HOT_LOG_RING_SIZE - 1);
+        slot = &ring[index];
+        int diff = (int) (atomic_load_explicit(&slot->turn, memory_order_acquire) + index - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return; // the consumer is a full lap behind
+        } else {
+            pos = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+
+    HotLogRecord *r = &slot->record;
+    r->time_ms = esp_log_timestamp();
+    r->id = (uint16_t) id;
+    r->argc = (uint8_t) (argc < HOT_LOG_MAX_ARGS ? argc : HOT_LOG_MAX_ARGS);
+    for (size_t i = 0; i < r->argc; i++) {
+        r->args[i] = args[i];
+    }
+    atomic_store_explicit(&slot->turn, pos + 1 - (pos & (HOT_LOG_RING_SIZE - 1)), memory_order_release);
+}
+
+bool hot_log_pop(HotLogRecord *out) {
+    unsigned index = tail & (HOT_LOG_RING_SIZE - 1);
+    HotLogSlot *slot = &ring[index];
+    if (atomic_load_explicit(&slot->turn, memory_order_acquire) + index != tail + 1) {
+        return false;
+    }
+    *out = slot->record;
+    atomic_store_explicit(&slot->turn, tail + HOT_LOG_RING_SIZE - index, memory_order_release);
+    tail++;
+    return true;
+}
+
+int hot_log_format(const HotLogRecord *r, char *out, size_t size) {
+    if (r->id >= HOT_LOG_MESSAGE_COUNT) {
+        return snprintf(out, size, "unknown message %u", r->id);
+    }
+    unsigned a[HOT_LOG_MAX_ARGS] = {0};
+    for (size_t i = 0; i < r->argc; i++) {
+        a[i] = r->args[i];
+    }
+    // unused trailing arguments are ignored by snprintf
+    return snprintf(out, size, message_formats[r->id], a[0], a[1], a[2], a[3]);
+}
+
+esp_log_level_t hot_log_level(const HotLogRecord *r) {
+    return r->id < HOT_LOG_MESSAGE_COUNT ? (esp_log_level_t) message_levels[r->id] : ESP_LOG_ERROR;
+}
+
+const char *hot_log_tag(const HotLogRecord *r) {
+    return r->id < HOT_LOG_MESSAGE_COUNT ? message_tags[r->id] : "hot_log";
+}
+
+uint32_t hot_log_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
@@ -0,0 +1,129 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef HOT_LOG_H
+#define HOT_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+/*
+ * Logging for code that runs on every byte or frame.
+ *
+ * Messages are declared once in HOT_LOG_MESSAGES with their level, tag and
+ * format. HOT_LOG() compiles to nothing when the message level is above
+ * CONFIG_PROBE_HOT_LOG_LEVEL, arguments included. Enabled messages are not
+ * formatted where they are logged: the message id and up to
+ * HOT_LOG_MAX_ARGS integer arguments go into a lock-free ring, and the
+ * low-priority hot_log task (or a host tool) turns them into text later.
+ * Pushing is safe from any task or ISR.
+ */
+
+#define HOT_LOG_LEVEL CONFIG_PROBE_HOT_LOG_LEVEL
+#define HOT_LOG_MAX_ARGS 4
+#ifdef CONFIG_PROBE_HOT_LOG_RING_SIZE
+#define HOT_LOG_RING_SIZE CONFIG_PROBE_HOT_LOG_RING_SIZE
+#else
+#define HOT_LOG_RING_SIZE 2 // nothing is logged
+#endif
+
+// X(id, level, tag, format); format takes up to HOT_LOG_MAX_ARGS int/unsigned values,
+// text that depends on a value needs a message per variant
+#define HOT_LOG_MESSAGES(X) \
+    X(HOT_LOG_LENGTH_FIELD, ESP_LOG_DEBUG, "pylon_packet", "bytes for length field: %02X (check) - %02X %02X %02X") \
+    X(HOT_LOG_FRAME_HEADER, ESP_LOG_DEBUG, "pylon_packet", "Frame %02X%02X from %02X, %u ASCII bytes") \
+    X(HOT_LOG_FRAME_COPIED, ESP_LOG_DEBUG, "pylon_packet", "Copied %u bytes, index is %u") \
+    X(HOT_LOG_FRAME_CHECKSUM, ESP_LOG_DEBUG, "pylon_packet", "Checksum: %04X, computed: %04X") \
+    X(HOT_LOG_INFO_HEADER, ESP_LOG_DEBUG, "pylon_packet", "Module ID: %u, cells: %u") \
+    X(HOT_LOG_INFO_CELL, ESP_LOG_DEBUG, "pylon_packet", "Cell %u: %u mV") \
+    X(HOT_LOG_INFO_TEMPERATURE, ESP_LOG_DEBUG, "pylon_packet", "Temperature %u: %d.%02d C") \
+    X(HOT_LOG_INFO_CURRENT_CHARGING, ESP_LOG_DEBUG, "pylon_packet", \
+      "Current: %d mA, state: Charging, total voltage: %u mV, user defined number: %u") \
+    X(HOT_LOG_INFO_CURRENT_DISCHARGING, ESP_LOG_DEBUG, "pylon_packet", \
+      "Current: %d mA, state: Discharging, total voltage: %u mV, user defined number: %u") \
+    X(HOT_LOG_INFO_CURRENT_IDLE, ESP_LOG_DEBUG, "pylon_packet", \
+      "Current: %d mA, state: Idle, total voltage: %u mV, user defined number: %u") \
+    X(HOT_LOG_INFO_CAPACITY, ESP_LOG_DEBUG, "pylon_packet", "Remaining capacity: %u.%02u of %u.%02u Ah") \
+    X(HOT_LOG_INFO_CYCLES, ESP_LOG_DEBUG, "pylon_packet", "Cycle count: %u") \
+    X(HOT_LOG_INFO_BATTERY_CAPACITY, ESP_LOG_DEBUG, "pylon_packet", \
+      "Battery capacity: %u.%02u Ah, current capacity: %u.%02u Ah") \
+    X(HOT_LOG_INFO_USER_VOLTAGE, ESP_LOG_DEBUG, "pylon_packet", "User voltages 0-3: %u %u %u %u mV") \
+    X(HOT_LOG_INFO_TAIL, ESP_LOG_DEBUG, "pylon_packet", "User voltage 4: %u mV, unknown: %u") \
+    X(HOT_LOG_DISPATCH, ESP_LOG_INFO, "pylon_uart", "Dispatching packet %02X%02X from %02X, INFO %u bytes")
+
+#define HOT_LOG_MESSAGE_ID(id, level, tag, format) id,
+#define HOT_LOG_MESSAGE_LEVEL(id, level, tag, format) id##_LEVEL = level,
+
+typedef enum {
+    HOT_LOG_MESSAGES(HOT_LOG_MESSAGE_ID)
+    HOT_LOG_MESSAGE_COUNT
+} HotLogMessage;
+
+enum {
+    HOT_LOG_MESSAGES(HOT_LOG_MESSAGE_LEVEL)
+};
+
+typedef struct {
+    uint32_t time_ms; // esp_log_timestamp() when the message was logged
+    uint16_t id; // HotLogMessage
+    uint8_t argc;
+    uint32_t args[HOT_LOG_MAX_ARGS];
+} HotLogRecord;
+
+#if HOT_LOG_LEVEL > 0 // above ESP_LOG_NONE
+#define HOT_LOG(id, ...) \
+    do { \
+        if (id##_LEVEL <= HOT_LOG_LEVEL) { \
+            const uint32_t hot_log_args_[] = {0, ##__VA_ARGS__}; \
+            _Static_assert(sizeof(hot_log_args_) <= (HOT_LOG_MAX_ARGS + 1) * sizeof(uint32_t), \
+                           "too many hot log arguments"); \
+            hot_log_push(id, &hot_log_args_[1], sizeof(hot_log_args_) / sizeof(uint32_t) - 1); \
+        } \
+    } while (0)
+#else
+#define HOT_LOG(id, ...) do { } while (0)
+#endif
+
+// Raw bytes cannot be deferred, dumps are written immediately and only in builds that enable the level
+#define HOT_LOG_HEXDUMP(level, tag, buffer, len) \
+    do { \
+        if ((level) <= HOT_LOG_LEVEL) { \
+            ESP_LOG_BUFFER_HEXDUMP(tag, buffer, len, level); \
+        } \
+    } while (0)
+
+/**
+ * Queue one message, dropped and counted when the ring is full
+ */
+void hot_log_push(HotLogMessage id, const uint32_t *args, size_t argc);
+
+/**
+ * Take the oldest queued message, single consumer only
+ */
+bool hot_log_pop(HotLogRecord *out);
+
+/**
+ * Format a record's message into out, always NUL-terminated; returns the length snprintf would write
+ */
+int hot_log_format(const HotLogRecord *record, char *out, size_t size);
+
+esp_log_level_t hot_log_level(const HotLogRecord *record);
+
+const char *hot_log_tag(const HotLogRecord *record);
+
+/**
+ * Messages lost to a full ring since boot
+ */
+uint32_t hot_log_dropped(void);
+
+/**
+ * Start the task that writes queued messages to the console
+ */
+void hot_log_start(void);
+
+#endif // HOT_LOG_H
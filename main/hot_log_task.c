@@ -0,0 +1,44 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "hot_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "hot_log";
+
+#define HOT_LOG_DRAIN_PERIOD_MS 100
+#define HOT_LOG_LINE_LEN 128
+
+#if HOT_LOG_LEVEL > 0 // above ESP_LOG_NONE
+static void hot_log_task(void *param) {
+    static char line[HOT_LOG_LINE_LEN];
+    HotLogRecord record;
+    uint32_t reported_drops = 0;
+
+    while (1) {
+        while (hot_log_pop(&record)) {
+            hot_log_format(&record, line, sizeof(line));
+            // the console timestamp is the time of printing, the logged one comes first
+            ESP_LOG_LEVEL(hot_log_level(&record), hot_log_tag(&record), "[%lu] %s",
+                          (unsigned long) record.time_ms, line);
+        }
+        uint32_t drops = hot_log_dropped();
+        if (drops != reported_drops) {
+            ESP_LOGW(TAG, "%lu messages lost, ring full", (unsigned long) (drops - reported_drops));
+            reported_drops = drops;
+        }
+        vTaskDelay(pdMS_TO_TICKS(HOT_LOG_DRAIN_PERIOD_MS));
+    }
+}
+#endif
+
+void hot_log_start(void) {
+#if HOT_LOG_LEVEL > 0 // above ESP_LOG_NONE
+    xTaskCreatePinnedToCore(hot_log_task, "hot_log", 3072, NULL, 1, NULL, 0);
+#else
+    ESP_LOGI(TAG, "Hot path logging compiled out");
+#endif
+}
@@ -0,0 +1,169 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "json_writer.h"
+#include <string.h>
+
+// "00" "01" ... "99", two digits per step when converting integers
+static const char digit_pairs[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static inline void put_char(JsonWriter *w, char c) {
+    if (w->len + 1 < w->size) {
+        w->buf[w->len++] = c;
+    } else {
+        w->overflow = true;
+    }
+}
+
+static inline void put_bytes(JsonWriter *w, const char *s, size_t n) {
+    if (w->len + n < w->size) {
+        memcpy(&w->buf[w->len], s, n);
+        w->len += n;
+    } else {
+        w->overflow = true;
+    }
+}
+
+static inline void begin_value(JsonWriter *w) {
+    if (w->comma) {
+        put_char(w, ',');
+    }
+    w->comma = true;
+}
+
+void json_writer_init(JsonWriter *w, char *buf, size_t size) {
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->comma = false;
+    w->overflow = size == 0;
+}
+
+bool json_writer_finish(JsonWriter *w) {
+    if (w->size > 0) {
+        w->buf[w->len] = '\0';
+    }
+    return !w->overflow;
+}
+
+void json_object_begin(JsonWriter *w) {
+    begin_value(w);
+    put_char(w, '{');
+    w->comma = false;
+}
+
+void json_object_end(JsonWriter *w) {
+    put_char(w, '}');
+    w->comma = true;
+}
+
+void json_array_begin(JsonWriter *w) {
+    begin_value(w);
+    put_char(w, '[');
+    w->comma = false;
+}
+
+void json_array_end(JsonWriter *w) {
+    put_char(w, ']');
+    w->comma = true;
+}
+
+void json_key(JsonWriter *w, const char *key) {
+    begin_value(w);
+    put_char(w, '"');
+    put_bytes(w, key, strlen(key));
+    put_bytes(w, "\":", 2);
+    w->comma = false;
+}
+
+size_t json_format_u32(char *out, uint32_t value) {
+    char tmp[10];
+    size_t pos = sizeof(tmp);
+    while (value >= 100) {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        tmp[--pos] = digit_pairs[pair + 1];
+        tmp[--pos] = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        tmp[--pos] = digit_pairs[value * 2 + 1];
+        tmp[--pos] = digit_pairs[value * 2];
+    } else {
+        tmp[--pos] = (char) ('0' + value);
+    }
+    size_t n = sizeof(tmp) - pos;
+    memcpy(out, &tmp[pos], n);
+    return n;
+}
+
+void json_u32(JsonWriter *w, uint32_t value) {
+    begin_value(w);
+    if (w->len + 10 < w->size) {
+        w->len += json_format_u32(&w->buf[w->len], value);
+    } else {
+        char tmp[10];
+        put_bytes(w, tmp, json_format_u32(tmp, value));
+    }
+}
+
+void json_i32(JsonWriter *w, int32_t value) {
+    if (value >= 0) {
+        json_u32(w, (uint32_t) value);
+        return;
+    }
+    begin_value(w);
+    put_char(w, '-');
+    char tmp[10];
+    put_bytes(w, tmp, json_format_u32(tmp, 0u - (uint32_t) value));
+}
+
+void json_bool(JsonWriter *w, bool value) {
+    begin_value(w);
+    if (value) {
+        put_bytes(w, "true", 4);
+    } else {
+        put_bytes(w, "false", 5);
+    }
+}
+
+void json_str(JsonWriter *w, const char *value) {
+    begin_value(w);
+    put_char(w, '"');
+    const char *run = value;
+    for (const char *p = value; *p; ++p) {
+        unsigned char c = (unsigned char) *p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        put_bytes(w, run, (size_t) (p - run));
+        run = p + 1;
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char) c};
+            put_bytes(w, esc, 2);
+        } else {
+            char esc[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0x0F]};
+            put_bytes(w, esc, 6);
+        }
+    }
+    put_bytes(w, run, strlen(run));
+    put_char(w, '"');
+}
+
+void json_raw(JsonWriter *w, const char *text, size_t n) {
+    begin_value(w);
+    put_bytes(w, text, n);
+}
@@ -0,0 +1,87 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Append-only JSON writer over a fixed buffer.
+ *
+ * Output is produced in a single pass without printf or intermediate
+ * buffers. Writes past the end of the buffer are dropped and remembered in
+ * overflow, so callers check the result once in json_writer_finish.
+ */
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool comma; // next element needs a separator
+    bool overflow;
+} JsonWriter;
+
+void json_writer_init(JsonWriter *w, char *buf, size_t size);
+
+/**
+ * NUL-terminate the output. Returns false if anything did not fit.
+ */
+bool json_writer_finish(JsonWriter *w);
+
+void json_object_begin(JsonWriter *w);
+
+void json_object_end(JsonWriter *w);
+
+void json_array_begin(JsonWriter *w);
+
+void json_array_end(JsonWriter *w);
+
+void json_key(JsonWriter *w, const char *key);
+
+void json_u32(JsonWriter *w, uint32_t value);
+
+void json_i32(JsonWriter *w, int32_t value);
+
+void json_bool(JsonWriter *w, bool value);
+
+/**
+ * String value; quotes, backslashes and control characters are escaped
+ */
+void json_str(JsonWriter *w, const char *value);
+
+/**
+ * Preformatted value: n characters written verbatim
+ */
+void json_raw(JsonWriter *w, const char *text, size_t n);
+
+static inline void json_field_u32(JsonWriter *w, const char *key, uint32_t value) {
+    json_key(w, key);
+    json_u32(w, value);
+}
+
+static inline void json_field_i32(JsonWriter *w, const char *key, int32_t value) {
+    json_key(w, key);
+    json_i32(w, value);
+}
+
+static inline void json_field_bool(JsonWriter *w, const char *key, bool value) {
+    json_key(w, key);
+    json_bool(w, value);
+}
+
+static inline void json_field_str(JsonWriter *w, const char *key, const char *value) {
+    json_key(w, key);
+    json_str(w, value);
+}
+
+/**
+ * Write an unsigned decimal into out (at least 10 bytes), returns its length
+ */
+size_t json_format_u32(char *out, uint32_t value);
+
+#endif // JSON_WRITER_H
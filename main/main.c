@@ -19,6 +19,9 @@
 #include "time_sync.h"
 #include "uart_listener.h"
 #include "packet_router.h"
+#include "probe_diag.h"
+#include "hot_log.h"
+#include "bus_recorder.h"
 #include "oled_ui.h"
 
 static const char *TAG = "main";
@@ -28,11 +31,20 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     switch ((esp_mqtt_event_id_t) event_id) {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT connected");
+            mqtt_publish_set_connected(true);
             packet_router_set_online(true);
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "MQTT disconnected");
             packet_router_set_online(false);
+            mqtt_publish_set_connected(false);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            mqtt_publish_completed(true);
+            break;
+        case MQTT_EVENT_DELETED:
+            ESP_LOGW(TAG, "MQTT message %d expired in the outbox", event->msg_id);
+            mqtt_publish_completed(false);
             break;
         default:
             break;
@@ -52,7 +64,8 @@ static esp_mqtt_client_handle_t mqtt_init(void) {
         .task.priority = 5,
         .task.stack_size = 4096,
         .buffer.size = 1024,
-        .buffer.out_size = 1024,
+        .buffer.out_size = MQTT_MAX_PAYLOAD_LEN,
+        .outbox.limit = CONFIG_PROBE_MQTT_OUTBOX_LIMIT_KB * 1024, // publish fails with -2 beyond it
     };
     esp_mqtt_client_handle_t mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
@@ -69,8 +82,9 @@ void app_main(void) {
     }
     ESP_ERROR_CHECK(ret);
     oled_ui_init();
+    hot_log_start();
 
-    mqtt_publish_queue_init();
+    mqtt_publish_queue_init(packet_router_defer);
     packet_router_init();
     esp_mqtt_client_handle_t mqtt_client = mqtt_init();
     ESP_LOGI(TAG, "mqtt_client = %p", mqtt_client);
@@ -79,7 +93,9 @@ void app_main(void) {
     wifi_init_sta(mqtt_client);
     time_sync_init();
 
-    pylon_uart_init(RS485_UART_NUM, my_packet_handler);
+    bus_recorder_start();
+    pylon_uart_init(my_packet_handler, packet_router_tick);
+    probe_diag_start();
 
     ESP_LOGI(TAG, "System initialization complete");
 }
@@ -5,83 +5,603 @@
  */
 
 #include "mqtt_formatter.h"
+#include "json_writer.h"
 #include "time_sync.h"
-#include <stdio.h>
+#include "sdkconfig.h"
 #include <string.h>
 
 #define MQTT_PREFIX CONFIG_PROBE_MQTT_BROKER_TOPIC_PREFIX "/" CONFIG_PROBE_DEVICE_NAME "/battery"
 
-bool get_iso8601(char *buffer, size_t len) {
-    time_t now = time(NULL);
-    struct tm timeinfo;
-    if (!gmtime_r(&now, &timeinfo)) {
+static const char hex_upper[] = "0123456789ABCDEF";
+
+static inline void put_2digits(char *out, int value) {
+    out[0] = (char) ('0' + value / 10);
+    out[1] = (char) ('0' + value % 10);
+}
+
+/**
+ * "YYYY-MM-DDTHH:MM:SSZ" into out (20 characters, not terminated)
+ */
+static bool format_iso8601(time_t at, char out[20]) {
+    struct tm t;
+    if (!gmtime_r(&at, &t) || t.tm_year < -1900 || t.tm_year > 9999 - 1900) {
         return false;
     }
-    if (strftime(buffer, len, "%Y-%m-%dT%H:%M:%SZ", &timeinfo) == 0) {
-        return false; // not enough space
-    }
+    int year = t.tm_year + 1900;
+    put_2digits(&out[0], year / 100);
+    put_2digits(&out[2], year % 100);
+    out[4] = '-';
+    put_2digits(&out[5], t.tm_mon + 1);
+    out[7] = '-';
+    put_2digits(&out[8], t.tm_mday);
+    out[10] = 'T';
+    put_2digits(&out[11], t.tm_hour);
+    out[13] = ':';
+    put_2digits(&out[14], t.tm_min);
+    out[16] = ':';
+    put_2digits(&out[17], t.tm_sec);
+    out[19] = 'Z';
     return true;
 }
 
-bool mqtt_format_info_payload(const PylonBatteryStatus *s, MQTTPayload *out) {
+static void json_timestamp(JsonWriter *w, const char *key, time_t at) {
+    static const char fallback[] = "\"1970-00-00T00H:00M:00Z\"";
+    char ts[22];
+    json_key(w, key);
+    if (format_iso8601(at, &ts[1])) {
+        ts[0] = '"';
+        ts[21] = '"';
+        json_raw(w, ts, sizeof(ts));
+    } else {
+        json_raw(w, fallback, sizeof(fallback) - 1);
+    }
+}
+
+/**
+ * "major.minor" version string from two numbers
+ */
+static void json_version(JsonWriter *w, const char *key, uint8_t major, uint8_t minor) {
+    char buf[9];
+    size_t n = 0;
+    buf[n++] = '"';
+    n += json_format_u32(&buf[n], major);
+    buf[n++] = '.';
+    n += json_format_u32(&buf[n], minor);
+    buf[n++] = '"';
+    json_key(w, key);
+    json_raw(w, buf, n);
+}
+
+// "bus<N>/" topic level of a bus, only when the probe taps more than one
+#if PYLON_BUS_COUNT > 1
+#define BUS_LEVEL_LEN 5
+#else
+#define BUS_LEVEL_LEN 0
+#endif
+_Static_assert(PYLON_BUS_COUNT <= 9, "the bus topic level has one digit");
+
+static inline size_t put_bus_level(char *out, uint8_t bus) {
+    if (!BUS_LEVEL_LEN) return 0;
+    memcpy(out, "bus", 3);
+    out[3] = (char) ('1' + bus);
+    out[4] = '/';
+    return BUS_LEVEL_LEN;
+}
+
+/**
+ * MQTT_PREFIX "/", the bus level, "AA/" unless address is NULL, then suffix, into a topic of MQTT_MAX_TOPIC_LEN
+ */
+static void put_bus_topic(char *topic, uint8_t bus, const uint8_t *address, const char *suffix) {
+    static const char prefix[] = MQTT_PREFIX "/";
+    size_t pos = sizeof(prefix) - 1;
+    size_t suffix_len = strlen(suffix);
+    _Static_assert(sizeof(prefix) + BUS_LEVEL_LEN + 3 < MQTT_MAX_TOPIC_LEN, "topic prefix is too long");
+
+    memcpy(topic, prefix, pos);
+    pos += put_bus_level(&topic[pos], bus);
+    if (address) {
+        topic[pos++] = hex_upper[*address >> 4];
+        topic[pos++] = hex_upper[*address & 0x0F];
+        topic[pos++] = '/';
+    }
+    if (suffix_len >= MQTT_MAX_TOPIC_LEN - pos) {
+        suffix_len = MQTT_MAX_TOPIC_LEN - pos - 1;
+    }
+    memcpy(&topic[pos], suffix, suffix_len);
+    topic[pos + suffix_len] = '\0';
+}
+
+static void set_pack_topic(MQTTPayload *out, uint8_t bus, uint8_t address, const char *suffix) {
+    put_bus_topic(out->topic, bus, &address, suffix);
+    out->payload_len = 0;
+    out->qos = 1;
+    out->retain = 0;
+}
+
+/**
+ * "AA" hex pack address, as in the pack topics
+ */
+static void json_address(JsonWriter *w, const char *key, uint8_t address) {
+    const char buf[4] = {'"', hex_upper[address >> 4], hex_upper[address & 0x0F], '"'};
+    json_key(w, key);
+    json_raw(w, buf, sizeof(buf));
+}
+
+static void json_u8_array(JsonWriter *w, const char *key, const uint8_t *values, size_t count) {
+    json_key(w, key);
+    json_array_begin(w);
+    for (size_t i = 0; i < count; ++i) {
+        json_u32(w, values[i]);
+    }
+    json_array_end(w);
+}
+
+#define STATUS_JSON_u8 json_u32
+#define STATUS_JSON_u16 json_u32
+#define STATUS_JSON_i16 json_i32
+#define STATUS_JSON_SCALAR(type, field) \
+    json_key(&w, #field); \
+    STATUS_JSON_##type(&w, s->field);
+#define STATUS_JSON_ARRAY(type, field, count_field) \
+    json_key(&w, #field); \
+    json_array_begin(&w); \
+    for (int i = 0; i < s->count_field; ++i) { \
+        STATUS_JSON_##type(&w, s->field[i]); \
+    } \
+    json_array_end(&w);
+
+bool mqtt_format_info_payload(uint8_t bus, const PylonBatteryStatus *s, uint32_t unix_time, MQTTPayload *out) {
+    if (!s || !out) return false;
+
+    set_pack_topic(out, bus, s->user_defined_number, "info");
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_timestamp(&w, "timestamp", unix_time);
+    PYLON_STATUS_FIELDS(STATUS_JSON_SCALAR, STATUS_JSON_ARRAY)
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+bool mqtt_format_batch_payload(const MqttRecord *r, MQTTBatchPayload *out) {
+    if (!r || !out || r->kind != MQTT_RECORD_BATCH) return false;
+
+    put_bus_topic(out->topic, r->bus, NULL, "batch");
+    out->qos = 1;
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_timestamp(&w, "timestamp", r->time);
+    json_key(&w, "packs");
+    json_array_begin(&w);
+    for (size_t i = 0; i < r->data.batch.count; i++) {
+        const PylonBatteryStatus *s = &r->data.batch.packs[i]->data.status;
+        json_object_begin(&w);
+        // packs may share a user_defined_number, the address tells them apart
+        json_address(&w, "address", r->data.batch.packs[i]->address);
+        PYLON_STATUS_FIELDS(STATUS_JSON_SCALAR, STATUS_JSON_ARRAY)
+        json_object_end(&w);
+    }
+    json_array_end(&w);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+_Static_assert(PYLON_STATUS_FIELD_COUNT <= 32, "status field mask is 32 bits wide");
+
+#define STATUS_MASK(field) (1u << PYLON_STATUS_FIELD_##field)
+#define STATUS_DELTA_SCALAR(type, field) \
+    if (field_mask & STATUS_MASK(field)) { \
+        STATUS_JSON_SCALAR(type, field) \
+    }
+#define STATUS_DELTA_ARRAY(type, field, count_field) \
+    if (field_mask & STATUS_MASK(field)) { \
+        STATUS_JSON_ARRAY(type, field, count_field) \
+    }
+
+bool mqtt_format_info_delta_payload(uint8_t bus, uint8_t address, const PylonBatteryStatus *s,
+                                    uint32_t field_mask, uint32_t unix_time, MQTTPayload *out) {
     if (!s || !out) return false;
 
-    char timestamp[32];
-    if (!get_iso8601(timestamp, sizeof(timestamp))) {
-        snprintf(timestamp, sizeof(timestamp), "1970-00-00T00H:00M:00Z");
+    // packs may share a user_defined_number, so deltas go by address and name the number of their full status
+    set_pack_topic(out, bus, address, "delta");
+    field_mask |= STATUS_MASK(user_defined_number);
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_timestamp(&w, "timestamp", unix_time);
+    PYLON_STATUS_FIELDS(STATUS_DELTA_SCALAR, STATUS_DELTA_ARRAY)
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+static void json_aggregate_stat(JsonWriter *w, const char *key, const AggregateStat *stat, uint32_t samples) {
+    json_key(w, key);
+    json_object_begin(w);
+    json_field_i32(w, "min", stat->min);
+    json_field_i32(w, "max", stat->max);
+    json_field_i32(w, "mean", aggregate_mean(stat, samples));
+    json_field_i32(w, "last", stat->last);
+    json_object_end(w);
+}
+
+#define SUMMARY_JSON_VALUE(name) json_aggregate_stat(&w, #name, &a->name, a->samples);
+
+bool mqtt_format_summary_payload(const StatusAggregate *a, uint32_t unix_time, MQTTPayload *out) {
+    if (!a || !out) return false;
+
+    // windows are kept per address, packs may share a user_defined_number
+    set_pack_topic(out, a->bus, a->address, "summary");
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_timestamp(&w, "timestamp", unix_time);
+    json_field_u32(&w, "user_defined_number", a->user_defined_number);
+    json_field_u32(&w, "window_ms", (uint32_t) ((a->end_us - a->start_us) / 1000));
+    json_field_u32(&w, "samples", a->samples);
+    json_field_u32(&w, "cell_count", a->cell_count);
+    json_field_u32(&w, "temperature_count", a->temperature_count);
+    STATUS_AGGREGATE_VALUES(SUMMARY_JSON_VALUE)
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+static inline uint8_t *put_u8(uint8_t *p, uint8_t v) {
+    *p = v;
+    return p + 1;
+}
+
+static inline uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    return p + 2;
+}
+
+static inline uint8_t *put_i16(uint8_t *p, int16_t v) {
+    return put_u16(p, (uint16_t) v);
+}
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p = put_u16(p, (uint16_t) v);
+    return put_u16(p, (uint16_t) (v >> 16));
+}
+
+#define STATUS_SIZE_SCALAR(type, field) + sizeof(((PylonBatteryStatus *) 0)->field)
+#define STATUS_SIZE_ARRAY(type, field, count_field) + sizeof(((PylonBatteryStatus *) 0)->field)
+// header (format version, timestamp) plus every field with full arrays
+#define STATUS_BINARY_MAX_SIZE (1 + 4 PYLON_STATUS_FIELDS(STATUS_SIZE_SCALAR, STATUS_SIZE_ARRAY))
+_Static_assert(STATUS_BINARY_MAX_SIZE <= MQTT_MAX_PAYLOAD_LEN, "binary status does not fit MQTTPayload");
+
+#define STATUS_BIN_SCALAR(type, field) p = put_##type(p, s->field);
+#define STATUS_BIN_ARRAY(type, field, count_field) \
+    for (int i = 0; i < s->count_field && i < sizeof(s->field) / sizeof(s->field[0]); ++i) { \
+        p = put_##type(p, s->field[i]); \
     }
 
-    snprintf(out->topic, sizeof(out->topic), "%s/%02X/info", MQTT_PREFIX, s->user_defined_number);
+bool mqtt_format_info_binary_payload(uint8_t bus, const PylonBatteryStatus *s, uint32_t unix_time,
+                                     MQTTPayload *out) {
+    if (!s || !out) return false;
+
+    set_pack_topic(out, bus, s->user_defined_number, "info_bin");
+
+    uint8_t *start = (uint8_t *) out->payload;
+    uint8_t *p = put_u8(start, MQTT_INFO_BINARY_VERSION);
+    p = put_u32(p, unix_time);
+    PYLON_STATUS_FIELDS(STATUS_BIN_SCALAR, STATUS_BIN_ARRAY)
+    out->payload_len = (int) (p - start);
+    return true;
+}
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+#define STATUS_SCHEMA_SCALAR(type, field) ",\"" #field ":" #type "\""
+#define STATUS_SCHEMA_ARRAY(type, field, count_field) ",\"" #field ":" #type "[" #count_field "]\""
+
+// field list as "name:type" in payload order, built at compile time
+static const char info_binary_schema[] =
+        "{\"version\":" STR(MQTT_INFO_BINARY_VERSION) ",\"byte_order\":\"little\","
+        "\"fields\":[\"format_version:u8\",\"timestamp:u32\""
+        PYLON_STATUS_FIELDS(STATUS_SCHEMA_SCALAR, STATUS_SCHEMA_ARRAY)
+        "]}";
+_Static_assert(sizeof(info_binary_schema) <= MQTT_MAX_PAYLOAD_LEN, "binary schema does not fit MQTTPayload");
+
+bool mqtt_format_info_binary_schema(MQTTPayload *out) {
+    if (!out) return false;
+
+    static const char topic[] = MQTT_PREFIX "/info_bin/schema";
+    _Static_assert(sizeof(topic) <= MQTT_MAX_TOPIC_LEN, "schema topic is too long");
+    memcpy(out->topic, topic, sizeof(topic));
+    memcpy(out->payload, info_binary_schema, sizeof(info_binary_schema));
+    out->payload_len = 0;
     out->qos = 1;
+    out->retain = 1;
+    return true;
+}
+
+bool mqtt_format_alarm_payload(uint8_t bus, uint8_t address, const PylonAlarmInfo *a, MQTTPayload *out) {
+    if (!a || !out) return false;
+
+    set_pack_topic(out, bus, address, "alarm");
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_u8_array(&w, "cell_alarm", a->cell_alarm, a->cell_count);
+    json_u8_array(&w, "temperature_alarm", a->temperature_alarm, a->temperature_count);
+    json_field_u32(&w, "charge_current_alarm", a->charge_current_alarm);
+    json_field_u32(&w, "module_voltage_alarm", a->module_voltage_alarm);
+    json_field_u32(&w, "discharge_current_alarm", a->discharge_current_alarm);
+    json_u8_array(&w, "status", a->status, a->status_count);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+bool mqtt_format_system_params_payload(uint8_t bus, uint8_t address, const PylonSystemParams *p, MQTTPayload *out) {
+    if (!p || !out) return false;
+
+    set_pack_topic(out, bus, address, "system");
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_field_u32(&w, "cell_high_voltage_mV", p->cell_high_voltage_mV);
+    json_field_u32(&w, "cell_low_voltage_mV", p->cell_low_voltage_mV);
+    json_field_u32(&w, "cell_under_voltage_mV", p->cell_under_voltage_mV);
+    json_field_i32(&w, "charge_high_temperature", p->charge_high_temperature);
+    json_field_i32(&w, "charge_low_temperature", p->charge_low_temperature);
+    json_field_i32(&w, "charge_current_limit", p->charge_current_limit);
+    json_field_u32(&w, "module_high_voltage_mV", p->module_high_voltage_mV);
+    json_field_u32(&w, "module_low_voltage_mV", p->module_low_voltage_mV);
+    json_field_u32(&w, "module_under_voltage_mV", p->module_under_voltage_mV);
+    json_field_i32(&w, "discharge_high_temperature", p->discharge_high_temperature);
+    json_field_i32(&w, "discharge_low_temperature", p->discharge_low_temperature);
+    json_field_i32(&w, "discharge_current_limit", p->discharge_current_limit);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+bool mqtt_format_version_payload(uint8_t bus, uint8_t address, uint8_t protocol_version, MQTTPayload *out) {
+    if (!out) return false;
+
+    set_pack_topic(out, bus, address, "version");
+    out->retain = 1;
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_version(&w, "protocol_version", protocol_version >> 4, protocol_version & 0x0F);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+bool mqtt_format_manufacturer_payload(uint8_t bus, uint8_t address, const PylonManufacturerInfo *m, MQTTPayload *out) {
+    if (!m || !out) return false;
+
+    set_pack_topic(out, bus, address, "manufacturer");
+    out->retain = 1;
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_field_str(&w, "battery_name", m->battery_name);
+    json_version(&w, "software_version", m->software_version[0], m->software_version[1]);
+    json_field_str(&w, "manufacturer", m->manufacturer);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+bool mqtt_format_charge_management_payload(uint8_t bus, uint8_t address, const PylonChargeManagement *c,
+                                           MQTTPayload *out) {
+    if (!c || !out) return false;
+
+    set_pack_topic(out, bus, address, "charge");
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_field_u32(&w, "charge_voltage_limit_mV", c->charge_voltage_limit_mV);
+    json_field_u32(&w, "discharge_voltage_limit_mV", c->discharge_voltage_limit_mV);
+    json_field_i32(&w, "charge_current_limit", c->charge_current_limit);
+    json_field_i32(&w, "discharge_current_limit", c->discharge_current_limit);
+    json_field_u32(&w, "status", c->status);
+    json_field_bool(&w, "charge_enable", c->status & 0x80);
+    json_field_bool(&w, "discharge_enable", c->status & 0x40);
+    json_field_bool(&w, "full_charge_request", c->status & 0x08);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+#define DIAG_PREFIX CONFIG_PROBE_MQTT_BROKER_TOPIC_PREFIX "/" CONFIG_PROBE_DEVICE_NAME "/diag"
+
+static void set_diag_topic(MQTTPayload *out, const char *suffix) {
+    static const char prefix[] = DIAG_PREFIX;
+    size_t pos = sizeof(prefix) - 1;
+    size_t suffix_len = suffix ? strlen(suffix) : 0;
+    _Static_assert(sizeof(prefix) + 3 < MQTT_MAX_TOPIC_LEN, "diag topic prefix is too long");
+
+    memcpy(out->topic, prefix, pos);
+    if (suffix_len) {
+        out->topic[pos++] = '/';
+        if (suffix_len >= sizeof(out->topic) - pos) {
+            suffix_len = sizeof(out->topic) - pos - 1;
+        }
+        memcpy(&out->topic[pos], suffix, suffix_len);
+    }
+    out->topic[pos + suffix_len] = '\0';
+    out->payload_len = 0;
+    out->qos = 0; // a lost report is superseded by the next one
     out->retain = 0;
+}
 
-    char cell_voltages[512] = {0};
-    strcat(cell_voltages, "[");
-    for (int i = 0; i < s->cell_count; ++i) {
-        char buf[16];
-        snprintf(buf, sizeof(buf), "%u%s", s->cell_voltage_mV[i], i < s->cell_count - 1 ? "," : "");
-        strncat(cell_voltages, buf, sizeof(cell_voltages) - strlen(cell_voltages) - 1);
+/**
+ * Events per period_us over the interval between two counter readings
+ */
+static uint32_t diag_rate(uint32_t now, uint32_t prev, int64_t interval_us, uint32_t period_us) {
+    if (interval_us <= 0) return 0;
+    return (uint32_t) ((uint64_t) (now - prev) * period_us / (uint64_t) interval_us);
+}
+
+static void json_diag_timing(JsonWriter *w, const char *key, const ProbeDiagTiming *t) {
+    json_key(w, key);
+    json_object_begin(w);
+    json_field_u32(w, "count", t->count);
+    json_field_u32(w, "p50", t->p50_us);
+    json_field_u32(w, "p90", t->p90_us);
+    json_field_u32(w, "p99", t->p99_us);
+    json_field_u32(w, "max", t->max_us);
+    json_object_end(w);
+}
+
+#define DIAG_JSON_COUNTER(id, key) json_field_u32(&w, key, now->counters[id]);
+
+bool mqtt_format_diag_payload(const ProbeDiagSnapshot *now, const ProbeDiagSnapshot *prev, MQTTPayload *out) {
+    if (!now || !prev || !out) return false;
+
+    set_diag_topic(out, NULL);
+
+    int64_t interval_us = now->uptime_us - prev->uptime_us;
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_timestamp(&w, "timestamp", time(NULL));
+    json_field_u32(&w, "uptime_s", (uint32_t) (now->uptime_us / 1000000));
+    json_field_u32(&w, "interval_ms", (uint32_t) (interval_us / 1000));
+    json_field_u32(&w, "rx_bytes_per_s",
+                   diag_rate(now->counters[DIAG_RX_BYTES], prev->counters[DIAG_RX_BYTES], interval_us, 1000000));
+    json_field_u32(&w, "rx_frames_per_min",
+                   diag_rate(now->counters[DIAG_RX_FRAMES], prev->counters[DIAG_RX_FRAMES], interval_us, 60000000));
+    PROBE_DIAG_RX_COUNTERS(DIAG_JSON_COUNTER)
+    json_diag_timing(&w, "rx_chunk_us", &now->timings[DIAG_TIME_RX_CHUNK]);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+bool mqtt_format_diag_router_payload(const ProbeDiagSnapshot *now, const RecordPoolStats *pool, MQTTPayload *out) {
+    if (!now || !pool || !out) return false;
+
+    set_diag_topic(out, "router");
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_timestamp(&w, "timestamp", time(NULL));
+    PROBE_DIAG_ROUTER_COUNTERS(DIAG_JSON_COUNTER)
+    json_field_u32(&w, "pool_size", (uint32_t) pool->size);
+    json_field_u32(&w, "pool_free", (uint32_t) pool->free);
+    json_field_u32(&w, "pool_min_free", (uint32_t) pool->min_free);
+    json_diag_timing(&w, "dispatch_us", &now->timings[DIAG_TIME_DISPATCH]);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+bool mqtt_format_diag_mqtt_payload(const ProbeDiagSnapshot *now, const MqttPublishStats *publisher, MQTTPayload *out) {
+    if (!now || !publisher || !out) return false;
+
+    set_diag_topic(out, "mqtt");
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_timestamp(&w, "timestamp", time(NULL));
+    PROBE_DIAG_MQTT_COUNTERS(DIAG_JSON_COUNTER)
+    json_field_u32(&w, "in_flight", publisher->in_flight);
+    json_field_u32(&w, "outbox_bytes", publisher->outbox_bytes);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+/**
+ * Upper bound of the latency histogram bucket holding the percentile, the maximum for the open-ended bucket
+ */
+static uint32_t latency_percentile_ms(const PackLatencyStats *l, uint32_t count, uint32_t percent) {
+    static const uint16_t bounds_ms[PACKET_ROUTER_LATENCY_BUCKETS - 1] = PACKET_ROUTER_LATENCY_BOUNDS_MS;
+    uint32_t rank = (uint32_t) (((uint64_t) count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (size_t i = 0; i < PACKET_ROUTER_LATENCY_BUCKETS - 1; i++) {
+        seen += l->histogram[i];
+        if (seen >= rank) return bounds_ms[i];
+    }
+    return (l->latency_max_us + 999) / 1000;
+}
+
+bool mqtt_format_diag_address_payload(const ProbeDiagAddress *a, uint32_t prev_frames, int64_t interval_us,
+                                      const PackLatencyStats *l, MQTTPayload *out) {
+    if (!a || !out) return false;
+
+    char suffix[BUS_LEVEL_LEN + 3];
+    size_t pos = put_bus_level(suffix, a->bus);
+    suffix[pos++] = hex_upper[a->address >> 4];
+    suffix[pos++] = hex_upper[a->address & 0x0F];
+    suffix[pos] = '\0';
+    set_diag_topic(out, suffix);
+
+    JsonWriter w;
+    json_writer_init(&w, out->payload, sizeof(out->payload));
+    json_object_begin(&w);
+    json_timestamp(&w, "timestamp", time(NULL));
+    json_field_u32(&w, "frames", a->frames);
+    json_field_u32(&w, "frames_per_min", diag_rate(a->frames, prev_frames, interval_us, 60000000));
+    if (l) {
+        uint32_t timed = 0;
+        for (size_t i = 0; i < PACKET_ROUTER_LATENCY_BUCKETS; i++) {
+            timed += l->histogram[i];
+        }
+        json_field_u32(&w, "responses", l->responses);
+        json_field_u32(&w, "unanswered", l->unanswered);
+        json_field_u32(&w, "orphans", l->orphans);
+        if (timed) {
+            json_field_u32(&w, "latency_min_us", l->latency_min_us);
+            json_field_u32(&w, "latency_mean_us", (uint32_t) (l->latency_sum_us / timed));
+            json_field_u32(&w, "latency_max_us", l->latency_max_us);
+            json_field_u32(&w, "latency_p50_ms", latency_percentile_ms(l, timed, 50));
+            json_field_u32(&w, "latency_p90_ms", latency_percentile_ms(l, timed, 90));
+            json_field_u32(&w, "latency_p99_ms", latency_percentile_ms(l, timed, 99));
+        }
     }
-    strcat(cell_voltages, "]");
-
-    char temps[256] = {0};
-    strcat(temps, "[");
-    for (int i = 0; i < s->temperature_count; ++i) {
-        char buf[16];
-        snprintf(buf, sizeof(buf), "%d%s", s->temperatures_c[i], i < s->temperature_count - 1 ? "," : "");
-        strncat(temps, buf, sizeof(temps) - strlen(temps) - 1);
+    json_object_end(&w);
+    return json_writer_finish(&w);
+}
+
+bool mqtt_format_capture_payload(const uint8_t *data, size_t len, MQTTPayload *out) {
+    static const char topic[] = CONFIG_PROBE_MQTT_BROKER_TOPIC_PREFIX "/" CONFIG_PROBE_DEVICE_NAME "/capture";
+    _Static_assert(sizeof(topic) <= MQTT_MAX_TOPIC_LEN, "capture topic is too long");
+    if (!data || !len || len > sizeof(out->payload) || !out) return false;
+
+    memcpy(out->topic, topic, sizeof(topic));
+    memcpy(out->payload, data, len);
+    out->payload_len = (int) len;
+    out->qos = 0; // a lost block only leaves a gap, later blocks carry their own segment header
+    out->retain = 0;
+    return true;
+}
+
+bool mqtt_format_record(const MqttRecord *r, MQTTPayload *out) {
+    if (!r || !out) return false;
+
+    switch (r->kind) {
+        case MQTT_RECORD_INFO:
+            return mqtt_format_info_payload(r->bus, &r->data.status, r->time, out);
+        case MQTT_RECORD_INFO_DELTA:
+            return mqtt_format_info_delta_payload(r->bus, r->address, &r->data.status, r->field_mask, r->time, out);
+        case MQTT_RECORD_INFO_BINARY:
+            return mqtt_format_info_binary_payload(r->bus, &r->data.status, r->time, out);
+        case MQTT_RECORD_SUMMARY:
+            return mqtt_format_summary_payload(&r->data.summary, r->time, out);
+        case MQTT_RECORD_ALARM:
+            return mqtt_format_alarm_payload(r->bus, r->address, &r->data.alarm, out);
+        case MQTT_RECORD_SYSTEM_PARAMS:
+            return mqtt_format_system_params_payload(r->bus, r->address, &r->data.params, out);
+        case MQTT_RECORD_VERSION_INFO:
+            return mqtt_format_version_payload(r->bus, r->address, r->data.protocol_version, out);
+        case MQTT_RECORD_MANUFACTURER:
+            return mqtt_format_manufacturer_payload(r->bus, r->address, &r->data.manufacturer, out);
+        case MQTT_RECORD_CHARGE_MANAGEMENT:
+            return mqtt_format_charge_management_payload(r->bus, r->address, &r->data.charge, out);
+        default:
+            return false;
     }
-    strcat(temps, "]");
-
-    int len = snprintf(out->payload, sizeof(out->payload),
-                       "{\"timestamp\":\"%s\",\"modules\":%u,\"cell_count\":%u,\"temperature_count\":%u,"
-                       "\"cell_voltage_mV\":%s,\"temperatures_c\":%s,"
-                       "\"current_mA\":%d,\"total_voltage_mV\":%u,\"remaining_capacity_ah\":%u,"
-                       "\"user_defined_number\":%u,\"total_capacity_ah\":%u,\"cycle_count\":%u,"
-                       "\"batteryCapacity\":%u,\"currentCapacity\":%u,\"userVoltage0\":%u,\""
-                       "userVoltage1\":%u,\"userVoltage2\":%u,\"userVoltage3\":%u,\"userVoltage4\":%u,\""
-                       "unknown\":%u}",
-                       timestamp,
-                       s->modules,
-                       s->cell_count,
-                       s->temperature_count,
-                       cell_voltages,
-                       temps,
-                       s->current_mA,
-                       s->total_voltage_mV,
-                       s->remaining_capacity_ah,
-                       s->user_defined_number,
-                       s->total_capacity_ah,
-                       s->cycle_count,
-                       s->batteryCapacity,
-                       s->currentCapacity,
-                       s->userVoltage0,
-                       s->userVoltage1,
-                       s->userVoltage2,
-                       s->userVoltage3,
-                       s->userVoltage4,
-                       s->unknown
-    );
-
-    return len > 0 && len < sizeof(out->payload);
 }
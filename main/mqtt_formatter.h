@@ -8,9 +8,105 @@
 #define MQTT_FORMATTER_H
 
 #include "mqtt_queue.h"
+#include "mqtt_record.h"
 #include "pylon_packet.h"
+#include "status_aggregator.h"
+#include "probe_diag.h"
+#include "packet_router.h"
+#include "record_pool.h"
 #include <stdbool.h>
 
-bool mqtt_format_info_payload(const PylonBatteryStatus *status, MQTTPayload *out);
+// Layout version of the .../info_bin payload, bump on any change to PYLON_STATUS_FIELDS
+#define MQTT_INFO_BINARY_VERSION 1
+
+/*
+ * Pack topics are <prefix>/<device>/battery/<AA>/..., AA being the address of
+ * the pack. When the probe taps more than one bus (PYLON_BUS_COUNT), they
+ * are namespaced by bus: .../battery/bus<N>/<AA>/..., the batch topic
+ * .../battery/bus<N>/batch and the per-address diagnostics .../diag/bus<N>/<AA>,
+ * N counting from 1.
+ */
+
+/**
+ * Topic and payload of a queued record, dispatching on its kind.
+ * Batches do not fit MQTTPayload and are formatted with mqtt_format_batch_payload.
+ */
+bool mqtt_format_record(const MqttRecord *record, MQTTPayload *out);
+
+/**
+ * Battery status on .../info, timestamped with unix_time
+ */
+bool mqtt_format_info_payload(uint8_t bus, const PylonBatteryStatus *status, uint32_t unix_time, MQTTPayload *out);
+
+/**
+ * Status of every pack of an MQTT_RECORD_BATCH, each with its "AA" address, as one JSON array on .../batch,
+ * timestamped with the first response of the batch
+ */
+bool mqtt_format_batch_payload(const MqttRecord *batch, MQTTBatchPayload *out);
+
+/**
+ * Only the fields selected in field_mask (bits 1u << PylonStatusField) plus the timestamp and
+ * user_defined_number, on .../<AA>/delta of the pack at address, which its deltas are tracked by
+ */
+bool mqtt_format_info_delta_payload(uint8_t bus, uint8_t address, const PylonBatteryStatus *status,
+                                    uint32_t field_mask, uint32_t unix_time, MQTTPayload *out);
+
+/**
+ * One aggregation window of the pack at aggregate->address on .../<AA>/summary:
+ * min/max/mean/last of every aggregated value
+ */
+bool mqtt_format_summary_payload(const StatusAggregate *aggregate, uint32_t unix_time, MQTTPayload *out);
+
+/**
+ * Battery status as packed little-endian values: format version (u8), unix time (u32),
+ * then PYLON_STATUS_FIELDS in order, arrays holding only their counted elements
+ */
+bool mqtt_format_info_binary_payload(uint8_t bus, const PylonBatteryStatus *status, uint32_t unix_time,
+                                     MQTTPayload *out);
+
+/**
+ * Retained description of the binary layout: "name:type" for every value in order
+ */
+bool mqtt_format_info_binary_schema(MQTTPayload *out);
+
+/**
+ * Frame receiver counters and receive chunk durations on <prefix>/<device>/diag,
+ * with byte and frame rates since prev
+ */
+bool mqtt_format_diag_payload(const ProbeDiagSnapshot *now, const ProbeDiagSnapshot *prev, MQTTPayload *out);
+
+/**
+ * Routing counters, record pool usage and dispatch durations on <prefix>/<device>/diag/router
+ */
+bool mqtt_format_diag_router_payload(const ProbeDiagSnapshot *now, const RecordPoolStats *pool, MQTTPayload *out);
+
+/**
+ * Publishing counters, QoS 1 messages in flight and outbox usage on <prefix>/<device>/diag/mqtt
+ */
+bool mqtt_format_diag_mqtt_payload(const ProbeDiagSnapshot *now, const MqttPublishStats *publisher, MQTTPayload *out);
+
+/**
+ * Frame rate and request/response latency of one address on <prefix>/<device>/diag/<AA>, or .../diag/bus<N>/<AA>.
+ * latency may be NULL for an address that has not been correlated yet.
+ */
+bool mqtt_format_diag_address_payload(const ProbeDiagAddress *address, uint32_t prev_frames, int64_t interval_us,
+                                      const PackLatencyStats *latency, MQTTPayload *out);
+
+/**
+ * Block of a bus capture (bus_capture.h) as a binary payload on <prefix>/<device>/capture
+ */
+bool mqtt_format_capture_payload(const uint8_t *data, size_t len, MQTTPayload *out);
+
+bool mqtt_format_alarm_payload(uint8_t bus, uint8_t address, const PylonAlarmInfo *alarm, MQTTPayload *out);
+
+bool mqtt_format_system_params_payload(uint8_t bus, uint8_t address, const PylonSystemParams *params, MQTTPayload *out);
+
+bool mqtt_format_version_payload(uint8_t bus, uint8_t address, uint8_t protocol_version, MQTTPayload *out);
+
+bool mqtt_format_manufacturer_payload(uint8_t bus, uint8_t address, const PylonManufacturerInfo *info,
+                                      MQTTPayload *out);
+
+bool mqtt_format_charge_management_payload(uint8_t bus, uint8_t address, const PylonChargeManagement *cm,
+                                           MQTTPayload *out);
 
 #endif
@@ -5,44 +5,190 @@
  */
 
 #include "mqtt_queue.h"
+#include "mqtt_formatter.h"
+#include "probe_diag.h"
+#include "record_pool.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "mqtt_client.h"
+#include <stdatomic.h>
 
 static const char *TAG = "mqtt_queue";
 static QueueHandle_t mqtt_queue = NULL;
+static TaskHandle_t mqtt_publish_handle = NULL;
 static esp_mqtt_client_handle_t mqtt_client_handle = NULL;
+static mqtt_record_handler_t defer_handler = NULL;
+static atomic_bool connected;
+static atomic_int in_flight;
 
-void mqtt_publish_queue_init(void) {
+#define MQTT_OUTBOX_LIMIT (CONFIG_PROBE_MQTT_OUTBOX_LIMIT_KB * 1024)
+#define MQTT_WINDOW_WAIT_MS 1000 // recheck the outbox even if no completion event arrives
+
+void mqtt_publish_queue_init(mqtt_record_handler_t defer) {
     ESP_LOGI(TAG, "MQTT publish queue initializing");
-    mqtt_queue = xQueueCreate(MQTT_QUEUE_SIZE, sizeof(MQTTPayload));
-    xTaskCreatePinnedToCore(mqtt_publish_task, "mqtt_pub_task", 4096, NULL, 8, NULL, 1);
+    defer_handler = defer;
+    mqtt_queue = xQueueCreate(MQTT_QUEUE_SIZE, sizeof(MqttRecord *));
+    xTaskCreatePinnedToCore(mqtt_publish_task, "mqtt_pub_task", 4096, NULL, 8, &mqtt_publish_handle, 1);
 }
 
 void mqtt_publish_set_client(esp_mqtt_client_handle_t client) {
     mqtt_client_handle = client;
 }
 
-bool mqtt_publish_enqueue(const MQTTPayload *msg) {
-    if (!mqtt_queue) return false;
-    return xQueueSend(mqtt_queue, msg, 0) == pdTRUE;
+bool mqtt_publish_enqueue(MqttRecord *record) {
+    if (!mqtt_queue || !record) return false;
+    return xQueueSend(mqtt_queue, &record, 0) == pdTRUE;
+}
+
+static inline void wake_publisher(void) {
+    if (mqtt_publish_handle) xTaskNotifyGive(mqtt_publish_handle);
+}
+
+void mqtt_publish_set_connected(bool online) {
+    atomic_store(&connected, online);
+    wake_publisher();
+}
+
+void mqtt_publish_completed(bool acknowledged) {
+    int n = atomic_load(&in_flight);
+    while (n > 0 && !atomic_compare_exchange_weak(&in_flight, &n, n - 1)) {
+    }
+    probe_diag_count(acknowledged ? DIAG_ACKED : DIAG_OUTBOX_EXPIRED, 1);
+    wake_publisher();
+}
+
+void mqtt_publish_stats(MqttPublishStats *out) {
+    out->in_flight = (uint32_t) atomic_load(&in_flight);
+    out->outbox_bytes = mqtt_client_handle ? (uint32_t) esp_mqtt_client_get_outbox_size(mqtt_client_handle) : 0;
+}
+
+/**
+ * Publish through the client, counting a QoS 1 message in flight until its completion event
+ */
+static int publish_message(const char *topic, const char *payload, int len, int qos, int retain) {
+    if (qos > 0) atomic_fetch_add(&in_flight, 1);
+    int msg_id = esp_mqtt_client_publish(mqtt_client_handle, topic, payload, len, qos, retain);
+    if (msg_id < 0 && qos > 0) atomic_fetch_sub(&in_flight, 1);
+    return msg_id;
+}
+
+bool mqtt_publish_now(const MQTTPayload *msg) {
+    if (!mqtt_client_handle) return false;
+    return publish_message(msg->topic, msg->payload, msg->payload_len, msg->qos, msg->retain) >= 0;
+}
+
+/**
+ * Room for one more message: fewer than CONFIG_PROBE_MQTT_MAX_IN_FLIGHT unacknowledged
+ * and the outbox below its limit. An empty outbox means nothing is in flight,
+ * whatever completion events were missed.
+ */
+static bool window_open(void) {
+    int outbox = esp_mqtt_client_get_outbox_size(mqtt_client_handle);
+    if (outbox == 0) atomic_store(&in_flight, 0);
+    return atomic_load(&in_flight) < CONFIG_PROBE_MQTT_MAX_IN_FLIGHT && outbox < MQTT_OUTBOX_LIMIT;
+}
+
+/**
+ * Block until the client can take another message, false if the connection is lost meanwhile
+ */
+static bool wait_for_window(void) {
+    while (atomic_load(&connected) && !window_open()) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_WINDOW_WAIT_MS));
+    }
+    return atomic_load(&connected);
+}
+
+/**
+ * Hand a record that could not be published back for the offline store
+ */
+static void defer_record(MqttRecord *record) {
+    probe_diag_count(DIAG_PUBLISH_DEFERRED, 1);
+    if (defer_handler) {
+        defer_handler(record);
+    } else {
+        record_pool_free(record);
+    }
+}
+
+#ifdef CONFIG_PROBE_BATCH_PUBLISH
+/**
+ * Format and publish a batch record, false if it could not be formatted.
+ * The batch has its own payload buffer, too large to use for every message.
+ */
+static bool publish_batch(const MqttRecord *record, int *msg_id) {
+    static MQTTBatchPayload batch_msg;
+    if (!mqtt_format_batch_payload(record, &batch_msg)) {
+        return false;
+    }
+    *msg_id = publish_message(batch_msg.topic, batch_msg.payload, 0, batch_msg.qos, 0);
+    ESP_LOGD(TAG, "Published %u packs to %s: msg_id=%d", record->data.batch.count, batch_msg.topic, *msg_id);
+    return true;
+}
+#endif
+
+static bool publish_record(const MqttRecord *record, int *msg_id) {
+    static MQTTPayload msg; // formatted here, one message at a time
+#ifdef CONFIG_PROBE_BATCH_PUBLISH
+    if (record->kind == MQTT_RECORD_BATCH) {
+        return publish_batch(record, msg_id);
+    }
+#endif
+    if (!mqtt_format_record(record, &msg)) {
+        return false;
+    }
+    *msg_id = publish_message(msg.topic, msg.payload, msg.payload_len, msg.qos, msg.retain);
+    ESP_LOGD(TAG, "Published to %s: msg_id=%d", msg.topic, *msg_id); // per message, compiled out by default
+    return true;
+}
+
+/**
+ * Publish a record, retrying while a message too large for the room left in the outbox
+ * waits for the messages ahead of it. Handing it back instead would only bring it
+ * straight back from the offline store. msg_id stays -2 if the outbox empties or
+ * the connection is lost meanwhile.
+ */
+static bool publish_record_when_room(const MqttRecord *record, int *msg_id) {
+    while (1) {
+        if (!publish_record(record, msg_id)) return false;
+        if (*msg_id != -2 || !atomic_load(&connected) || esp_mqtt_client_get_outbox_size(mqtt_client_handle) == 0) {
+            return true;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_WINDOW_WAIT_MS));
+    }
 }
 
 void mqtt_publish_task(void *param) {
-    MQTTPayload msg;
+    MqttRecord *record;
     while (1) {
-        if (xQueueReceive(mqtt_queue, &msg, portMAX_DELAY) == pdTRUE && mqtt_client_handle) {
-            int msg_id = esp_mqtt_client_publish(
-                mqtt_client_handle,
-                msg.topic,
-                msg.payload,
-                0,
-                msg.qos,
-                msg.retain
-            );
-            ESP_LOGI(TAG, "Published to %s: msg_id=%d", msg.topic, msg_id);
+        if (xQueueReceive(mqtt_queue, &record, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (!mqtt_client_handle) {
+            record_pool_free(record);
+            continue;
+        }
+        // backpressure: while the broker is behind, records stay here and the queue fills up
+        if (!wait_for_window()) {
+            defer_record(record);
+            continue;
+        }
+        int msg_id;
+        if (!publish_record_when_room(record, &msg_id)) {
+            probe_diag_count(DIAG_FORMAT_FAILED, 1);
+            ESP_LOGW(TAG, "Format MQTT payload of record kind %u failed", record->kind);
+            record_pool_free(record);
+            continue;
+        }
+        if (msg_id == -2 || (msg_id < 0 && !atomic_load(&connected))) {
+            defer_record(record); // outbox full or connection lost, keep it for later
+            continue;
+        }
+        if (msg_id < 0) {
+            probe_diag_count(DIAG_PUBLISH_FAILED, 1);
+            ESP_LOGW(TAG, "Publish of record kind %u failed", record->kind);
         }
+        record_pool_free(record); // the client has sent the message or copied it to its outbox
     }
 }
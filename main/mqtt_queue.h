@@ -11,22 +11,76 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "mqtt_client.h"
+#include "mqtt_record.h"
+#include "sdkconfig.h"
 
 #define MQTT_MAX_TOPIC_LEN 128
+#ifdef CONFIG_PROBE_INFO_PAYLOAD_BINARY
+// without JSON status payloads the largest message is an alarm report of a 32-cell pack
+#define MQTT_MAX_PAYLOAD_LEN 512
+#else
 #define MQTT_MAX_PAYLOAD_LEN 1024
+#endif
 #define MQTT_QUEUE_SIZE 10
+// JSON status of every pack of a full bus in one message, 32-cell packs with the widest values
+#define MQTT_BATCH_MAX_PAYLOAD_LEN (MQTT_RECORD_BATCH_MAX_PACKS * 704)
 
 typedef struct {
     char topic[MQTT_MAX_TOPIC_LEN];
     char payload[MQTT_MAX_PAYLOAD_LEN];
+    int payload_len; // 0 - payload is a NUL-terminated string
     int qos;
     int retain;
 } MQTTPayload;
 
-void mqtt_publish_queue_init(void);
+typedef struct {
+    char topic[MQTT_MAX_TOPIC_LEN];
+    char payload[MQTT_BATCH_MAX_PAYLOAD_LEN];
+    int qos;
+} MQTTBatchPayload;
+
+typedef struct {
+    uint32_t in_flight; // QoS 1 messages published and not acknowledged yet
+    uint32_t outbox_bytes; // held by the MQTT client until acknowledged
+} MqttPublishStats;
+
+/**
+ * Takes a record the publish task could not hand to the MQTT client because the
+ * connection is down or its outbox is full. The callee owns the record from then on.
+ */
+typedef void (*mqtt_record_handler_t)(MqttRecord *record);
+
+void mqtt_publish_queue_init(mqtt_record_handler_t defer);
 
 void mqtt_publish_set_client(esp_mqtt_client_handle_t client); // ← добавляем это
-bool mqtt_publish_enqueue(const MQTTPayload *msg);
+
+/**
+ * Queue a pool record for the publish task, which formats it right before publishing.
+ * On success the queue owns the record and returns it to the pool once published;
+ * on failure the caller keeps it.
+ */
+bool mqtt_publish_enqueue(MqttRecord *record);
+
+/**
+ * Publish an already formatted message from the calling task, bypassing the queue.
+ * For occasional messages (diagnostics, schema) that are not kept while offline.
+ */
+bool mqtt_publish_now(const MQTTPayload *msg);
+
+/**
+ * Connection state from the MQTT event handler. Records taken from the queue
+ * while disconnected are deferred instead of published.
+ */
+void mqtt_publish_set_connected(bool connected);
+
+/**
+ * Completion of a QoS 1 message from the MQTT event handler: acknowledged by the
+ * broker (MQTT_EVENT_PUBLISHED) or dropped from the outbox unacknowledged
+ * (MQTT_EVENT_DELETED). Opens the window for the next message.
+ */
+void mqtt_publish_completed(bool acknowledged);
+
+void mqtt_publish_stats(MqttPublishStats *out);
 
 void mqtt_publish_task(void *param);
 
@@ -0,0 +1,82 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef MQTT_RECORD_H
+#define MQTT_RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pylon_packet.h"
+#include "status_aggregator.h"
+
+/*
+ * Decoded response waiting to be published.
+ *
+ * The publish and offline queues carry these instead of formatted messages:
+ * a record holds only the values, and the topic and JSON (or binary) payload
+ * are produced by mqtt_format_record right before publishing. The time the
+ * response arrived is kept, so a message sent late still tells when it was
+ * measured.
+ */
+
+// Layout version of MqttRecord as kept in flash, bump on any change to the record or the types it holds
+#define MQTT_RECORD_VERSION 2
+#define MQTT_RECORD_BATCH_MAX_PACKS 16
+
+// X(kind, member): record kind and the data member it uses
+#define MQTT_RECORD_KINDS(X) \
+    X(MQTT_RECORD_INFO, status) \
+    X(MQTT_RECORD_INFO_DELTA, status) \
+    X(MQTT_RECORD_INFO_BINARY, status) \
+    X(MQTT_RECORD_SUMMARY, summary) \
+    X(MQTT_RECORD_ALARM, alarm) \
+    X(MQTT_RECORD_SYSTEM_PARAMS, params) \
+    X(MQTT_RECORD_VERSION_INFO, protocol_version) \
+    X(MQTT_RECORD_MANUFACTURER, manufacturer) \
+    X(MQTT_RECORD_CHARGE_MANAGEMENT, charge) \
+    X(MQTT_RECORD_BATCH, batch)
+
+#define MQTT_RECORD_KIND_ID(kind, member) kind,
+
+typedef enum {
+    MQTT_RECORD_KINDS(MQTT_RECORD_KIND_ID)
+    MQTT_RECORD_KIND_COUNT
+} MqttRecordKind;
+
+typedef struct MqttRecord {
+    uint8_t kind; // MqttRecordKind
+    uint8_t bus; // bus of the responding pack, 0 for the first
+    uint8_t address; // bus address of the responding pack
+    uint32_t time; // unix time the response arrived
+    uint32_t field_mask; // MQTT_RECORD_INFO_DELTA: fields to publish, bits 1u << PylonStatusField
+    union {
+        PylonBatteryStatus status;
+        StatusAggregate summary;
+        PylonAlarmInfo alarm;
+        PylonSystemParams params;
+        uint8_t protocol_version;
+        PylonManufacturerInfo manufacturer;
+        PylonChargeManagement charge;
+        struct {
+            uint8_t count;
+            struct MqttRecord *packs[MQTT_RECORD_BATCH_MAX_PACKS]; // MQTT_RECORD_INFO records, owned by the batch
+        } batch; // never stored in flash
+    } data;
+} MqttRecord;
+
+#define MQTT_RECORD_KIND_SIZE(kind, member) \
+    case kind: return offsetof(MqttRecord, data) + sizeof(((MqttRecord *) 0)->data.member);
+
+/**
+ * Bytes of the record that carry data for its kind, 0 for an unknown kind
+ */
+static inline size_t mqtt_record_size(const MqttRecord *r) {
+    switch (r->kind) {
+        MQTT_RECORD_KINDS(MQTT_RECORD_KIND_SIZE)
+        default: return 0;
+    }
+}
+
+#endif // MQTT_RECORD_H
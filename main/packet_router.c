@@ -7,80 +7,728 @@
 #include "pylon_packet.h"
 #include "mqtt_formatter.h"
 #include "mqtt_queue.h"
+#include "status_aggregator.h"
+#include "probe_diag.h"
+#include "flash_store.h"
+#include "record_pool.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
 #include <string.h>
+#include <time.h>
 
 static const char *TAG = "packet_router";
 
 static bool wifi_online = false;
-static QueueHandle_t retry_queue = NULL;
+static QueueHandle_t retry_queue = NULL; // offline buffer of pool records when there is no flash store
+static TaskHandle_t store_drain_handle = NULL;
+
+#ifdef CONFIG_PROBE_BATCH_PUBLISH
+// Records kept free for the batches being collected: a full batch of every bus
+#define BATCH_RESERVE (PYLON_BUS_COUNT * RECORD_POOL_BATCH_SLOTS)
+_Static_assert(RECORD_POOL_SIZE > BATCH_RESERVE, "PROBE_RECORD_POOL_SIZE leaves no record beside the batches");
+
+// Status records of the current poll cycle of every bus and the time the last one joined,
+// used by the dispatch task only
+static MqttRecord *status_batches[PYLON_BUS_COUNT];
+static int64_t batch_joined_us[PYLON_BUS_COUNT];
+
+/**
+ * Records the open batches may still take before they are full
+ */
+static size_t batch_reserve_left(void) {
+    return record_pool_batch_reserve_left(status_batches, PYLON_BUS_COUNT);
+}
+#else
+#define BATCH_RESERVE 0
+
+static inline size_t batch_reserve_left(void) {
+    return 0;
+}
+#endif
+
+#if defined(CONFIG_PROBE_INFO_PAYLOAD_BINARY) || defined(CONFIG_PROBE_INFO_PAYLOAD_BOTH)
+// called from the MQTT event task only
+static void publish_binary_schema(void) {
+    static MQTTPayload schema_msg;
+    if (!mqtt_format_info_binary_schema(&schema_msg) || !mqtt_publish_now(&schema_msg)) {
+        ESP_LOGW(TAG, "Failed to publish binary payload schema");
+    }
+}
+#endif
 
 void packet_router_set_online(bool online) {
     wifi_online = online;
-    if (online && retry_queue) {
-        MQTTPayload msg;
-        while (xQueueReceive(retry_queue, &msg, 0) == pdTRUE) {
-            mqtt_publish_enqueue(&msg);
-            ESP_LOGI(TAG, "Resent deferred packet for topic %s", msg.topic);
+#if defined(CONFIG_PROBE_INFO_PAYLOAD_BINARY) || defined(CONFIG_PROBE_INFO_PAYLOAD_BOTH)
+    if (online) {
+        publish_binary_schema();
+    }
+#endif
+    if (online && store_drain_handle) {
+        xTaskNotifyGive(store_drain_handle);
+    }
+}
+
+bool packet_router_is_online(void) {
+    return wifi_online;
+}
+
+/**
+ * Next record kept while offline, NULL if there is none or no pool slot to read it into.
+ * The records the open batches may need are left alone, the publisher frees more.
+ */
+static MqttRecord *take_deferred(void) {
+    MqttRecord *record = NULL;
+    if (record_pool_available() <= BATCH_RESERVE) return NULL;
+    if (!flash_store_available()) {
+        return xQueueReceive(retry_queue, &record, 0) == pdTRUE ? record : NULL;
+    }
+    if (!flash_store_pending() || !(record = record_pool_alloc())) return NULL;
+    if (!flash_store_peek(record)) {
+        record_pool_free(record);
+        return NULL;
+    }
+    return record;
+}
+
+/**
+ * Forward records kept while offline or deferred by the publisher once MQTT can take them,
+ * CONFIG_PROBE_STORE_DRAIN_BATCH at a time so live traffic and the broker are not swamped
+ */
+static void store_drain_task(void *param) {
+    MqttRecord *record = NULL; // taken from the offline store, not yet accepted by the publish queue
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t sent = 0;
+        while (wifi_online) {
+            if (!record && !(record = take_deferred())) {
+                if (!flash_store_pending()) break;
+                vTaskDelay(pdMS_TO_TICKS(CONFIG_PROBE_STORE_DRAIN_INTERVAL_MS)); // live traffic holds every slot
+                continue;
+            }
+            if (!mqtt_publish_enqueue(record)) {
+                vTaskDelay(pdMS_TO_TICKS(CONFIG_PROBE_STORE_DRAIN_INTERVAL_MS)); // publish queue is full
+                continue;
+            }
+            record = NULL; // owned by the publish queue now
+            flash_store_consume();
+            if (++sent % CONFIG_PROBE_STORE_DRAIN_BATCH == 0) {
+                vTaskDelay(pdMS_TO_TICKS(CONFIG_PROBE_STORE_DRAIN_INTERVAL_MS));
+            }
+        }
+        if (sent) {
+            ESP_LOGI(TAG, "Resent %lu deferred messages, %lu left", (unsigned long) sent,
+                     (unsigned long) (flash_store_available() ? flash_store_pending()
+                                                              : uxQueueMessagesWaiting(retry_queue)));
         }
     }
 }
 
 void packet_router_init(void) {
     ESP_LOGI(TAG, "Packet router initializing");
-    retry_queue = xQueueCreate(10, sizeof(MQTTPayload));
+    bool stored = false;
+#ifdef CONFIG_PROBE_OFFLINE_STORE
+    stored = flash_store_init();
+#endif
+    if (!stored) {
+        retry_queue = xQueueCreate(10, sizeof(MqttRecord *));
+    }
+    xTaskCreatePinnedToCore(store_drain_task, "store_drain", 4096, NULL, 4, &store_drain_handle, 1);
 }
 
-bool mqtt_retry_enqueue_force(QueueHandle_t q, const MQTTPayload *msg) {
-    if (xQueueSend(q, msg, 0) == pdTRUE) {
+/**
+ * Queue a pool record, making room by discarding the oldest one; the queue owns the record on success
+ */
+bool mqtt_retry_enqueue_force(QueueHandle_t q, MqttRecord *record) {
+    if (xQueueSend(q, &record, 0) == pdTRUE) {
         return true;
     } else {
         ESP_LOGI(TAG, "Stored packet for later (offline mode)");
     }
 
-    MQTTPayload discarded;
+    MqttRecord *discarded;
     if (xQueueReceive(q, &discarded, 0) == pdTRUE) {
         ESP_LOGW("MQTT", "Queue full, discarding oldest message");
-        return xQueueSend(q, msg, 0) == pdTRUE;
+        probe_diag_count(DIAG_DEFERRED_DROPPED, 1);
+        record_pool_free(discarded);
+        return xQueueSend(q, &record, 0) == pdTRUE;
     }
 
     return false;
 }
 
-void my_packet_handler(const char *ascii_packet, size_t len) {
-    PylonPacketRaw raw;
-    if (!pylon_decode_ascii_hex(ascii_packet, len, &raw)) {
-        ESP_LOGW(TAG, "Decode failed");
-        return;
+typedef enum {
+    ROUTE_FAILED,
+    ROUTE_PUBLISH, // record is ready in out
+    ROUTE_SUPPRESSED // nothing new to publish for this response
+} RouteResult;
+
+static inline RouteResult route_result(bool decoded) {
+    return decoded ? ROUTE_PUBLISH : ROUTE_FAILED;
+}
+
+/**
+ * Start a record of the response from address on bus, stamped with the current time
+ */
+static inline void record_begin(MqttRecord *out, MqttRecordKind kind, uint8_t bus, uint8_t address) {
+    out->kind = (uint8_t) kind;
+    out->bus = bus;
+    out->address = address;
+    out->time = (uint32_t) time(NULL);
+    out->field_mask = 0;
+}
+
+#ifdef CONFIG_PROBE_DELTA_PUBLISH
+// Last published values of a pack. Fields are updated only when they are
+// published, so slow drift is still reported once it exceeds the deadband.
+typedef struct {
+    bool used;
+    uint8_t bus;
+    uint8_t address;
+    int64_t full_us; // time of the last full publish
+    uint32_t lost; // messages_lost() at the last full publish
+    PylonBatteryStatus published;
+} PackSnapshot;
+
+// Used by the dispatch task only
+static PackSnapshot snapshots[PACKET_ROUTER_MAX_PACKS];
+
+static PackSnapshot *pack_snapshot(uint8_t bus, uint8_t address) {
+    PackSnapshot *free_snap = NULL;
+    PackSnapshot *oldest = &snapshots[0];
+    for (size_t i = 0; i < PACKET_ROUTER_MAX_PACKS; i++) {
+        PackSnapshot *snap = &snapshots[i];
+        if (!snap->used) {
+            if (!free_snap) free_snap = snap;
+            continue;
+        }
+        if (snap->bus == bus && snap->address == address) return snap;
+        if (snap->full_us < oldest->full_us) oldest = snap;
     }
+    if (free_snap) return free_snap;
+    oldest->used = false;
+    return oldest;
+}
 
-    if (raw.cid1 != 0x46 || raw.cid2 != 0x00) {
-        ESP_LOGI(TAG, "Unknown CID: %02X%02X. Ignored", raw.cid1, raw.cid2);
-        return;
+static uint32_t field_deadband(PylonStatusField field) {
+    switch (field) {
+        case PYLON_STATUS_FIELD_cell_voltage_mV: return CONFIG_PROBE_DEADBAND_CELL_MV;
+        case PYLON_STATUS_FIELD_total_voltage_mV: return CONFIG_PROBE_DEADBAND_PACK_MV;
+        case PYLON_STATUS_FIELD_current_mA: return CONFIG_PROBE_DEADBAND_CURRENT_MA;
+        case PYLON_STATUS_FIELD_temperatures_c: return CONFIG_PROBE_DEADBAND_TEMPERATURE;
+        default: return 0; // counters and capacities: any change
+    }
+}
+
+static inline bool beyond_deadband(int32_t value, int32_t published, PylonStatusField field) {
+    uint32_t diff = value > published ? (uint32_t) (value - published) : (uint32_t) (published - value);
+    return diff > field_deadband(field);
+}
+
+#define DELTA_SCALAR(type, field) \
+    if (beyond_deadband(s->field, snap->field, PYLON_STATUS_FIELD_##field)) { \
+        mask |= 1u << PYLON_STATUS_FIELD_##field; \
+    }
+#define DELTA_ARRAY(type, field, count_field) \
+    for (int i = 0; i < s->count_field; i++) { \
+        if (beyond_deadband(s->field[i], snap->field[i], PYLON_STATUS_FIELD_##field)) { \
+            mask |= 1u << PYLON_STATUS_FIELD_##field; \
+            break; \
+        } \
     }
+#define DELTA_COMMIT_SCALAR(type, field) \
+    if (mask & (1u << PYLON_STATUS_FIELD_##field)) snap->field = s->field;
+#define DELTA_COMMIT_ARRAY(type, field, count_field) \
+    if (mask & (1u << PYLON_STATUS_FIELD_##field)) memcpy(snap->field, s->field, sizeof(snap->field));
 
+/**
+ * Fields of s that moved past their deadband since they were last published
+ */
+static uint32_t changed_fields(const PylonBatteryStatus *s, const PylonBatteryStatus *snap) {
+    uint32_t mask = 0;
+    PYLON_STATUS_FIELDS(DELTA_SCALAR, DELTA_ARRAY)
+    return mask;
+}
+
+static void commit_fields(const PylonBatteryStatus *s, PylonBatteryStatus *snap, uint32_t mask) {
+    PYLON_STATUS_FIELDS(DELTA_COMMIT_SCALAR, DELTA_COMMIT_ARRAY)
+}
+
+/**
+ * Messages given up after they left the router. Snapshots are updated when a
+ * record is routed, so a lost delta would leave consumers behind until the
+ * value moves past its deadband again.
+ */
+static uint32_t messages_lost(void) {
+    return probe_diag_get(DIAG_DEFERRED_DROPPED) + probe_diag_get(DIAG_OUTBOX_EXPIRED) +
+           probe_diag_get(DIAG_PUBLISH_FAILED);
+}
+
+/**
+ * Full status when the pack is new, its layout changed, it has been silent
+ * for too long or any message was lost since its last full status; otherwise
+ * only the changed fields, or nothing at all.
+ */
+static RouteResult record_status_delta(MqttRecord *out) {
+    const PylonBatteryStatus *status = &out->data.status;
+    PackSnapshot *snap = pack_snapshot(out->bus, out->address);
+    int64_t now = esp_timer_get_time();
+    uint32_t lost = messages_lost();
+
+    if (!snap->used ||
+        snap->published.cell_count != status->cell_count ||
+        snap->published.temperature_count != status->temperature_count ||
+        snap->lost != lost ||
+        now - snap->full_us >= CONFIG_PROBE_DELTA_MAX_SILENCE_S * 1000000LL) {
+        snap->used = true;
+        snap->bus = out->bus;
+        snap->address = out->address;
+        snap->full_us = now;
+        snap->lost = lost;
+        snap->published = *status;
+        return ROUTE_PUBLISH;
+    }
+
+    uint32_t mask = changed_fields(status, &snap->published);
+    if (!mask) return ROUTE_SUPPRESSED;
+    commit_fields(status, &snap->published, mask);
+    out->kind = MQTT_RECORD_INFO_DELTA;
+    out->field_mask = mask;
+    return ROUTE_PUBLISH;
+}
+#endif
+
+#ifndef CONFIG_PROBE_INFO_PAYLOAD_BINARY
+static RouteResult decode_analog(const PylonFrameView *frame, MqttRecord *out) {
+#if defined(CONFIG_PROBE_AGGREGATE_PUBLISH)
     PylonBatteryStatus status;
-    if (!pylon_parse_info_payload(raw.data, raw.data_length, &status)) {
+    if (!pylon_parse_info_payload(frame, &status)) {
+        ESP_LOGI(TAG, "Parse INFO failed. Ignored");
+        return ROUTE_FAILED;
+    }
+    record_begin(out, MQTT_RECORD_SUMMARY, frame->bus, frame->address);
+    return status_aggregator_add(frame->bus, frame->address, &status, esp_timer_get_time(),
+                                 CONFIG_PROBE_AGGREGATE_WINDOW_S * 1000000LL, &out->data.summary)
+           ? ROUTE_PUBLISH : ROUTE_SUPPRESSED;
+#else
+    record_begin(out, MQTT_RECORD_INFO, frame->bus, frame->address);
+    if (!pylon_parse_info_payload(frame, &out->data.status)) {
         ESP_LOGI(TAG, "Parse INFO failed. Ignored");
+        return ROUTE_FAILED;
+    }
+#if defined(CONFIG_PROBE_DELTA_PUBLISH)
+    return record_status_delta(out);
+#else
+    return ROUTE_PUBLISH;
+#endif
+#endif
+}
+#endif
+
+#if defined(CONFIG_PROBE_INFO_PAYLOAD_BINARY) || defined(CONFIG_PROBE_INFO_PAYLOAD_BOTH)
+static RouteResult decode_analog_binary(const PylonFrameView *frame, MqttRecord *out) {
+    record_begin(out, MQTT_RECORD_INFO_BINARY, frame->bus, frame->address);
+    return route_result(pylon_parse_info_payload(frame, &out->data.status));
+}
+#endif
+
+static RouteResult decode_alarm(const PylonFrameView *frame, MqttRecord *out) {
+    record_begin(out, MQTT_RECORD_ALARM, frame->bus, frame->address);
+    return route_result(pylon_parse_alarm_payload(frame, &out->data.alarm));
+}
+
+static RouteResult decode_system_params(const PylonFrameView *frame, MqttRecord *out) {
+    record_begin(out, MQTT_RECORD_SYSTEM_PARAMS, frame->bus, frame->address);
+    return route_result(pylon_parse_system_params(frame, &out->data.params));
+}
+
+static RouteResult decode_protocol_version(const PylonFrameView *frame, MqttRecord *out) {
+    record_begin(out, MQTT_RECORD_VERSION_INFO, frame->bus, frame->address);
+    out->data.protocol_version = frame->version;
+    return ROUTE_PUBLISH;
+}
+
+static RouteResult decode_manufacturer(const PylonFrameView *frame, MqttRecord *out) {
+    record_begin(out, MQTT_RECORD_MANUFACTURER, frame->bus, frame->address);
+    return route_result(pylon_parse_manufacturer_info(frame, &out->data.manufacturer));
+}
+
+static RouteResult decode_charge_management(const PylonFrameView *frame, MqttRecord *out) {
+    record_begin(out, MQTT_RECORD_CHARGE_MANAGEMENT, frame->bus, frame->address);
+    return route_result(pylon_parse_charge_management(frame, &out->data.charge));
+}
+
+typedef RouteResult (*pylon_response_decoder_t)(const PylonFrameView *response, MqttRecord *out);
+
+typedef struct {
+    uint8_t cid1;
+    uint8_t cid2; // command code of the request the response answers
+    const char *name;
+    pylon_response_decoder_t decode;
+} PylonCommandRoute;
+
+// A command may have several routes, each of them publishes its own message
+static const PylonCommandRoute command_routes[] = {
+#ifndef CONFIG_PROBE_INFO_PAYLOAD_BINARY
+    {PYLON_CID1_BATTERY, PYLON_CID2_ANALOG, "analog", decode_analog},
+#endif
+#if defined(CONFIG_PROBE_INFO_PAYLOAD_BINARY) || defined(CONFIG_PROBE_INFO_PAYLOAD_BOTH)
+    {PYLON_CID1_BATTERY, PYLON_CID2_ANALOG, "analog binary", decode_analog_binary},
+#endif
+    {PYLON_CID1_BATTERY, PYLON_CID2_ALARM, "alarm", decode_alarm},
+    {PYLON_CID1_BATTERY, PYLON_CID2_SYSTEM_PARAMS, "system params", decode_system_params},
+    {PYLON_CID1_BATTERY, PYLON_CID2_PROTOCOL_VERSION, "protocol version", decode_protocol_version},
+    {PYLON_CID1_BATTERY, PYLON_CID2_MANUFACTURER, "manufacturer", decode_manufacturer},
+    {PYLON_CID1_BATTERY, PYLON_CID2_CHARGE_MANAGEMENT, "charge management", decode_charge_management},
+};
+
+#define COMMAND_ROUTE_COUNT (sizeof(command_routes) / sizeof(command_routes[0]))
+
+/**
+ * First route of cid1/cid2 at or after command_routes[from], NULL if there is none
+ */
+static const PylonCommandRoute *find_route(uint8_t cid1, uint8_t cid2, size_t from) {
+    for (size_t i = from; i < COMMAND_ROUTE_COUNT; i++) {
+        if (command_routes[i].cid1 == cid1 && command_routes[i].cid2 == cid2) {
+            return &command_routes[i];
+        }
+    }
+    return NULL;
+}
+
+const uint16_t packet_router_latency_bounds_ms[PACKET_ROUTER_LATENCY_BUCKETS - 1] = PACKET_ROUTER_LATENCY_BOUNDS_MS;
+
+// Responses carry only the RTN code, so the last request per address of a bus
+// tells how to decode the next response from that address
+typedef struct {
+    uint8_t cid1;
+    uint8_t cid2;
+    bool pending;
+    int64_t eoi_us;
+} PendingRequest;
+
+typedef struct {
+    bool used;
+    int64_t last_seen_us;
+    PendingRequest request;
+    PackLatencyStats stats;
+} CorrelationEntry;
+
+// Written by the dispatch task only, read by packet_router_latency_snapshot
+static CorrelationEntry correlation[PACKET_ROUTER_MAX_PACKS];
+static portMUX_TYPE correlation_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Find the entry for address on bus, claiming a free or the least recently seen one
+ */
+static CorrelationEntry *correlation_entry(uint8_t bus, uint8_t address) {
+    CorrelationEntry *free_entry = NULL;
+    CorrelationEntry *stalest = &correlation[0];
+    for (size_t i = 0; i < PACKET_ROUTER_MAX_PACKS; i++) {
+        CorrelationEntry *e = &correlation[i];
+        if (!e->used) {
+            if (!free_entry) free_entry = e;
+            continue;
+        }
+        if (e->stats.bus == bus && e->stats.address == address) return e;
+        if (e->last_seen_us < stalest->last_seen_us) stalest = e;
+    }
+
+    CorrelationEntry *e = free_entry ? free_entry : stalest;
+    memset(e, 0, sizeof(*e));
+    e->used = true;
+    e->stats.bus = bus;
+    e->stats.address = address;
+    e->stats.latency_min_us = UINT32_MAX;
+    return e;
+}
+
+static void record_latency(PackLatencyStats *stats, uint32_t latency_us) {
+    size_t bucket = 0;
+    while (bucket < PACKET_ROUTER_LATENCY_BUCKETS - 1 &&
+           latency_us > packet_router_latency_bounds_ms[bucket] * 1000u) {
+        bucket++;
+    }
+    stats->histogram[bucket]++;
+    stats->responses++;
+    stats->latency_sum_us += latency_us;
+    if (latency_us < stats->latency_min_us) stats->latency_min_us = latency_us;
+    if (latency_us > stats->latency_max_us) stats->latency_max_us = latency_us;
+}
+
+/**
+ * Pair a response with the request pending for its address.
+ * Returns false for orphans: no request, or the request is older than the response timeout.
+ */
+static bool correlate_response(const PylonFrameView *frame, PendingRequest *request) {
+    bool paired = false;
+
+    portENTER_CRITICAL(&correlation_lock);
+    CorrelationEntry *e = correlation_entry(frame->bus, frame->address);
+    e->last_seen_us = frame->eoi_us;
+    *request = e->request;
+    e->request.pending = false;
+
+    if (request->pending) {
+        int64_t latency_us = frame->soi_us - request->eoi_us;
+        if (!frame->soi_us || !request->eoi_us) {
+            e->stats.responses++; // no timestamps (replayed data), pair without timing
+            paired = true;
+        } else if (latency_us >= 0 && latency_us <= CONFIG_PROBE_RESPONSE_TIMEOUT_MS * 1000LL) {
+            record_latency(&e->stats, (uint32_t) latency_us);
+            paired = true;
+        }
+    }
+    if (!paired) e->stats.orphans++;
+    portEXIT_CRITICAL(&correlation_lock);
+
+    return paired;
+}
+
+static void correlate_request(const PylonFrameView *frame) {
+    portENTER_CRITICAL(&correlation_lock);
+    CorrelationEntry *e = correlation_entry(frame->bus, frame->address);
+    e->last_seen_us = frame->eoi_us;
+    if (e->request.pending) e->stats.unanswered++;
+    e->request.cid1 = frame->cid1;
+    e->request.cid2 = frame->cid2;
+    e->request.eoi_us = frame->eoi_us;
+    e->request.pending = true;
+    portEXIT_CRITICAL(&correlation_lock);
+}
+
+size_t packet_router_latency_snapshot(PackLatencyStats *out, size_t max_entries) {
+    size_t n = 0;
+    portENTER_CRITICAL(&correlation_lock);
+    for (size_t i = 0; i < PACKET_ROUTER_MAX_PACKS && n < max_entries; i++) {
+        if (correlation[i].used) {
+            out[n++] = correlation[i].stats;
+        }
+    }
+    portEXIT_CRITICAL(&correlation_lock);
+    return n;
+}
+
+static void store_record(const MqttRecord *record) {
+    if (flash_store_append(record)) {
+        probe_diag_count(DIAG_STORED, 1);
+    } else {
+        probe_diag_count(DIAG_DEFERRED_DROPPED, 1);
+        ESP_LOGW(TAG, "Failed to store record from %02X on bus %u", record->address, record->bus + 1);
+    }
+}
+
+/**
+ * Keep a pool record for the drain task, returning it to the pool unless the RAM queue took it
+ */
+static void keep_record(MqttRecord *record) {
+    if (flash_store_available()) {
+        if (record->kind == MQTT_RECORD_BATCH) {
+            // batches hold pointers, their packs are stored and later resent one by one
+            for (size_t i = 0; i < record->data.batch.count; i++) {
+                store_record(record->data.batch.packs[i]);
+            }
+        } else {
+            store_record(record);
+        }
+    } else {
+        if (mqtt_retry_enqueue_force(retry_queue, record)) {
+            return;
+        }
+        probe_diag_count(DIAG_DEFERRED_DROPPED, 1);
+        ESP_LOGW(TAG, "Retry queue full, failed to force enqueue");
+    }
+    record_pool_free(record);
+}
+
+void packet_router_defer(MqttRecord *record) {
+    keep_record(record);
+    if (store_drain_handle) {
+        xTaskNotifyGive(store_drain_handle);
+    }
+}
+
+/**
+ * Pool record for a new response. When the pool is down to what the open batches
+ * may still need, records kept in RAM while offline give way to it, oldest first.
+ */
+static MqttRecord *alloc_record(void) {
+    MqttRecord *oldest;
+    while (retry_queue && record_pool_available() <= batch_reserve_left() &&
+           xQueueReceive(retry_queue, &oldest, 0) == pdTRUE) {
+        ESP_LOGW(TAG, "Records running out, discarding the oldest offline message");
+        probe_diag_count(DIAG_DEFERRED_DROPPED, 1);
+        record_pool_free(oldest);
+    }
+    return record_pool_alloc();
+}
+
+/**
+ * Hand a pool record to the publish queue or keep it for later. A full publish queue,
+ * or one holding the records the open batches need, means the broker is behind,
+ * so the record waits in the offline store instead.
+ */
+static void route_record(MqttRecord *record) {
+    if (!wifi_online) {
+        keep_record(record);
+        return;
+    }
+    if (record_pool_available() >= batch_reserve_left() && mqtt_publish_enqueue(record)) {
+        probe_diag_count(DIAG_PUBLISHED, 1);
+        return;
+    }
+    probe_diag_count(DIAG_PUBLISH_DEFERRED, 1);
+    packet_router_defer(record);
+}
+
+#ifdef CONFIG_PROBE_BATCH_PUBLISH
+static bool batch_has_pack(const MqttRecord *batch, uint8_t address) {
+    for (size_t i = 0; i < batch->data.batch.count; i++) {
+        if (batch->data.batch.packs[i]->address == address) return true;
+    }
+    return false;
+}
+
+/**
+ * Route the batch of bus as one message, its records no longer count against the reserve
+ */
+static void close_batch(uint8_t bus) {
+    MqttRecord *batch = status_batches[bus];
+    status_batches[bus] = NULL;
+    route_record(batch);
+}
+
+/**
+ * Collect a status record into the batch of the current poll cycle of its bus.
+ * A pack answering again means the master started the next cycle, so the batch
+ * is routed as one message and a new one begins with this record.
+ */
+static void batch_status(MqttRecord *status) {
+    MqttRecord **batch = &status_batches[status->bus];
+    if (*batch && (batch_has_pack(*batch, status->address) ||
+                   (*batch)->data.batch.count == MQTT_RECORD_BATCH_MAX_PACKS)) {
+        close_batch(status->bus);
+    }
+    if (!*batch) {
+        *batch = alloc_record();
+        if (!*batch) {
+            ESP_LOGW(TAG, "No free record for a batch, status of %02X on bus %u dropped", status->address,
+                     status->bus + 1);
+            record_pool_free(status);
+            return;
+        }
+        record_begin(*batch, MQTT_RECORD_BATCH, status->bus, 0);
+        (*batch)->time = status->time;
+        (*batch)->data.batch.count = 0;
+    }
+    (*batch)->data.batch.packs[(*batch)->data.batch.count++] = status;
+    batch_joined_us[status->bus] = esp_timer_get_time();
+}
+
+/**
+ * Route the batches no pack has joined for CONFIG_PROBE_BATCH_TIMEOUT_S:
+ * the master stopped polling, and no next cycle will close them
+ */
+static void flush_batches(int64_t now_us) {
+    for (uint8_t b = 0; b < PYLON_BUS_COUNT; b++) {
+        if (status_batches[b] && now_us - batch_joined_us[b] >= CONFIG_PROBE_BATCH_TIMEOUT_S * 1000000LL) {
+            close_batch(b);
+        }
+    }
+}
+#endif
+
+/**
+ * Route a record ready for publishing, collecting status records into batches when enabled
+ */
+static void publish_record(MqttRecord *record) {
+#ifdef CONFIG_PROBE_BATCH_PUBLISH
+    if (record->kind == MQTT_RECORD_INFO) {
+        batch_status(record);
+        return;
+    }
+#endif
+    route_record(record);
+}
+
+#ifdef CONFIG_PROBE_AGGREGATE_PUBLISH
+/**
+ * Publish the elapsed windows of packs that went silent, which no frame of theirs will close.
+ * The record is taken first: without one the windows stay in the aggregator for the next tick.
+ */
+static void flush_summaries(int64_t now_us) {
+    while (1) {
+        MqttRecord *record = alloc_record();
+        if (!record) {
+            ESP_LOGW(TAG, "No free record for the summaries of silent packs, retried later");
+            return;
+        }
+        if (!status_aggregator_flush(now_us, CONFIG_PROBE_AGGREGATE_WINDOW_S * 1000000LL, &record->data.summary)) {
+            record_pool_free(record);
+            return;
+        }
+        record_begin(record, MQTT_RECORD_SUMMARY, record->data.summary.bus, record->data.summary.address);
+        route_record(record);
+    }
+}
+#endif
+
+void my_packet_handler(const PylonFrameView *frame) {
+    if (pylon_is_request(frame->cid2)) {
+        correlate_request(frame);
+        return;
+    }
+
+    PendingRequest request;
+    if (!correlate_response(frame, &request)) {
+        probe_diag_count(DIAG_ORPHAN_RESPONSES, 1);
+        ESP_LOGD(TAG, "Response %02X%02X from %02X without live request. Ignored", frame->cid1, frame->cid2,
+                 frame->address);
         return;
     }
+    ESP_LOGD(TAG, "Pack %02X answered %02X%02X in %lld us", frame->address, request.cid1, request.cid2,
+             (long long) (frame->soi_us - request.eoi_us));
 
-    MQTTPayload msg;
-    if (!mqtt_format_info_payload(&status, &msg)) {
-        ESP_LOGW(TAG, "Format MQTT payload failed");
+    if (frame->cid2 != PYLON_RTN_NORMAL) {
+        probe_diag_count(DIAG_REJECTED_COMMANDS, 1);
+        ESP_LOGW(TAG, "Pack %02X on bus %u rejected command %02X%02X, RTN %02X", frame->address, frame->bus + 1,
+                 request.cid1, request.cid2, frame->cid2);
         return;
     }
 
-    if (wifi_online) {
-        if (!mqtt_publish_enqueue(&msg)) {
-            ESP_LOGW(TAG, "Failed to enqueue MQTT message");
+    const PylonCommandRoute *route = find_route(request.cid1, request.cid2, 0);
+    if (!route) {
+        probe_diag_count(DIAG_UNKNOWN_COMMANDS, 1);
+        ESP_LOGD(TAG, "Unsupported command %02X%02X. Ignored", request.cid1, request.cid2);
+        return;
+    }
+
+    for (; route; route = find_route(request.cid1, request.cid2, route - command_routes + 1)) {
+        MqttRecord *record = alloc_record();
+        if (!record) {
+            ESP_LOGW(TAG, "No free record for %s response, dropped", route->name);
+            continue;
         }
-    } else {
-        if (!mqtt_retry_enqueue_force(retry_queue, &msg)) {
-            ESP_LOGW(TAG, "Retry queue full, failed to force enqueue");
+        RouteResult result = route->decode(frame, record);
+        if (result == ROUTE_PUBLISH) {
+            publish_record(record);
+            continue;
+        }
+        if (result == ROUTE_FAILED) {
+            probe_diag_count(DIAG_FORMAT_FAILED, 1);
+            ESP_LOGW(TAG, "Decode %s response failed", route->name);
         }
+        record_pool_free(record);
     }
 }
 
+void packet_router_tick(int64_t now_us) {
+#ifdef CONFIG_PROBE_AGGREGATE_PUBLISH
+    flush_summaries(now_us);
+#endif
+#ifdef CONFIG_PROBE_BATCH_PUBLISH
+    flush_batches(now_us);
+#endif
+}
@@ -8,11 +8,61 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include "pylon_packet.h"
+#include "mqtt_record.h"
+#include "uart_listener.h"
+
+#define PACKET_ROUTER_MAX_PACKS (16 * PYLON_BUS_COUNT)
+#define PACKET_ROUTER_LATENCY_BUCKETS 8
+#define PACKET_ROUTER_LATENCY_BOUNDS_MS {10, 20, 50, 100, 200, 500, 1000}
+
+/**
+ * Upper bounds of the response latency histogram buckets in ms, the last bucket is open-ended
+ */
+extern const uint16_t packet_router_latency_bounds_ms[PACKET_ROUTER_LATENCY_BUCKETS - 1];
+
+/**
+ * Request/response correlation statistics for one address of a bus.
+ * Latency is measured from EOI of the master's request to SOI of the BMS response.
+ */
+typedef struct {
+    uint8_t bus;
+    uint8_t address;
+    uint32_t responses; // responses paired with a request
+    uint32_t unanswered; // requests replaced by a newer request before any response
+    uint32_t orphans; // responses without a live request, discarded
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;
+    uint32_t histogram[PACKET_ROUTER_LATENCY_BUCKETS];
+} PackLatencyStats;
 
 void packet_router_init(void);
 
-void my_packet_handler(const char *ascii_packet, size_t len);
+/**
+ * Copy the statistics of up to max_entries tracked addresses, returns the number copied
+ */
+size_t packet_router_latency_snapshot(PackLatencyStats *out, size_t max_entries);
+
+void my_packet_handler(const PylonFrameView *frame);
+
+/**
+ * Periodic work of the dispatch task (pylon_tick_callback_t): publishes what no
+ * later frame may come to close, such as the window of a pack that went silent
+ */
+void packet_router_tick(int64_t now_us);
 
 void packet_router_set_online(bool online);
 
+/**
+ * Keep a record the publisher could not send for the offline store, resent once
+ * MQTT has room again. Matches mqtt_record_handler_t and takes ownership of the record.
+ */
+void packet_router_defer(MqttRecord *record);
+
+/**
+ * MQTT connection state as last reported by packet_router_set_online
+ */
+bool packet_router_is_online(void);
+
 #endif
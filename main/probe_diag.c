@@ -0,0 +1,169 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "probe_diag.h"
+#include "packet_router.h"
+#include "mqtt_formatter.h"
+#include "mqtt_queue.h"
+#include "record_pool.h"
+#include "uart_listener.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+
+static const char *TAG = "probe_diag";
+
+static atomic_uint counters[DIAG_COUNTER_COUNT];
+static atomic_uint time_buckets[DIAG_TIMER_COUNT][PROBE_DIAG_TIME_BUCKETS];
+static atomic_uint time_max[DIAG_TIMER_COUNT];
+// indexed by bus and address, 1 KB per bus instead of a lookup table that needs a lock
+static atomic_uint address_frames[PYLON_BUS_COUNT][256];
+
+void probe_diag_count(ProbeDiagCounter counter, uint32_t n) {
+    atomic_fetch_add_explicit(&counters[counter], n, memory_order_relaxed);
+}
+
+static inline size_t time_bucket(uint32_t us) {
+    size_t bucket = us ? 32 - __builtin_clz(us) : 0;
+    return bucket < PROBE_DIAG_TIME_BUCKETS ? bucket : PROBE_DIAG_TIME_BUCKETS - 1;
+}
+
+void probe_diag_time(ProbeDiagTimer timer, uint32_t us) {
+    atomic_fetch_add_explicit(&time_buckets[timer][time_bucket(us)], 1, memory_order_relaxed);
+    unsigned max = atomic_load_explicit(&time_max[timer], memory_order_relaxed);
+    while (us > max &&
+           !atomic_compare_exchange_weak_explicit(&time_max[timer], &max, us, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+void probe_diag_frame(uint8_t bus, uint8_t address) {
+    atomic_fetch_add_explicit(&address_frames[bus][address], 1, memory_order_relaxed);
+}
+
+uint32_t probe_diag_get(ProbeDiagCounter counter) {
+    return atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
+
+/**
+ * Upper bound of the bucket holding the given percentile, never above the observed max
+ */
+static uint32_t time_percentile(const uint32_t *buckets, uint32_t count, uint32_t max_us, uint32_t percent) {
+    uint32_t rank = (uint32_t) (((uint64_t) count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (size_t i = 0; i < PROBE_DIAG_TIME_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint32_t bound = i ? (1u << i) - 1 : 0;
+            return bound < max_us ? bound : max_us;
+        }
+    }
+    return max_us;
+}
+
+void probe_diag_snapshot(ProbeDiagSnapshot *out) {
+    out->uptime_us = esp_timer_get_time();
+    for (size_t i = 0; i < DIAG_COUNTER_COUNT; i++) {
+        out->counters[i] = atomic_load_explicit(&counters[i], memory_order_relaxed);
+    }
+    for (size_t t = 0; t < DIAG_TIMER_COUNT; t++) {
+        uint32_t buckets[PROBE_DIAG_TIME_BUCKETS];
+        ProbeDiagTiming *timing = &out->timings[t];
+        timing->count = 0;
+        for (size_t i = 0; i < PROBE_DIAG_TIME_BUCKETS; i++) {
+            buckets[i] = atomic_load_explicit(&time_buckets[t][i], memory_order_relaxed);
+            timing->count += buckets[i];
+        }
+        timing->max_us = atomic_load_explicit(&time_max[t], memory_order_relaxed);
+        timing->p50_us = time_percentile(buckets, timing->count, timing->max_us, 50);
+        timing->p90_us = time_percentile(buckets, timing->count, timing->max_us, 90);
+        timing->p99_us = time_percentile(buckets, timing->count, timing->max_us, 99);
+    }
+}
+
+size_t probe_diag_addresses(ProbeDiagAddress *out, size_t max_entries) {
+    size_t n = 0;
+    for (size_t bus = 0; bus < PYLON_BUS_COUNT; bus++) {
+        for (size_t address = 0; address < 256 && n < max_entries; address++) {
+            uint32_t frames = atomic_load_explicit(&address_frames[bus][address], memory_order_relaxed);
+            if (frames) {
+                out[n].bus = (uint8_t) bus;
+                out[n].address = (uint8_t) address;
+                out[n].frames = frames;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+#if CONFIG_PROBE_DIAG_INTERVAL_S > 0
+static const PackLatencyStats *find_latency(const PackLatencyStats *stats, size_t count, const ProbeDiagAddress *a) {
+    for (size_t i = 0; i < count; i++) {
+        if (stats[i].bus == a->bus && stats[i].address == a->address) return &stats[i];
+    }
+    return NULL;
+}
+
+static void publish(const MQTTPayload *msg) {
+    if (mqtt_publish_now(msg)) {
+        probe_diag_count(DIAG_PUBLISHED, 1);
+    } else {
+        probe_diag_count(DIAG_PUBLISH_FAILED, 1);
+    }
+}
+
+static void probe_diag_task(void *param) {
+    static ProbeDiagSnapshot prev, now;
+    static ProbeDiagAddress addresses[PACKET_ROUTER_MAX_PACKS];
+    static PackLatencyStats latency[PACKET_ROUTER_MAX_PACKS];
+    static uint32_t prev_frames[PYLON_BUS_COUNT][256];
+    static MQTTPayload msg;
+
+    probe_diag_snapshot(&prev);
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_PROBE_DIAG_INTERVAL_S * 1000));
+        probe_diag_snapshot(&now);
+        // nothing is kept for later: a diagnostics report is only useful while fresh
+        bool online = packet_router_is_online();
+        if (online) {
+            if (mqtt_format_diag_payload(&now, &prev, &msg)) publish(&msg);
+            RecordPoolStats pool;
+            record_pool_stats(&pool);
+            if (mqtt_format_diag_router_payload(&now, &pool, &msg)) publish(&msg);
+            MqttPublishStats publisher;
+            mqtt_publish_stats(&publisher);
+            if (mqtt_format_diag_mqtt_payload(&now, &publisher, &msg)) publish(&msg);
+        }
+
+        size_t latency_count = packet_router_latency_snapshot(latency, PACKET_ROUTER_MAX_PACKS);
+        size_t address_count = probe_diag_addresses(addresses, PACKET_ROUTER_MAX_PACKS);
+        int64_t interval_us = now.uptime_us - prev.uptime_us;
+        for (size_t i = 0; i < address_count; i++) {
+            const ProbeDiagAddress *a = &addresses[i];
+            if (online && mqtt_format_diag_address_payload(a, prev_frames[a->bus][a->address], interval_us,
+                                                           find_latency(latency, latency_count, a), &msg)) {
+                publish(&msg);
+            }
+            prev_frames[a->bus][a->address] = a->frames;
+        }
+        ESP_LOGD(TAG, "rx %lu bytes, %lu frames, %lu dropped", (unsigned long) now.counters[DIAG_RX_BYTES],
+                 (unsigned long) now.counters[DIAG_RX_FRAMES], (unsigned long) now.counters[DIAG_RX_DROPPED]);
+        prev = now;
+    }
+}
+#endif
+
+void probe_diag_start(void) {
+#if CONFIG_PROBE_DIAG_INTERVAL_S > 0
+    ESP_LOGI(TAG, "Publishing diagnostics every %d s", CONFIG_PROBE_DIAG_INTERVAL_S);
+    xTaskCreatePinnedToCore(probe_diag_task, "probe_diag", 4096, NULL, 3, NULL, 1);
+#else
+    ESP_LOGI(TAG, "Diagnostics reports disabled");
+#endif
+}
@@ -0,0 +1,113 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef PROBE_DIAG_H
+#define PROBE_DIAG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Receive and publish health counters of the probe.
+ *
+ * Counters and timing histograms are lock-free and may be updated from any
+ * task. Snapshots of them are published periodically under <prefix>/<device>/diag.
+ */
+
+// Frame receiver counters, published on .../diag. X(id, json_key)
+#define PROBE_DIAG_RX_COUNTERS(X) \
+    X(DIAG_RX_BYTES, "rx_bytes") \
+    X(DIAG_RX_FRAMES, "rx_frames") \
+    X(DIAG_ERR_BAD_CHAR, "err_bad_char") \
+    X(DIAG_ERR_LENGTH_CHECKSUM, "err_length_checksum") \
+    X(DIAG_ERR_LENGTH, "err_length") \
+    X(DIAG_ERR_CHECKSUM, "err_checksum") \
+    X(DIAG_ERR_NO_EOI, "err_no_eoi") \
+    X(DIAG_ERR_RESYNC, "err_resync") \
+    X(DIAG_ERR_LINE, "err_line") \
+    X(DIAG_RX_OVERRUNS, "rx_overruns") \
+    X(DIAG_RX_DROPPED, "rx_dropped")
+
+// Routing counters, published on .../diag/router. X(id, json_key)
+#define PROBE_DIAG_ROUTER_COUNTERS(X) \
+    X(DIAG_ORPHAN_RESPONSES, "orphan_responses") \
+    X(DIAG_REJECTED_COMMANDS, "rejected_commands") \
+    X(DIAG_UNKNOWN_COMMANDS, "unknown_commands") \
+    X(DIAG_FORMAT_FAILED, "format_failed") \
+    X(DIAG_POOL_EXHAUSTED, "pool_exhausted")
+
+// Publishing and offline store counters, published on .../diag/mqtt. X(id, json_key)
+#define PROBE_DIAG_MQTT_COUNTERS(X) \
+    X(DIAG_PUBLISHED, "published") \
+    X(DIAG_PUBLISH_FAILED, "publish_failed") \
+    X(DIAG_PUBLISH_DEFERRED, "deferred") \
+    X(DIAG_ACKED, "acked") \
+    X(DIAG_OUTBOX_EXPIRED, "outbox_expired") \
+    X(DIAG_STORED, "stored") \
+    X(DIAG_DEFERRED_DROPPED, "deferred_dropped")
+
+#define PROBE_DIAG_COUNTERS(X) PROBE_DIAG_RX_COUNTERS(X) PROBE_DIAG_ROUTER_COUNTERS(X) PROBE_DIAG_MQTT_COUNTERS(X)
+
+#define PROBE_DIAG_COUNTER_ID(id, key) id,
+
+typedef enum {
+    PROBE_DIAG_COUNTERS(PROBE_DIAG_COUNTER_ID)
+    DIAG_COUNTER_COUNT
+} ProbeDiagCounter;
+
+typedef enum {
+    DIAG_TIME_RX_CHUNK, // framing of one chunk read from the UART driver
+    DIAG_TIME_DISPATCH, // packet callback of one frame
+    DIAG_TIMER_COUNT
+} ProbeDiagTimer;
+
+// Bucket i counts durations in [2^(i-1), 2^i) us, bucket 0 is below 1 us
+#define PROBE_DIAG_TIME_BUCKETS 24
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t p50_us; // upper bound of the bucket holding the percentile
+    uint32_t p90_us;
+    uint32_t p99_us;
+} ProbeDiagTiming;
+
+typedef struct {
+    uint8_t bus;
+    uint8_t address;
+    uint32_t frames; // valid frames from this address since boot
+} ProbeDiagAddress;
+
+typedef struct {
+    int64_t uptime_us;
+    uint32_t counters[DIAG_COUNTER_COUNT];
+    ProbeDiagTiming timings[DIAG_TIMER_COUNT];
+} ProbeDiagSnapshot;
+
+void probe_diag_count(ProbeDiagCounter counter, uint32_t n);
+
+void probe_diag_time(ProbeDiagTimer timer, uint32_t us);
+
+/**
+ * Count a valid frame received from address on bus
+ */
+void probe_diag_frame(uint8_t bus, uint8_t address);
+
+uint32_t probe_diag_get(ProbeDiagCounter counter);
+
+void probe_diag_snapshot(ProbeDiagSnapshot *out);
+
+/**
+ * Frame counters of up to max_entries addresses seen on the buses, in bus order, returns the number copied
+ */
+size_t probe_diag_addresses(ProbeDiagAddress *out, size_t max_entries);
+
+/**
+ * Start periodic publishing, every CONFIG_PROBE_DIAG_INTERVAL_S seconds
+ */
+void probe_diag_start(void);
+
+#endif // PROBE_DIAG_H
@@ -5,41 +5,109 @@
  */
 #include "pylon_packet.h"
 #include "esp_log.h"
+#include "hot_log.h"
 #include <string.h>
+#include <stdlib.h>
 #include <ctype.h>
 
 static const char *TAG = "pylon_packet";
 
-static inline uint8_t hex_char_to_nibble(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    return 0xFF;
+#define XX PYLON_HEX_INVALID
+const uint8_t pylon_hex_lut[256] = {
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, XX, XX, XX, XX, XX, XX,
+        XX, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+        XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+#undef XX
+
+static inline uint8_t hex_to_uint8(const char *c, uint8_t *invalid) {
+    uint8_t hi = pylon_hex_nibble(c[0]);
+    uint8_t lo = pylon_hex_nibble(c[1]);
+    *invalid |= hi | lo;
+    return (uint8_t) (hi << 4 | lo);
 }
 
-static inline uint8_t hex_to_uint8(const char *c) {
-    return hex_char_to_nibble(*c) << 4 | hex_char_to_nibble(*(c + 1));
+static inline uint16_t ascii_hex4_to_u16(const char *p, uint8_t *invalid) {
+    uint8_t n0 = pylon_hex_nibble(p[0]);
+    uint8_t n1 = pylon_hex_nibble(p[1]);
+    uint8_t n2 = pylon_hex_nibble(p[2]);
+    uint8_t n3 = pylon_hex_nibble(p[3]);
+    *invalid |= n0 | n1 | n2 | n3;
+    return (uint16_t) (n0 << 12 | n1 << 8 | n2 << 4 | n3);
 }
 
-static uint8_t copy_ascii_to_hex(const char *in, char *out, size_t ascii_len) {
-    size_t hex_len = ascii_len / 2;
-    for (size_t i = 0; i < hex_len; i++) {
-        out[i] = hex_to_uint8(&in[i * 2]);
-    }
-    return hex_len;
-}
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PYLON_HEX_SWAR 1
 
-static inline uint16_t ascii_hex2_to_u16(const char *p) {
-    return (hex_char_to_nibble(p[0]) << 4) | hex_char_to_nibble(p[1]);
-}
+// Native register width: 4 chars -> 2 bytes on the ESP32, 8 chars -> 4 bytes on 64-bit hosts
+#if UINTPTR_MAX > 0xFFFFFFFFu
+typedef uint64_t hex_word_t;
+#else
+typedef uint32_t hex_word_t;
+#endif
+
+#define HEX_LANES(b) ((hex_word_t) ~(hex_word_t) 0 / 0xFF * (uint8_t) (b))
+#define HEX_LANES16(w) ((hex_word_t) ~(hex_word_t) 0 / 0xFFFF * (uint16_t) (w))
 
-static inline uint16_t ascii_hex3_to_u16(const char *p) {
-    return (hex_char_to_nibble(p[0]) << 8) | (hex_char_to_nibble(p[1]) << 4) | hex_char_to_nibble(p[2]);
+/**
+ * Decode sizeof(hex_word_t) ASCII hex characters at once.
+ * Every byte lane is range-checked without branches; returns non-zero if any
+ * lane is not [0-9A-Fa-f].
+ */
+static inline hex_word_t hex_decode_word(const char *in, uint8_t *out) {
+    hex_word_t w;
+    memcpy(&w, in, sizeof(w));
+
+    const hex_word_t high = HEX_LANES(0x80);
+    hex_word_t x = w & ~high;
+    // bit 7 of each lane: x >= lo for "+ (0x80 - lo)", x > hi for "+ (0x7F - hi)"
+    hex_word_t digit = (x + HEX_LANES(0x80 - '0')) & ~(x + HEX_LANES(0x7F - '9')) & high;
+    hex_word_t lower = x | HEX_LANES(0x20);
+    hex_word_t alpha = (lower + HEX_LANES(0x80 - 'a')) & ~(lower + HEX_LANES(0x7F - 'f')) & high;
+    hex_word_t invalid = (~(digit | alpha) & high) | (w & high);
+
+    hex_word_t nib = (x & HEX_LANES(0x0F)) + (alpha >> 7) * 9;
+    // pair lanes: low byte of every 16-bit lane becomes (first << 4) | second
+    hex_word_t v = ((nib & HEX_LANES16(0x000F)) << 4) | ((nib >> 8) & HEX_LANES16(0x000F));
+    v = v | (v >> 8);
+#if UINTPTR_MAX > 0xFFFFFFFFu
+    v &= 0x0000FFFF0000FFFFull;
+    v = (v | (v >> 16)) & 0xFFFFFFFFull;
+#else
+    v &= 0xFFFFu;
+#endif
+    memcpy(out, &v, sizeof(w) / 2);
+    return invalid;
 }
+#endif
 
-static inline uint16_t ascii_hex4_to_u16(const char *p) {
-    return (hex_char_to_nibble(p[0]) << 12) | (hex_char_to_nibble(p[1]) << 8) |
-           (hex_char_to_nibble(p[2]) << 4) | hex_char_to_nibble(p[3]);
+size_t pylon_hex_to_bin(const char *ascii, size_t ascii_len, uint8_t *out, uint8_t *invalid) {
+    size_t hex_len = ascii_len / 2;
+    size_t i = 0;
+#ifdef PYLON_HEX_SWAR
+    hex_word_t bad = 0;
+    for (; i + sizeof(hex_word_t) / 2 <= hex_len; i += sizeof(hex_word_t) / 2) {
+        bad |= hex_decode_word(&ascii[i * 2], &out[i]);
+    }
+    if (bad) *invalid |= PYLON_HEX_INVALID;
+#endif
+    for (; i < hex_len; i++) {
+        out[i] = hex_to_uint8(&ascii[i * 2], invalid);
+    }
+    return hex_len;
 }
 
 uint16_t pylon_parse_length_field(const char *ptr) {
@@ -48,16 +116,21 @@ uint16_t pylon_parse_length_field(const char *ptr) {
         return 0xFFFF; // недопустимый указатель
     }
 
-    uint8_t len_chksum = hex_char_to_nibble(ptr[0]);
-    uint8_t byte1 = hex_char_to_nibble(ptr[1]);
-    uint8_t byte2 = hex_char_to_nibble(ptr[2]);
-    uint8_t byte3 = hex_char_to_nibble(ptr[3]);
+    uint8_t len_chksum = pylon_hex_nibble(ptr[0]);
+    uint8_t byte1 = pylon_hex_nibble(ptr[1]);
+    uint8_t byte2 = pylon_hex_nibble(ptr[2]);
+    uint8_t byte3 = pylon_hex_nibble(ptr[3]);
+
+    if ((len_chksum | byte1 | byte2 | byte3) & 0xF0) {
+        ESP_LOGI(TAG, "Non-hex character in length field");
+        return 0xFFFF;
+    }
 
-    ESP_LOGD(TAG, "bytes for length field: %02X (check) - %02X %02X %02X", len_chksum, byte1, byte2, byte3);
+    HOT_LOG(HOT_LOG_LENGTH_FIELD, len_chksum, byte1, byte2, byte3);
 
     uint16_t len_id = byte1 << 8 | byte2 << 4 | byte3;
 
-    uint8_t computed_chk = (~((byte1 + byte2 + byte3) % 16) & 0x0F) + 1;
+    uint8_t computed_chk = pylon_length_checksum(len_id);
 
     if (computed_chk != len_chksum) {
         ESP_LOGI(TAG, "Checksum error for length %04X: expected %02X, got %02X", len_id, computed_chk, len_chksum);
@@ -78,82 +151,114 @@ uint16_t compute_checksum_ascii(const char *ascii, size_t len_ascii_without_soi_
     return checksum;
 }
 
-bool pylon_decode_ascii_hex(const char *input, size_t len_ascii, PylonPacketRaw *out) {
-    if (!input || !out) {
-        ESP_LOGE(TAG, "Invalid input or output pointer");
-        return false;
-    }
-
-    if (input[0] != 0x7e || input[len_ascii - 1] != 0x0d) {
+/**
+ * Validate an ASCII frame and convert its INFO into info_out.
+ * info_out may point at input itself: INFO is converted last, after the
+ * header and checksum have been read, and binary output never overtakes
+ * the ASCII it is read from.
+ */
+static bool decode_ascii_frame(const char *input, size_t len_ascii, uint8_t *info_out, size_t info_capacity,
+                               PylonFrameView *view) {
+    if (len_ascii < PYLON_FRAME_OVERHEAD_ASCII || input[0] != PYLON_SOI || input[len_ascii - 1] != PYLON_EOI) {
         ESP_LOGE(TAG, "Invalid packet start or end");
         return false;
     }
 
     uint16_t index = 1; // skip SOI
+    uint8_t invalid = 0;
 
-    out->version = hex_to_uint8(&input[index]);
+    view->version = hex_to_uint8(&input[index], &invalid);
     index += 2;
-    out->address = hex_to_uint8(&input[index]);
+    view->address = hex_to_uint8(&input[index], &invalid);
     index += 2;
-    out->cid1 = hex_to_uint8(&input[index]);
+    view->cid1 = hex_to_uint8(&input[index], &invalid);
     index += 2;
-    out->cid2 = hex_to_uint8(&input[index]);
+    view->cid2 = hex_to_uint8(&input[index], &invalid);
     index += 2;
-    if (out->cid1 != 0x46 || out->cid2 != 0x00) {
-        ESP_LOGW(TAG, "Unknown CID: %02X%02X", out->cid1, out->cid2);
-        return false;
-    }
-    ESP_LOG_BUFFER_HEXDUMP(TAG, input, len_ascii, ESP_LOG_DEBUG);
+    HOT_LOG(HOT_LOG_FRAME_HEADER, view->cid1, view->cid2, view->address, len_ascii);
+    HOT_LOG_HEXDUMP(ESP_LOG_VERBOSE, TAG, input, len_ascii);
     uint16_t length_to_copy = pylon_parse_length_field(&input[index]);
     index += 4;
     if (length_to_copy == 0xFFFF) {
-        out->valid = false;
         ESP_LOGE(TAG, "Invalid length field. ");
         return false; // ошибка длины
     }
 
-    if (length_to_copy > PYLON_MAX_DATA_BYTES - index - 3) {
-        ESP_LOGE(TAG, "Length exceeds maximum data size");
-        out->valid = false;
-        return false; // длина превышает максимальный размер данных
+    // INFO is whatever lies between LENID and CHKSUM, so LENID must match the frame exactly
+    if (length_to_copy != len_ascii - PYLON_FRAME_OVERHEAD_ASCII || (length_to_copy & 1) ||
+        length_to_copy / 2 > info_capacity) {
+        ESP_LOGE(TAG, "Length field %u does not match a frame of %u characters", length_to_copy,
+                 (unsigned) len_ascii);
+        return false;
     }
 
-    out->data_length = copy_ascii_to_hex(&input[index], (char *) out->data, length_to_copy);
-    index += length_to_copy;
-    ESP_LOGD(TAG, "Copied %d bytes, index is %zu", out->data_length, index);
-
     uint16_t checksum = compute_checksum_ascii(&input[1], len_ascii - 6); // - SOI - EOI - checksum
-
-    out->checksum = ascii_hex4_to_u16(&input[index]);
-    out->valid = (out->checksum == checksum);
-    ESP_LOGI(TAG, "Checksum: %04X, computed: %04X", out->checksum, checksum);
-    if (!out->valid) {
+    view->checksum = ascii_hex4_to_u16(&input[index + length_to_copy], &invalid);
+    HOT_LOG(HOT_LOG_FRAME_CHECKSUM, view->checksum, checksum);
+    if (view->checksum != checksum) {
         ESP_LOGE(TAG, "Checksum error");
+        return false; // a damaged frame is not worth converting
+    }
+
+    view->info_length = pylon_hex_to_bin(&input[index], length_to_copy, info_out, &invalid);
+    view->info = info_out;
+    HOT_LOG(HOT_LOG_FRAME_COPIED, view->info_length, index + length_to_copy);
+
+    if (invalid & 0xF0) {
+        ESP_LOGE(TAG, "Non-hex character in frame");
+        return false;
+    }
+
+    return true;
+}
+
+bool pylon_decode_ascii_hex(const char *input, size_t len_ascii, PylonPacketRaw *out) {
+    if (!input || !out) {
+        ESP_LOGE(TAG, "Invalid input or output pointer");
         return false;
     }
 
+    PylonFrameView view = {0};
+    out->valid = decode_ascii_frame(input, len_ascii, out->data, sizeof(out->data), &view);
+    out->version = view.version;
+    out->address = view.address;
+    out->cid1 = view.cid1;
+    out->cid2 = view.cid2;
+    out->data_length = out->valid ? view.info_length : 0;
+    out->checksum = view.checksum;
     return out->valid;
 }
 
-bool pylon_parse_info_payload(const uint8_t *info, size_t len, PylonBatteryStatus *out) {
-    if (!info || !out) {
+bool pylon_decode_ascii_hex_inplace(char *buffer, size_t len_ascii, PylonFrameView *view) {
+    if (!buffer || !view) {
+        ESP_LOGE(TAG, "Invalid input or output pointer");
+        return false;
+    }
+
+    return decode_ascii_frame(buffer, len_ascii, (uint8_t *) buffer, len_ascii / 2, view);
+}
+
+bool pylon_parse_info_payload(const PylonFrameView *frame, PylonBatteryStatus *out) {
+    if (!frame || !frame->info || !out) {
         ESP_LOGE("pylon_flat", "Null pointer");
         return false;
     }
 
-    ESP_LOG_BUFFER_HEXDUMP(TAG, info, len, ESP_LOG_DEBUG);
+    const uint8_t *info = frame->info;
+    size_t len = frame->info_length;
+
+    HOT_LOG_HEXDUMP(ESP_LOG_VERBOSE, TAG, info, len);
 
     size_t index = 0;
 
     if (index + 2 > len) return false;
     out->modules = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Module ID: %u", out->modules);
 
     if (index + 1 > len) return false;
     out->cell_count = pylon_read_u8(&info[index]);
     index += 1;
-    ESP_LOGI(TAG, "Cells: %u", out->cell_count);
+    HOT_LOG(HOT_LOG_INFO_HEADER, out->modules, out->cell_count);
 
     if (out->cell_count > PYLON_MAX_CELLS) {
         ESP_LOGE("pylon_flat", "Cell count too large: %u", out->cell_count);
@@ -164,7 +269,7 @@ bool pylon_parse_info_payload(const uint8_t *info, size_t len, PylonBatteryStatu
         if (index + 2 > len) return false;
         out->cell_voltage_mV[i] = pylon_read_u16(&info[index]);
         index += 2;
-        ESP_LOGI(TAG, "Cell %d: %u mV", i, out->cell_voltage_mV[i]);
+        HOT_LOG(HOT_LOG_INFO_CELL, i, out->cell_voltage_mV[i]);
     }
 
     if (index + 1 > len) return false;
@@ -180,87 +285,213 @@ bool pylon_parse_info_payload(const uint8_t *info, size_t len, PylonBatteryStatu
         if (index + 2 > len) return false;
         out->temperatures_c[i] = pylon_read_s16(&info[index]);
         index += 2;
-        ESP_LOGI(TAG, "Temperature %d: %d.%02d C", i, out->temperatures_c[i]/100, abs(out->temperatures_c[i] % 100));
+        HOT_LOG(HOT_LOG_INFO_TEMPERATURE, i, out->temperatures_c[i] / 100, abs(out->temperatures_c[i] % 100));
     }
 
     if (index + 2 > len) return false;
     out->current_mA = pylon_read_s16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Current: %d mA", out->current_mA);
-    if (out->current_mA > 0) {
-        ESP_LOGI(TAG, "State: Charging");
-    } else if (out->current_mA < 0) {
-        ESP_LOGI(TAG, "State: Discharging");
-    } else {
-        ESP_LOGI(TAG, "State: Idle");
-    }
 
     if (index + 2 > len) return false;
     out->total_voltage_mV = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Total voltage: %d.%02d mV", out->total_voltage_mV/1000, abs(out->total_voltage_mV % 1000));
 
     if (index + 2 > len) return false;
     out->remaining_capacity_ah = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Remaining capacity: %d.%02d Ah", out->remaining_capacity_ah/100,
-             abs(out->remaining_capacity_ah % 100));
 
     if (index + 1 > len) return false;
     out->user_defined_number = pylon_read_u8(&info[index]);
     index += 1;
-    ESP_LOGI(TAG, "User defined number: %u", out->user_defined_number);
+    if (out->current_mA > 0) {
+        HOT_LOG(HOT_LOG_INFO_CURRENT_CHARGING, out->current_mA, out->total_voltage_mV, out->user_defined_number);
+    } else if (out->current_mA < 0) {
+        HOT_LOG(HOT_LOG_INFO_CURRENT_DISCHARGING, out->current_mA, out->total_voltage_mV, out->user_defined_number);
+    } else {
+        HOT_LOG(HOT_LOG_INFO_CURRENT_IDLE, out->current_mA, out->total_voltage_mV, out->user_defined_number);
+    }
 
     if (index + 2 > len) return false;
     out->total_capacity_ah = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Total capacity: %d.%02d Ah", out->total_capacity_ah / 100, abs(out->total_capacity_ah % 100));
+    HOT_LOG(HOT_LOG_INFO_CAPACITY, out->remaining_capacity_ah / 100, out->remaining_capacity_ah % 100,
+            out->total_capacity_ah / 100, out->total_capacity_ah % 100);
 
     if (index + 2 > len) return false;
     out->cycle_count = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Cycle count: %u", out->cycle_count);
+    HOT_LOG(HOT_LOG_INFO_CYCLES, out->cycle_count);
 
     if (index + 2 > len) return false;
     out->batteryCapacity = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Battery capacity: %d.%02d Ah", out->batteryCapacity / 100, abs(out->batteryCapacity % 100));
 
     if (index + 2 > len) return false;
     out->currentCapacity = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Current capacity: %d.%02d Ah", out->currentCapacity / 100, abs(out->currentCapacity % 100));
+    HOT_LOG(HOT_LOG_INFO_BATTERY_CAPACITY, out->batteryCapacity / 100, out->batteryCapacity % 100,
+            out->currentCapacity / 100, out->currentCapacity % 100);
 
     if (index + 2 > len) return false;
     out->userVoltage0 = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "User voltage 0: %d.%02d mV", out->userVoltage0/ 1000, abs(out->userVoltage0 % 1000));
 
     if (index + 2 > len) return false;
     out->userVoltage1 = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "User voltage 1: %d.%02d mV", out->userVoltage1/ 1000, abs(out->userVoltage1 % 1000));
 
     if (index + 2 > len) return false;
     out->userVoltage2 = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "User voltage 2: %d.%02d mV", out->userVoltage2/ 1000, abs(out->userVoltage2 % 1000));
 
     if (index + 2 > len) return false;
     out->userVoltage3 = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "User voltage 3: %d.%02d mV", out->userVoltage3/ 1000, abs(out->userVoltage3 % 1000));
 
     if (index + 2 > len) return false;
     out->userVoltage4 = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "User voltage 4: %d.%02d mV", out->userVoltage4/ 1000, abs(out->userVoltage4 % 1000));
+    HOT_LOG(HOT_LOG_INFO_USER_VOLTAGE, out->userVoltage0, out->userVoltage1, out->userVoltage2, out->userVoltage3);
 
     if (index + 2 > len) return false;
     out->unknown = pylon_read_u16(&info[index]);
     index += 2;
-    ESP_LOGI(TAG, "Unknown: %u", out->unknown);
+    HOT_LOG(HOT_LOG_INFO_TAIL, out->userVoltage4, out->unknown);
+
+    return true;
+}
+
+bool pylon_parse_alarm_payload(const PylonFrameView *frame, PylonAlarmInfo *out) {
+    if (!frame || !frame->info || !out) {
+        ESP_LOGE(TAG, "Null pointer");
+        return false;
+    }
+
+    const uint8_t *info = frame->info;
+    size_t len = frame->info_length;
+    size_t index = 1; // DATAFLAG
+
+    if (index + 2 > len) return false;
+    out->address = pylon_read_u8(&info[index++]);
+    out->cell_count = pylon_read_u8(&info[index++]);
+    if (out->cell_count > PYLON_MAX_CELLS || index + out->cell_count + 1 > len) {
+        ESP_LOGD(TAG, "Alarm: bad cell count %u", out->cell_count);
+        return false;
+    }
+    memcpy(out->cell_alarm, &info[index], out->cell_count);
+    index += out->cell_count;
+
+    out->temperature_count = pylon_read_u8(&info[index++]);
+    if (out->temperature_count > PYLON_MAX_TEMPS || index + out->temperature_count + 3 > len) {
+        ESP_LOGD(TAG, "Alarm: bad temperature count %u", out->temperature_count);
+        return false;
+    }
+    memcpy(out->temperature_alarm, &info[index], out->temperature_count);
+    index += out->temperature_count;
+
+    out->charge_current_alarm = pylon_read_u8(&info[index++]);
+    out->module_voltage_alarm = pylon_read_u8(&info[index++]);
+    out->discharge_current_alarm = pylon_read_u8(&info[index++]);
+
+    out->status_count = 0;
+    while (out->status_count < PYLON_ALARM_STATUS_BYTES && index < len) {
+        out->status[out->status_count++] = pylon_read_u8(&info[index++]);
+    }
+
+    ESP_LOGD(TAG, "Alarm: pack %02X, %u cells, %u temps, status1 %02X", out->address, out->cell_count,
+             out->temperature_count, out->status_count ? out->status[0] : 0);
+    return true;
+}
+
+bool pylon_parse_system_params(const PylonFrameView *frame, PylonSystemParams *out) {
+    if (!frame || !frame->info || !out) {
+        ESP_LOGE(TAG, "Null pointer");
+        return false;
+    }
+
+    const uint8_t *info = frame->info;
+    if (frame->info_length < 1 + 12 * 2) return false;
+    size_t index = 1; // INFOFLAG
+
+    out->cell_high_voltage_mV = pylon_read_u16(&info[index]);
+    index += 2;
+    out->cell_low_voltage_mV = pylon_read_u16(&info[index]);
+    index += 2;
+    out->cell_under_voltage_mV = pylon_read_u16(&info[index]);
+    index += 2;
+    out->charge_high_temperature = pylon_read_s16(&info[index]);
+    index += 2;
+    out->charge_low_temperature = pylon_read_s16(&info[index]);
+    index += 2;
+    out->charge_current_limit = pylon_read_s16(&info[index]);
+    index += 2;
+    out->module_high_voltage_mV = pylon_read_u16(&info[index]);
+    index += 2;
+    out->module_low_voltage_mV = pylon_read_u16(&info[index]);
+    index += 2;
+    out->module_under_voltage_mV = pylon_read_u16(&info[index]);
+    index += 2;
+    out->discharge_high_temperature = pylon_read_s16(&info[index]);
+    index += 2;
+    out->discharge_low_temperature = pylon_read_s16(&info[index]);
+    index += 2;
+    out->discharge_current_limit = pylon_read_s16(&info[index]);
 
+    ESP_LOGD(TAG, "System params: cell %u..%u mV, module %u..%u mV", out->cell_low_voltage_mV,
+             out->cell_high_voltage_mV, out->module_low_voltage_mV, out->module_high_voltage_mV);
     return true;
 }
 
+/**
+ * Copy a fixed-width protocol text field, keeping printable ASCII only
+ */
+static void copy_text_field(char *dst, const uint8_t *src, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] >= 0x20 && src[i] < 0x7F && src[i] != '"' && src[i] != '\\') {
+            dst[n++] = (char) src[i];
+        }
+    }
+    while (n > 0 && dst[n - 1] == ' ') n--;
+    dst[n] = '\0';
+}
+
+bool pylon_parse_manufacturer_info(const PylonFrameView *frame, PylonManufacturerInfo *out) {
+    if (!frame || !frame->info || !out) {
+        ESP_LOGE(TAG, "Null pointer");
+        return false;
+    }
+
+    const uint8_t *info = frame->info;
+    if (frame->info_length < PYLON_BATTERY_NAME_LEN + 2 + PYLON_MANUFACTURER_NAME_LEN) return false;
+
+    copy_text_field(out->battery_name, info, PYLON_BATTERY_NAME_LEN);
+    out->software_version[0] = info[PYLON_BATTERY_NAME_LEN];
+    out->software_version[1] = info[PYLON_BATTERY_NAME_LEN + 1];
+    copy_text_field(out->manufacturer, &info[PYLON_BATTERY_NAME_LEN + 2], PYLON_MANUFACTURER_NAME_LEN);
+
+    ESP_LOGD(TAG, "Manufacturer: %s, battery %s v%u.%u", out->manufacturer, out->battery_name,
+             out->software_version[0], out->software_version[1]);
+    return true;
+}
+
+bool pylon_parse_charge_management(const PylonFrameView *frame, PylonChargeManagement *out) {
+    if (!frame || !frame->info || !out) {
+        ESP_LOGE(TAG, "Null pointer");
+        return false;
+    }
+
+    const uint8_t *info = frame->info;
+    if (frame->info_length < 10) return false;
+
+    out->address = pylon_read_u8(&info[0]);
+    out->charge_voltage_limit_mV = pylon_read_u16(&info[1]);
+    out->discharge_voltage_limit_mV = pylon_read_u16(&info[3]);
+    out->charge_current_limit = pylon_read_s16(&info[5]);
+    out->discharge_current_limit = pylon_read_s16(&info[7]);
+    out->status = pylon_read_u8(&info[9]);
+
+    ESP_LOGD(TAG, "Charge management: %u..%u mV, status %02X", out->discharge_voltage_limit_mV,
+             out->charge_voltage_limit_mV, out->status);
+    return true;
+}
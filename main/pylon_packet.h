@@ -14,6 +14,29 @@
 #define PYLON_MAX_CELLS 32
 #define PYLON_MAX_TEMPS 8
 
+#define PYLON_SOI 0x7E
+#define PYLON_EOI 0x0D
+// SOI, VER ADR CID1 CID2 LENID, CHKSUM and EOI around the INFO characters
+#define PYLON_FRAME_OVERHEAD_ASCII 18
+
+#define PYLON_CID1_BATTERY 0x46
+
+// CID2 command codes sent by the master
+#define PYLON_CID2_ANALOG 0x42
+#define PYLON_CID2_ALARM 0x44
+#define PYLON_CID2_SYSTEM_PARAMS 0x47
+#define PYLON_CID2_PROTOCOL_VERSION 0x4F
+#define PYLON_CID2_MANUFACTURER 0x51
+#define PYLON_CID2_CHARGE_MANAGEMENT 0x92
+
+// CID2 return codes (RTN) sent back by the BMS
+#define PYLON_RTN_NORMAL 0x00
+#define PYLON_RTN_LAST_ERROR 0x06
+
+#define PYLON_ALARM_STATUS_BYTES 5
+#define PYLON_BATTERY_NAME_LEN 10
+#define PYLON_MANUFACTURER_NAME_LEN 20
+
 #define PYLON_CHECK(expr, message, ...) \
     do { \
         if (!(expr)) { \
@@ -33,6 +56,23 @@ typedef struct {
     bool valid; // флаг валидности после разбора
 } PylonPacketRaw;
 
+/**
+ * Decoded frame whose INFO lives in a buffer owned by someone else
+ * (an RX buffer, an in-place decoded ASCII line). Valid as long as that buffer is.
+ */
+typedef struct {
+    uint8_t version;
+    uint8_t address;
+    uint8_t cid1;
+    uint8_t cid2;
+    uint16_t checksum;
+    uint16_t info_length; // INFO length in bytes
+    const uint8_t *info;
+    int64_t soi_us; // receive time of SOI, 0 if unknown
+    int64_t eoi_us; // receive time of EOI, 0 if unknown
+    uint8_t bus; // receiving bus, 0 for the first
+} PylonFrameView;
+
 typedef struct {
     uint16_t modules; // количество параллельных батарей (модулей)
     uint8_t cell_count; // количество ячеек
@@ -61,9 +101,160 @@ typedef struct {
     uint16_t unknown;
 } PylonBatteryStatus;
 
+/*
+ * Field schema of PylonBatteryStatus in publishing order.
+ * SCALAR(type, field) - single value, type is the storage type: u8, u16 or i16
+ * ARRAY(type, field, count_field) - first count_field elements of field
+ */
+#define PYLON_STATUS_FIELDS(SCALAR, ARRAY) \
+    SCALAR(u16, modules) \
+    SCALAR(u8, cell_count) \
+    SCALAR(u8, temperature_count) \
+    ARRAY(u16, cell_voltage_mV, cell_count) \
+    ARRAY(i16, temperatures_c, temperature_count) \
+    SCALAR(i16, current_mA) \
+    SCALAR(u16, total_voltage_mV) \
+    SCALAR(u16, remaining_capacity_ah) \
+    SCALAR(u8, user_defined_number) \
+    SCALAR(u16, total_capacity_ah) \
+    SCALAR(u16, cycle_count) \
+    SCALAR(u16, batteryCapacity) \
+    SCALAR(u16, currentCapacity) \
+    SCALAR(u16, userVoltage0) \
+    SCALAR(u16, userVoltage1) \
+    SCALAR(u16, userVoltage2) \
+    SCALAR(u16, userVoltage3) \
+    SCALAR(u16, userVoltage4) \
+    SCALAR(u16, unknown)
+
+#define PYLON_STATUS_SCALAR_ID(type, field) PYLON_STATUS_FIELD_##field,
+#define PYLON_STATUS_ARRAY_ID(type, field, count_field) PYLON_STATUS_FIELD_##field,
+
+/**
+ * Index of every schema field, (1u << index) selects the field in a field mask
+ */
+typedef enum {
+    PYLON_STATUS_FIELDS(PYLON_STATUS_SCALAR_ID, PYLON_STATUS_ARRAY_ID)
+    PYLON_STATUS_FIELD_COUNT
+} PylonStatusField;
+
+#define PYLON_HEX_INVALID 0xFF
+
+/**
+ * ASCII character -> nibble value, PYLON_HEX_INVALID for non-hex characters
+ */
+extern const uint8_t pylon_hex_lut[256];
+
+/**
+ * Convert one ASCII hex character to its value, PYLON_HEX_INVALID for anything else.
+ * OR-ing results together and testing the high nibble detects any bad character.
+ */
+static inline uint8_t pylon_hex_nibble(char c) {
+    return pylon_hex_lut[(uint8_t) c];
+}
+
+/**
+ * Convert ascii_len hex characters into ascii_len / 2 bytes.
+ * Bad characters are OR-ed into *invalid (non-zero high nibble), so a whole
+ * frame can be checked once at the end. out may alias ascii (in-place decode).
+ */
+size_t pylon_hex_to_bin(const char *ascii, size_t ascii_len, uint8_t *out, uint8_t *invalid);
+
+/**
+ * LCHKSUM nibble of the LENID field for a 12-bit LENGTH value
+ */
+static inline uint8_t pylon_length_checksum(uint16_t len_id) {
+    uint8_t sum = ((len_id >> 8) & 0x0F) + ((len_id >> 4) & 0x0F) + (len_id & 0x0F);
+    return (uint8_t) (~(sum % 16) + 1) & 0x0F;
+}
+
+uint16_t pylon_parse_length_field(const char *ptr);
+
+uint16_t compute_checksum_ascii(const char *ascii, size_t len_ascii_without_soi_eoi);
+
+typedef struct {
+    uint8_t address; // адрес модуля из INFO
+    uint8_t cell_count;
+    uint8_t cell_alarm[PYLON_MAX_CELLS]; // 0 - норма, 1 - ниже предела, 2 - выше предела
+    uint8_t temperature_count;
+    uint8_t temperature_alarm[PYLON_MAX_TEMPS];
+    uint8_t charge_current_alarm;
+    uint8_t module_voltage_alarm;
+    uint8_t discharge_current_alarm;
+    uint8_t status_count; // сколько байт статуса реально пришло
+    uint8_t status[PYLON_ALARM_STATUS_BYTES]; // status 1..5 (битовые поля)
+} PylonAlarmInfo;
+
+typedef struct {
+    uint16_t cell_high_voltage_mV;
+    uint16_t cell_low_voltage_mV;
+    uint16_t cell_under_voltage_mV;
+    int16_t charge_high_temperature; // в десятых Кельвина, как в протоколе
+    int16_t charge_low_temperature;
+    int16_t charge_current_limit; // в десятых ампера
+    uint16_t module_high_voltage_mV;
+    uint16_t module_low_voltage_mV;
+    uint16_t module_under_voltage_mV;
+    int16_t discharge_high_temperature;
+    int16_t discharge_low_temperature;
+    int16_t discharge_current_limit;
+} PylonSystemParams;
+
+typedef struct {
+    char battery_name[PYLON_BATTERY_NAME_LEN + 1];
+    uint8_t software_version[2];
+    char manufacturer[PYLON_MANUFACTURER_NAME_LEN + 1];
+} PylonManufacturerInfo;
+
+typedef struct {
+    uint8_t address;
+    uint16_t charge_voltage_limit_mV;
+    uint16_t discharge_voltage_limit_mV;
+    int16_t charge_current_limit; // в десятых ампера
+    int16_t discharge_current_limit;
+    uint8_t status; // bit7 charge enable, bit6 discharge enable, bit5/4 charge immediately, bit3 full charge request
+} PylonChargeManagement;
+
+/**
+ * True for frames sent by the master (CID2 is a command), false for BMS responses (CID2 is RTN)
+ */
+static inline bool pylon_is_request(uint8_t cid2) {
+    return cid2 > PYLON_RTN_LAST_ERROR;
+}
+
 bool pylon_decode_ascii_hex(const char *input, size_t len_ascii, PylonPacketRaw *out);
 
-bool pylon_parse_info_payload(const uint8_t *info, size_t len, PylonBatteryStatus *out);
+/**
+ * Decode an ASCII frame (SOI ... EOI) without copying: INFO is converted to
+ * binary at the start of buffer, overwriting the ASCII text, and view points at it.
+ */
+bool pylon_decode_ascii_hex_inplace(char *buffer, size_t len_ascii, PylonFrameView *view);
+
+/**
+ * View over a packet decoded into a PylonPacketRaw
+ */
+static inline PylonFrameView pylon_frame_view(const PylonPacketRaw *raw) {
+    PylonFrameView view = {
+        .version = raw->version,
+        .address = raw->address,
+        .cid1 = raw->cid1,
+        .cid2 = raw->cid2,
+        .checksum = raw->checksum,
+        .info_length = raw->data_length,
+        .info = raw->data,
+    };
+    return view;
+}
+
+bool pylon_parse_info_payload(const PylonFrameView *frame, PylonBatteryStatus *out);
+
+bool pylon_parse_alarm_payload(const PylonFrameView *frame, PylonAlarmInfo *out);
+
+bool pylon_parse_system_params(const PylonFrameView *frame, PylonSystemParams *out);
+
+bool pylon_parse_manufacturer_info(const PylonFrameView *frame, PylonManufacturerInfo *out);
+
+bool pylon_parse_charge_management(const PylonFrameView *frame, PylonChargeManagement *out);
 
 /**
  * Read 8-bit unsigned integer
@@ -0,0 +1,130 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "pylon_stream.h"
+#include <string.h>
+
+#define PYLON_HEADER_CHARS 8
+#define PYLON_LENID_CHARS 4
+#define PYLON_CHKSUM_CHARS 4
+
+static PylonStreamResult stream_fail(PylonStreamDecoder *dec, PylonStreamError error) {
+    dec->error = error;
+    dec->state = PYLON_STREAM_WAIT_SOI;
+    dec->out->valid = false;
+    return PYLON_STREAM_ERROR;
+}
+
+void pylon_stream_init(PylonStreamDecoder *dec) {
+    memset(dec, 0, sizeof(*dec));
+    dec->state = PYLON_STREAM_WAIT_SOI;
+}
+
+void pylon_stream_start(PylonStreamDecoder *dec, PylonPacketRaw *out) {
+    dec->state = PYLON_STREAM_HEADER;
+    dec->error = PYLON_STREAM_ERR_NONE;
+    dec->out = out;
+    dec->sum = 0;
+    dec->acc = 0;
+    dec->pos = 0;
+    dec->info_len = 0;
+    out->data_length = 0;
+    out->valid = false;
+}
+
+PylonStreamResult pylon_stream_feed(PylonStreamDecoder *dec, uint8_t byte) {
+    if (dec->state == PYLON_STREAM_WAIT_SOI) {
+        return PYLON_STREAM_PENDING;
+    }
+
+    PylonPacketRaw *out = dec->out;
+
+    if (byte == PYLON_SOI) {
+        pylon_stream_start(dec, out);
+        dec->error = PYLON_STREAM_ERR_RESYNC;
+        return PYLON_STREAM_ERROR;
+    }
+
+    if (dec->state == PYLON_STREAM_EOI) {
+        if (byte != PYLON_EOI) {
+            return stream_fail(dec, PYLON_STREAM_ERR_NO_EOI);
+        }
+        dec->state = PYLON_STREAM_WAIT_SOI;
+        out->valid = true;
+        return PYLON_STREAM_FRAME;
+    }
+
+    uint8_t nibble = pylon_hex_nibble((char) byte);
+    if (nibble > 0x0F) {
+        return stream_fail(dec, PYLON_STREAM_ERR_BAD_CHAR);
+    }
+
+    if (dec->state != PYLON_STREAM_CHKSUM) {
+        dec->sum += byte;
+    }
+    dec->acc = (uint16_t) (dec->acc << 4) | nibble;
+    dec->pos++;
+
+    switch (dec->state) {
+        case PYLON_STREAM_HEADER:
+            switch (dec->pos) {
+                case 2: out->version = (uint8_t) dec->acc;
+                    break;
+                case 4: out->address = (uint8_t) dec->acc;
+                    break;
+                case 6: out->cid1 = (uint8_t) dec->acc;
+                    break;
+                case PYLON_HEADER_CHARS:
+                    out->cid2 = (uint8_t) dec->acc;
+                    dec->state = PYLON_STREAM_LENID;
+                    dec->pos = 0;
+                    break;
+                default:
+                    break;
+            }
+            break;
+
+        case PYLON_STREAM_LENID:
+            if (dec->pos == PYLON_LENID_CHARS) {
+                uint16_t len_id = dec->acc & 0x0FFF;
+                if ((dec->acc >> 12) != pylon_length_checksum(len_id)) {
+                    return stream_fail(dec, PYLON_STREAM_ERR_LENGTH_CHECKSUM);
+                }
+                if ((len_id & 1) || len_id / 2 > PYLON_MAX_DATA_BYTES) {
+                    return stream_fail(dec, PYLON_STREAM_ERR_LENGTH);
+                }
+                dec->info_len = len_id;
+                dec->state = len_id ? PYLON_STREAM_INFO : PYLON_STREAM_CHKSUM;
+                dec->pos = 0;
+            }
+            break;
+
+        case PYLON_STREAM_INFO:
+            if ((dec->pos & 1) == 0) {
+                out->data[dec->pos / 2 - 1] = (uint8_t) dec->acc;
+            }
+            if (dec->pos == dec->info_len) {
+                out->data_length = dec->info_len / 2;
+                dec->state = PYLON_STREAM_CHKSUM;
+                dec->pos = 0;
+            }
+            break;
+
+        case PYLON_STREAM_CHKSUM:
+            if (dec->pos == PYLON_CHKSUM_CHARS) {
+                out->checksum = dec->acc;
+                if (out->checksum != (uint16_t) (~dec->sum + 1)) {
+                    return stream_fail(dec, PYLON_STREAM_ERR_CHECKSUM);
+                }
+                dec->state = PYLON_STREAM_EOI;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return PYLON_STREAM_PENDING;
+}
@@ -0,0 +1,78 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef PYLON_STREAM_H
+#define PYLON_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pylon_packet.h"
+
+/*
+ * Incremental Pylon frame decoder.
+ *
+ * Bytes are fed one at a time as they come off the bus. Hex pairs are turned
+ * into binary and the frame checksum is accumulated on the fly, so the frame
+ * is fully validated when EOI arrives and no ASCII copy of it is ever kept.
+ * The decoder does not log and is safe to call from an ISR.
+ */
+
+typedef enum {
+    PYLON_STREAM_WAIT_SOI,
+    PYLON_STREAM_HEADER, // VER, ADR, CID1, CID2
+    PYLON_STREAM_LENID,
+    PYLON_STREAM_INFO,
+    PYLON_STREAM_CHKSUM,
+    PYLON_STREAM_EOI
+} PylonStreamState;
+
+typedef enum {
+    PYLON_STREAM_PENDING, // byte consumed, frame not complete yet
+    PYLON_STREAM_FRAME, // valid frame decoded into the output packet
+    PYLON_STREAM_ERROR // frame dropped, see PylonStreamDecoder.error
+} PylonStreamResult;
+
+typedef enum {
+    PYLON_STREAM_ERR_NONE,
+    PYLON_STREAM_ERR_BAD_CHAR, // non-hex character inside the frame
+    PYLON_STREAM_ERR_LENGTH_CHECKSUM, // LCHKSUM does not match LENID
+    PYLON_STREAM_ERR_LENGTH, // odd or oversized LENID
+    PYLON_STREAM_ERR_CHECKSUM, // CHKSUM does not match the frame
+    PYLON_STREAM_ERR_NO_EOI, // CHKSUM not followed by EOI
+    PYLON_STREAM_ERR_RESYNC // SOI inside a frame, decoding restarted
+} PylonStreamError;
+
+typedef struct {
+    PylonStreamState state;
+    PylonStreamError error;
+    PylonPacketRaw *out;
+    uint16_t sum; // running sum of ASCII characters after SOI
+    uint16_t acc; // current field accumulator
+    uint16_t pos; // characters consumed in the current field
+    uint16_t info_len; // INFO length in ASCII characters (LENID)
+} PylonStreamDecoder;
+
+void pylon_stream_init(PylonStreamDecoder *dec);
+
+/**
+ * Start a new frame after SOI has been seen, decoding into out
+ */
+void pylon_stream_start(PylonStreamDecoder *dec, PylonPacketRaw *out);
+
+/**
+ * Feed the next byte after SOI.
+ *
+ * On PYLON_STREAM_FRAME the output packet is complete and valid and the
+ * decoder waits for the next SOI. On PYLON_STREAM_ERROR the frame is lost;
+ * the decoder either waits for SOI or, for PYLON_STREAM_ERR_RESYNC, has
+ * already restarted into the same output packet.
+ */
+PylonStreamResult pylon_stream_feed(PylonStreamDecoder *dec, uint8_t byte);
+
+static inline bool pylon_stream_idle(const PylonStreamDecoder *dec) {
+    return dec->state == PYLON_STREAM_WAIT_SOI;
+}
+
+#endif // PYLON_STREAM_H
@@ -0,0 +1,364 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "pylon_synth.h"
+#include <string.h>
+
+#define SYNTH_DEFAULT_ADDRESS 0x02
+#define SYNTH_CAPACITY 5000 // 10 mAh, a 50 Ah module
+#define SYNTH_MAX_CURRENT 2500 // 10 mA
+#define SYNTH_KELVIN_0C 2731 // tenths of a kelvin
+
+// Limits reported by the system parameters and checked for the alarm response
+#define SYNTH_CELL_HIGH_MV 3650
+#define SYNTH_CELL_LOW_MV 3050
+#define SYNTH_CELL_UNDER_MV 2900
+#define SYNTH_TEMP_HIGH (SYNTH_KELVIN_0C + 500)
+#define SYNTH_TEMP_LOW SYNTH_KELVIN_0C
+
+#define SYNTH_CORRUPTION_KEY(name, key) key,
+static const char *const corruption_keys[] = {PYLON_SYNTH_CORRUPTIONS(SYNTH_CORRUPTION_KEY)};
+
+#define SYNTH_COMMAND_CID2(name, cid2) cid2,
+static const uint8_t command_cid2[] = {PYLON_SYNTH_COMMANDS(SYNTH_COMMAND_CID2)};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static uint32_t synth_random(PylonSynth *s) {
+    uint32_t x = s->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return s->rng = x;
+}
+
+/**
+ * Uniform in lo..hi
+ */
+static int32_t synth_range(PylonSynth *s, int32_t lo, int32_t hi) {
+    return lo + (int32_t) (synth_random(s) % (uint32_t) (hi - lo + 1));
+}
+
+static int32_t clamp(int32_t v, int32_t lo, int32_t hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static size_t put_hex8(char *out, uint8_t v) {
+    out[0] = hex_digits[v >> 4];
+    out[1] = hex_digits[v & 0x0F];
+    return 2;
+}
+
+static size_t put_hex16(char *out, uint16_t v) {
+    put_hex8(out, (uint8_t) (v >> 8));
+    put_hex8(out + 2, (uint8_t) v);
+    return 4;
+}
+
+static size_t put_u16(uint8_t *out, uint16_t v) {
+    out[0] = (uint8_t) (v >> 8);
+    out[1] = (uint8_t) v;
+    return 2;
+}
+
+/**
+ * Complete ASCII frame (SOI ... EOI) around a binary INFO payload
+ */
+static size_t build_frame(char *out, uint8_t address, uint8_t cid2, const uint8_t *info, size_t info_len) {
+    size_t pos = 0;
+    out[pos++] = PYLON_SOI;
+    pos += put_hex8(&out[pos], PYLON_SYNTH_VERSION);
+    pos += put_hex8(&out[pos], address);
+    pos += put_hex8(&out[pos], PYLON_CID1_BATTERY);
+    pos += put_hex8(&out[pos], cid2);
+
+    uint16_t len_id = (uint16_t) (info_len * 2) & 0x0FFF;
+    pos += put_hex16(&out[pos], (uint16_t) (pylon_length_checksum(len_id) << 12 | len_id));
+    for (size_t i = 0; i < info_len; i++) {
+        pos += put_hex8(&out[pos], info[i]);
+    }
+
+    pos += put_hex16(&out[pos], compute_checksum_ascii(&out[1], pos - 1));
+    out[pos++] = PYLON_EOI;
+    return pos;
+}
+
+static void pack_init(PylonSynth *s, PylonSynthPack *p) {
+    p->remaining = (uint16_t) synth_range(s, SYNTH_CAPACITY / 5, SYNTH_CAPACITY);
+    p->current = (int16_t) synth_range(s, -SYNTH_MAX_CURRENT / 4, SYNTH_MAX_CURRENT / 4);
+    p->cycles = (uint16_t) synth_range(s, 0, 500);
+    for (uint8_t i = 0; i < PYLON_MAX_CELLS; i++) {
+        p->cell_mV[i] = (uint16_t) synth_range(s, 3280, 3340);
+    }
+    for (uint8_t i = 0; i < PYLON_MAX_TEMPS; i++) {
+        p->temperature[i] = (uint16_t) synth_range(s, SYNTH_KELVIN_0C + 180, SYNTH_KELVIN_0C + 280);
+    }
+}
+
+/**
+ * One poll interval of a pack: the current drifts, the charge follows it and
+ * the cells settle towards the voltage of that charge under that current.
+ * The direction reverses at full and empty, a full charge counts a cycle.
+ */
+static void pack_step(PylonSynth *s, PylonSynthPack *p) {
+    p->current = (int16_t) clamp(p->current + synth_range(s, -40, 40), -SYNTH_MAX_CURRENT, SYNTH_MAX_CURRENT);
+    int32_t remaining = p->remaining + p->current / 64;
+    if (remaining >= SYNTH_CAPACITY && p->current > 0) {
+        p->current = (int16_t) -p->current;
+        p->cycles++;
+    } else if (remaining <= 0 && p->current < 0) {
+        p->current = (int16_t) -p->current;
+    }
+    p->remaining = (uint16_t) clamp(remaining, 0, SYNTH_CAPACITY);
+
+    int32_t target_mV = 3200 + 150 * p->remaining / SYNTH_CAPACITY + p->current / 50;
+    for (uint8_t i = 0; i < s->config.cells; i++) {
+        int32_t mV = p->cell_mV[i];
+        mV += (target_mV - mV) / 8 + synth_range(s, -2, 2);
+        p->cell_mV[i] = (uint16_t) clamp(mV, 2500, 3800);
+    }
+    int32_t heating = p->current < 0 ? -p->current / 250 : p->current / 250;
+    for (uint8_t i = 0; i < s->config.temperatures; i++) {
+        int32_t t = p->temperature[i] + synth_range(s, -2, 2) + (heating > 2 ? 1 : 0);
+        p->temperature[i] = (uint16_t) clamp(t, SYNTH_KELVIN_0C - 100, SYNTH_KELVIN_0C + 600);
+    }
+}
+
+/**
+ * Laid out the way pylon_parse_info_payload reads it
+ */
+static size_t build_analog_info(const PylonSynth *s, const PylonSynthPack *p, uint8_t address, uint8_t *info) {
+    size_t pos = 0;
+    uint32_t total_mV = 0;
+    pos += put_u16(&info[pos], address); // DATAFLAG, address
+    info[pos++] = s->config.cells;
+    for (uint8_t i = 0; i < s->config.cells; i++) {
+        pos += put_u16(&info[pos], p->cell_mV[i]);
+        total_mV += p->cell_mV[i];
+    }
+    info[pos++] = s->config.temperatures;
+    for (uint8_t i = 0; i < s->config.temperatures; i++) {
+        pos += put_u16(&info[pos], p->temperature[i]);
+    }
+    pos += put_u16(&info[pos], (uint16_t) p->current);
+    pos += put_u16(&info[pos], (uint16_t) (total_mV > UINT16_MAX ? UINT16_MAX : total_mV));
+    pos += put_u16(&info[pos], p->remaining);
+    info[pos++] = 0x02; // user defined number
+    pos += put_u16(&info[pos], SYNTH_CAPACITY);
+    pos += put_u16(&info[pos], p->cycles);
+    pos += put_u16(&info[pos], SYNTH_CAPACITY); // batteryCapacity
+    pos += put_u16(&info[pos], p->remaining); // currentCapacity
+    for (int i = 0; i < 5; i++) {
+        pos += put_u16(&info[pos], (uint16_t) (total_mV / 10)); // userVoltage0..4
+    }
+    pos += put_u16(&info[pos], 0); // unknown
+    return pos;
+}
+
+static uint8_t limit_alarm(int32_t value, int32_t low, int32_t high) {
+    return value <= low ? 0x01 : value >= high ? 0x02 : 0x00;
+}
+
+static size_t build_alarm_info(const PylonSynth *s, const PylonSynthPack *p, uint8_t address, uint8_t *info) {
+    size_t pos = 0;
+    info[pos++] = 0x00; // DATAFLAG
+    info[pos++] = address;
+    info[pos++] = s->config.cells;
+    for (uint8_t i = 0; i < s->config.cells; i++) {
+        info[pos++] = limit_alarm(p->cell_mV[i], SYNTH_CELL_LOW_MV, SYNTH_CELL_HIGH_MV);
+    }
+    info[pos++] = s->config.temperatures;
+    for (uint8_t i = 0; i < s->config.temperatures; i++) {
+        info[pos++] = limit_alarm(p->temperature[i], SYNTH_TEMP_LOW, SYNTH_TEMP_HIGH);
+    }
+    info[pos++] = p->current >= SYNTH_MAX_CURRENT ? 0x02 : 0x00; // charge current
+    info[pos++] = 0x00; // module voltage
+    info[pos++] = p->current <= -SYNTH_MAX_CURRENT ? 0x02 : 0x00; // discharge current
+    for (int i = 0; i < PYLON_ALARM_STATUS_BYTES; i++) {
+        info[pos++] = 0x00;
+    }
+    return pos;
+}
+
+static size_t build_system_params_info(const PylonSynth *s, uint8_t *info) {
+    const uint16_t values[] = {
+        SYNTH_CELL_HIGH_MV, SYNTH_CELL_LOW_MV, SYNTH_CELL_UNDER_MV,
+        SYNTH_TEMP_HIGH, SYNTH_TEMP_LOW, SYNTH_MAX_CURRENT / 10,
+        (uint16_t) (s->config.cells * 3550), (uint16_t) (s->config.cells * 3100), (uint16_t) (s->config.cells * 2900),
+        SYNTH_TEMP_HIGH + 100, SYNTH_KELVIN_0C - 100, (uint16_t) (-SYNTH_MAX_CURRENT / 10),
+    };
+    size_t pos = 0;
+    info[pos++] = 0x00; // INFOFLAG
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        pos += put_u16(&info[pos], values[i]);
+    }
+    return pos;
+}
+
+static size_t build_manufacturer_info(uint8_t *info) {
+    size_t pos = 0;
+    memcpy(&info[pos], "SYNTH50AH ", PYLON_BATTERY_NAME_LEN);
+    pos += PYLON_BATTERY_NAME_LEN;
+    info[pos++] = 1; // software version
+    info[pos++] = 0;
+    memcpy(&info[pos], "PYLON SYNTHETIC     ", PYLON_MANUFACTURER_NAME_LEN);
+    pos += PYLON_MANUFACTURER_NAME_LEN;
+    return pos;
+}
+
+static size_t build_charge_management_info(const PylonSynth *s, const PylonSynthPack *p, uint8_t address,
+                                           uint8_t *info) {
+    size_t pos = 0;
+    info[pos++] = address;
+    pos += put_u16(&info[pos], (uint16_t) (s->config.cells * 3500));
+    pos += put_u16(&info[pos], (uint16_t) (s->config.cells * 3000));
+    pos += put_u16(&info[pos], SYNTH_MAX_CURRENT / 10);
+    pos += put_u16(&info[pos], (uint16_t) (-SYNTH_MAX_CURRENT / 10));
+    uint8_t status = 0xC0; // charge and discharge enabled
+    if (p->remaining < SYNTH_CAPACITY / 10) status |= 0x20; // charge immediately
+    info[pos++] = status;
+    return pos;
+}
+
+size_t pylon_synth_frame(PylonSynth *s, uint8_t pack, PylonSynthCommand command, bool response, char *out) {
+    uint8_t info[PYLON_SYNTH_MAX_INFO];
+    uint8_t address = (uint8_t) (s->config.first_address + pack);
+    PylonSynthPack *p = &s->packs[pack];
+    size_t info_len = 0;
+
+    if (!response) {
+        // the master names the pack in INFO, except when asking for version or manufacturer
+        if (command != PYLON_SYNTH_PROTOCOL_VERSION && command != PYLON_SYNTH_MANUFACTURER) {
+            info[info_len++] = address;
+        }
+        return build_frame(out, address, command_cid2[command], info, info_len);
+    }
+
+    switch (command) {
+        case PYLON_SYNTH_ANALOG:
+            pack_step(s, p);
+            info_len = build_analog_info(s, p, address, info);
+            break;
+        case PYLON_SYNTH_ALARM:
+            info_len = build_alarm_info(s, p, address, info);
+            break;
+        case PYLON_SYNTH_SYSTEM_PARAMS:
+            info_len = build_system_params_info(s, info);
+            break;
+        case PYLON_SYNTH_MANUFACTURER:
+            info_len = build_manufacturer_info(info);
+            break;
+        case PYLON_SYNTH_CHARGE_MANAGEMENT:
+            info_len = build_charge_management_info(s, p, address, info);
+            break;
+        default:
+            break; // the protocol version is the VER field
+    }
+    return build_frame(out, address, PYLON_RTN_NORMAL, info, info_len);
+}
+
+static PylonSynthCorruption pick_corruption(PylonSynth *s) {
+    uint32_t kinds = s->config.corruptions;
+    int n = 0;
+    for (int k = 0; k < PYLON_SYNTH_CORRUPTION_COUNT; k++) {
+        n += (kinds >> k) & 1;
+    }
+    int pick = (int) (synth_random(s) % (uint32_t) n);
+    for (int k = 0; k < PYLON_SYNTH_CORRUPTION_COUNT; k++) {
+        if (((kinds >> k) & 1) && pick-- == 0) return (PylonSynthCorruption) k;
+    }
+    return PYLON_SYNTH_CORRUPT_CHECKSUM;
+}
+
+/**
+ * Another hex digit than c
+ */
+static char other_hex(PylonSynth *s, char c) {
+    uint8_t v = pylon_hex_nibble(c);
+    return hex_digits[(v + 1 + synth_random(s) % 15) & 0x0F];
+}
+
+/**
+ * Damage a valid frame of len bytes, return its new length
+ */
+static size_t corrupt_frame(PylonSynth *s, char *frame, size_t len) {
+    PylonSynthCorruption kind = pick_corruption(s);
+    s->corrupted[kind]++;
+    switch (kind) {
+        case PYLON_SYNTH_CORRUPT_BAD_CHAR:
+            // anywhere between SOI and CHKSUM
+            frame[1 + synth_random(s) % (len - 6)] = 'G';
+            break;
+        case PYLON_SYNTH_CORRUPT_LENGTH_CHECKSUM:
+            frame[9] = other_hex(s, frame[9]);
+            // the frame checksum stays valid, so only LENID is wrong
+            put_hex16(&frame[len - 5], compute_checksum_ascii(&frame[1], len - 6));
+            break;
+        case PYLON_SYNTH_CORRUPT_CHECKSUM:
+            frame[len - 2] = other_hex(s, frame[len - 2]);
+            break;
+        case PYLON_SYNTH_CORRUPT_NO_EOI:
+            frame[len - 1] = '0';
+            break;
+        case PYLON_SYNTH_CORRUPT_TRUNCATED:
+            len = 1 + synth_random(s) % (len - 2);
+            break;
+        default:
+            break;
+    }
+    return len;
+}
+
+bool pylon_synth_init(PylonSynth *s, const PylonSynthConfig *config) {
+    if (!config->packs || config->packs > PYLON_SYNTH_MAX_PACKS ||
+        !config->cells || config->cells > PYLON_MAX_CELLS ||
+        !config->temperatures || config->temperatures > PYLON_MAX_TEMPS ||
+        config->corrupt_per_mille > 1000 ||
+        (config->poll & ~PYLON_SYNTH_POLL_ALL) ||
+        (config->corruptions & ~((1u << PYLON_SYNTH_CORRUPTION_COUNT) - 1))) {
+        return false;
+    }
+    memset(s, 0, sizeof(*s));
+    s->config = *config;
+    if (!s->config.first_address) s->config.first_address = SYNTH_DEFAULT_ADDRESS;
+    if (!s->config.poll) s->config.poll = PYLON_SYNTH_POLL_ALL;
+    if (!s->config.corruptions) s->config.corruptions = (1u << PYLON_SYNTH_CORRUPTION_COUNT) - 1;
+    s->rng = config->seed ? config->seed : 0x2545F491u; // xorshift never leaves 0
+    for (uint8_t i = 0; i < s->config.packs; i++) {
+        pack_init(s, &s->packs[i]);
+    }
+    while (!(s->config.poll & PYLON_SYNTH_POLL(s->command))) s->command++;
+    return true;
+}
+
+/**
+ * Move to the next polled command, the next pack after the last one and a new cycle after the last pack
+ */
+static void advance(PylonSynth *s) {
+    do {
+        if (++s->command == PYLON_SYNTH_COMMAND_COUNT) {
+            s->command = 0;
+            if (++s->pack == s->config.packs) {
+                s->pack = 0;
+                s->cycles++;
+            }
+        }
+    } while (!(s->config.poll & PYLON_SYNTH_POLL(s->command)));
+}
+
+size_t pylon_synth_next(PylonSynth *s, char *out) {
+    size_t len = pylon_synth_frame(s, s->pack, (PylonSynthCommand) s->command, s->response_due, out);
+    if (s->response_due) advance(s);
+    s->response_due = !s->response_due;
+    s->frames++;
+    if (s->config.corrupt_per_mille && synth_random(s) % 1000 < s->config.corrupt_per_mille) {
+        len = corrupt_frame(s, out, len);
+    }
+    return len;
+}
+
+const char *pylon_synth_corruption_key(PylonSynthCorruption kind) {
+    return kind < PYLON_SYNTH_CORRUPTION_COUNT ? corruption_keys[kind] : "unknown";
+}
@@ -0,0 +1,127 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef PYLON_SYNTH_H
+#define PYLON_SYNTH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "pylon_packet.h"
+
+/*
+ * Synthetic Pylon bus traffic for load testing: the poll cycle of a master
+ * that asks every pack in turn for the configured commands, each request
+ * followed by the response of the pack. Frames carry a valid LENID checksum
+ * nibble and frame checksum unless they are deliberately corrupted.
+ *
+ * Every pack has its own cell voltages, temperatures, current and charge,
+ * which drift a little with every analog response. The values come from a
+ * seeded xorshift generator, so the same configuration always produces the
+ * same byte stream.
+ */
+
+#define PYLON_SYNTH_MAX_PACKS 15 // addresses 0x02..0x10 of the sample bus fit
+#define PYLON_SYNTH_VERSION 0x25
+
+/*
+ * Commands a pack can be polled for.
+ * X(name, cid2)
+ */
+#define PYLON_SYNTH_COMMANDS(X) \
+    X(ANALOG, PYLON_CID2_ANALOG) \
+    X(ALARM, PYLON_CID2_ALARM) \
+    X(SYSTEM_PARAMS, PYLON_CID2_SYSTEM_PARAMS) \
+    X(PROTOCOL_VERSION, PYLON_CID2_PROTOCOL_VERSION) \
+    X(MANUFACTURER, PYLON_CID2_MANUFACTURER) \
+    X(CHARGE_MANAGEMENT, PYLON_CID2_CHARGE_MANAGEMENT)
+
+#define PYLON_SYNTH_COMMAND_ID(name, cid2) PYLON_SYNTH_##name,
+
+typedef enum {
+    PYLON_SYNTH_COMMANDS(PYLON_SYNTH_COMMAND_ID)
+    PYLON_SYNTH_COMMAND_COUNT
+} PylonSynthCommand;
+
+#define PYLON_SYNTH_POLL(command) (1u << (command))
+#define PYLON_SYNTH_POLL_ALL ((1u << PYLON_SYNTH_COMMAND_COUNT) - 1)
+
+/*
+ * Damage done to a corrupted frame, with the stream decoder error it causes.
+ * X(name, key)
+ *   BAD_CHAR         a header or INFO character is not hex, PYLON_STREAM_ERR_BAD_CHAR
+ *   LENGTH_CHECKSUM  LCHKSUM does not match LENID, PYLON_STREAM_ERR_LENGTH_CHECKSUM
+ *   CHECKSUM         CHKSUM does not match the frame, PYLON_STREAM_ERR_CHECKSUM
+ *   NO_EOI           EOI replaced by another character, PYLON_STREAM_ERR_NO_EOI
+ *   TRUNCATED        the frame stops early, the next SOI gives PYLON_STREAM_ERR_RESYNC
+ */
+#define PYLON_SYNTH_CORRUPTIONS(X) \
+    X(BAD_CHAR, "bad_char") \
+    X(LENGTH_CHECKSUM, "length_checksum") \
+    X(CHECKSUM, "checksum") \
+    X(NO_EOI, "no_eoi") \
+    X(TRUNCATED, "truncated")
+
+#define PYLON_SYNTH_CORRUPTION_ID(name, key) PYLON_SYNTH_CORRUPT_##name,
+
+typedef enum {
+    PYLON_SYNTH_CORRUPTIONS(PYLON_SYNTH_CORRUPTION_ID)
+    PYLON_SYNTH_CORRUPTION_COUNT
+} PylonSynthCorruption;
+
+// Largest INFO: the analog response of a pack with PYLON_MAX_CELLS cells and PYLON_MAX_TEMPS sensors
+#define PYLON_SYNTH_MAX_INFO (2 + 1 + 2 * PYLON_MAX_CELLS + 1 + 2 * PYLON_MAX_TEMPS + 2 + 2 + 2 + 1 + 2 + 2 + 8 * 2)
+#define PYLON_SYNTH_MAX_FRAME (PYLON_FRAME_OVERHEAD_ASCII + 2 * PYLON_SYNTH_MAX_INFO)
+
+typedef struct {
+    uint8_t first_address; // of the first pack, the others follow; 0 for 0x02
+    uint8_t packs; // 1..PYLON_SYNTH_MAX_PACKS
+    uint8_t cells; // per pack, 1..PYLON_MAX_CELLS
+    uint8_t temperatures; // per pack, 1..PYLON_MAX_TEMPS
+    uint32_t poll; // PYLON_SYNTH_POLL() of the commands asked in every cycle, 0 for all
+    uint16_t corrupt_per_mille; // share of frames damaged, 0..1000
+    uint32_t corruptions; // (1u << PylonSynthCorruption) kinds to pick from, 0 for all
+    uint32_t seed;
+} PylonSynthConfig;
+
+typedef struct {
+    uint16_t cell_mV[PYLON_MAX_CELLS];
+    uint16_t temperature[PYLON_MAX_TEMPS]; // tenths of a kelvin
+    int16_t current; // 10 mA, positive while charging
+    uint16_t remaining; // 10 mAh
+    uint16_t cycles;
+} PylonSynthPack;
+
+typedef struct {
+    PylonSynthConfig config;
+    uint32_t rng;
+    PylonSynthPack packs[PYLON_SYNTH_MAX_PACKS];
+    uint8_t pack; // position in the poll cycle
+    uint8_t command;
+    bool response_due; // the request for pack and command went out
+    uint32_t frames; // frames generated
+    uint32_t cycles; // poll cycles completed
+    uint32_t corrupted[PYLON_SYNTH_CORRUPTION_COUNT];
+} PylonSynth;
+
+/**
+ * Start a generator at the first request of a poll cycle, false if config is out of range
+ */
+bool pylon_synth_init(PylonSynth *s, const PylonSynthConfig *config);
+
+/**
+ * Write the next frame of the poll cycle to out (SOI ... EOI, PYLON_SYNTH_MAX_FRAME
+ * bytes available), corrupted at the configured rate. Returns its length.
+ */
+size_t pylon_synth_next(PylonSynth *s, char *out);
+
+/**
+ * Write an intact request or response of pack (0-based) to out, outside of the poll cycle
+ */
+size_t pylon_synth_frame(PylonSynth *s, uint8_t pack, PylonSynthCommand command, bool response, char *out);
+
+const char *pylon_synth_corruption_key(PylonSynthCorruption kind);
+
+#endif // PYLON_SYNTH_H
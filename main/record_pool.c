@@ -0,0 +1,100 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "record_pool.h"
+#include "probe_diag.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "record_pool";
+
+// A free slot holds the link to the next free slot in place of the record
+typedef union PoolSlot {
+    MqttRecord record;
+    union PoolSlot *next;
+} PoolSlot;
+
+static PoolSlot slots[RECORD_POOL_SIZE];
+static PoolSlot *free_list = NULL;
+static size_t free_count;
+static size_t min_free;
+static bool initialized = false;
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Chain all slots on first use, called with pool_lock held
+ */
+static void pool_init(void) {
+    for (size_t i = 0; i < RECORD_POOL_SIZE; i++) {
+        slots[i].next = i + 1 < RECORD_POOL_SIZE ? &slots[i + 1] : NULL;
+    }
+    free_list = &slots[0];
+    free_count = RECORD_POOL_SIZE;
+    min_free = RECORD_POOL_SIZE;
+    initialized = true;
+}
+
+MqttRecord *record_pool_alloc(void) {
+    portENTER_CRITICAL(&pool_lock);
+    if (!initialized) pool_init();
+    PoolSlot *slot = free_list;
+    if (slot) {
+        free_list = slot->next;
+        free_count--;
+        if (free_count < min_free) min_free = free_count;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (!slot) {
+        probe_diag_count(DIAG_POOL_EXHAUSTED, 1);
+        return NULL;
+    }
+    return &slot->record;
+}
+
+void record_pool_free(MqttRecord *record) {
+    if (!record) return;
+    PoolSlot *slot = (PoolSlot *) record;
+    if (slot < slots || slot >= slots + RECORD_POOL_SIZE) {
+        ESP_LOGE(TAG, "Record %p is not from the pool", (void *) record);
+        return;
+    }
+    if (record->kind == MQTT_RECORD_BATCH) {
+        for (size_t i = 0; i < record->data.batch.count; i++) {
+            record_pool_free(record->data.batch.packs[i]);
+        }
+    }
+
+    portENTER_CRITICAL(&pool_lock);
+    slot->next = free_list;
+    free_list = slot;
+    free_count++;
+    portEXIT_CRITICAL(&pool_lock);
+}
+
+size_t record_pool_available(void) {
+    portENTER_CRITICAL(&pool_lock);
+    if (!initialized) pool_init();
+    size_t available = free_count;
+    portEXIT_CRITICAL(&pool_lock);
+    return available;
+}
+
+size_t record_pool_batch_reserve_left(MqttRecord *const *batches, size_t count) {
+    size_t left = count * RECORD_POOL_BATCH_SLOTS;
+    for (size_t i = 0; i < count; i++) {
+        if (batches[i]) left -= batches[i]->data.batch.count + 1u;
+    }
+    return left;
+}
+
+void record_pool_stats(RecordPoolStats *out) {
+    portENTER_CRITICAL(&pool_lock);
+    if (!initialized) pool_init();
+    out->size = RECORD_POOL_SIZE;
+    out->free = free_count;
+    out->min_free = min_free;
+    portEXIT_CRITICAL(&pool_lock);
+}
@@ -0,0 +1,56 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef RECORD_POOL_H
+#define RECORD_POOL_H
+
+#include <stddef.h>
+#include "mqtt_record.h"
+#include "sdkconfig.h"
+
+/*
+ * Fixed pool of MqttRecord slots.
+ *
+ * A record is decoded into a slot once and then only its pointer moves
+ * through the publish and offline queues; whoever takes a record off a queue
+ * owns it and returns it with record_pool_free. Slots are kept on a free
+ * list in static memory, so the number of messages in flight is bounded by
+ * RECORD_POOL_SIZE. Thread-safe, not for ISRs.
+ */
+
+#define RECORD_POOL_SIZE CONFIG_PROBE_RECORD_POOL_SIZE
+// Slots a full batch holds: its own and one per pack
+#define RECORD_POOL_BATCH_SLOTS (MQTT_RECORD_BATCH_MAX_PACKS + 1)
+
+typedef struct {
+    size_t size;
+    size_t free;
+    size_t min_free; // lowest free count since boot
+} RecordPoolStats;
+
+/**
+ * Take a free slot, NULL (counted as DIAG_POOL_EXHAUSTED) when every slot is in use
+ */
+MqttRecord *record_pool_alloc(void);
+
+/**
+ * Return a slot taken with record_pool_alloc, with the records of a batch; NULL is ignored
+ */
+void record_pool_free(MqttRecord *record);
+
+/**
+ * Slots free right now
+ */
+size_t record_pool_available(void);
+
+void record_pool_stats(RecordPoolStats *out);
+
+/**
+ * Slots the batches still being collected may take before they are full, out of
+ * RECORD_POOL_BATCH_SLOTS per entry of batches; NULL entries are batches not started
+ */
+size_t record_pool_batch_reserve_left(MqttRecord *const *batches, size_t count);
+
+#endif // RECORD_POOL_H
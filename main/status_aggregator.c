@@ -0,0 +1,114 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#include "status_aggregator.h"
+#include <string.h>
+
+typedef struct {
+    bool used;
+    StatusAggregate window;
+} AggregatorSlot;
+
+// Used by the dispatch task only
+static AggregatorSlot slots[STATUS_AGGREGATOR_MAX_PACKS];
+
+/**
+ * Slot of the pack, or a free one, or the one that has been silent for longest
+ */
+static AggregatorSlot *find_slot(uint8_t bus, uint8_t address) {
+    AggregatorSlot *free_slot = NULL;
+    AggregatorSlot *stalest = &slots[0];
+    for (size_t i = 0; i < STATUS_AGGREGATOR_MAX_PACKS; i++) {
+        AggregatorSlot *slot = &slots[i];
+        if (!slot->used) {
+            if (!free_slot) free_slot = slot;
+            continue;
+        }
+        if (slot->window.bus == bus && slot->window.address == address) return slot;
+        if (slot->window.end_us < stalest->window.end_us) stalest = slot;
+    }
+    AggregatorSlot *slot = free_slot ? free_slot : stalest;
+    slot->used = false;
+    return slot;
+}
+
+static inline void stat_add(AggregateStat *stat, int32_t value, bool first) {
+    if (first) {
+        stat->min = value;
+        stat->max = value;
+        stat->sum = 0;
+    } else {
+        if (value < stat->min) stat->min = value;
+        if (value > stat->max) stat->max = value;
+    }
+    stat->sum += value;
+    stat->last = value;
+}
+
+static void window_add(StatusAggregate *w, const PylonBatteryStatus *s, int64_t now_us) {
+    bool first = w->samples == 0;
+    if (first) {
+        w->start_us = now_us;
+    }
+    w->end_us = now_us;
+    w->samples++;
+    w->user_defined_number = s->user_defined_number;
+    w->cell_count = s->cell_count;
+    w->temperature_count = s->temperature_count;
+
+    int32_t cell_min = 0, cell_max = 0;
+    for (int i = 0; i < s->cell_count && i < PYLON_MAX_CELLS; i++) {
+        int32_t v = s->cell_voltage_mV[i];
+        if (i == 0 || v < cell_min) cell_min = v;
+        if (i == 0 || v > cell_max) cell_max = v;
+    }
+    int32_t temp_min = 0, temp_max = 0;
+    for (int i = 0; i < s->temperature_count && i < PYLON_MAX_TEMPS; i++) {
+        int32_t v = s->temperatures_c[i];
+        if (i == 0 || v < temp_min) temp_min = v;
+        if (i == 0 || v > temp_max) temp_max = v;
+    }
+
+    stat_add(&w->current_mA, s->current_mA, first);
+    stat_add(&w->total_voltage_mV, s->total_voltage_mV, first);
+    stat_add(&w->remaining_capacity_ah, s->remaining_capacity_ah, first);
+    stat_add(&w->cell_min_mV, cell_min, first);
+    stat_add(&w->cell_max_mV, cell_max, first);
+    stat_add(&w->temperature_min, temp_min, first);
+    stat_add(&w->temperature_max, temp_max, first);
+}
+
+bool status_aggregator_add(uint8_t bus, uint8_t address, const PylonBatteryStatus *status, int64_t now_us,
+                           int64_t window_us, StatusAggregate *summary) {
+    AggregatorSlot *slot = find_slot(bus, address);
+    if (!slot->used) {
+        memset(&slot->window, 0, sizeof(slot->window));
+        slot->window.bus = bus;
+        slot->window.address = address;
+        slot->used = true;
+    }
+
+    bool closed = false;
+    StatusAggregate *w = &slot->window;
+    if (w->samples && now_us - w->start_us >= window_us) {
+        *summary = *w;
+        w->samples = 0;
+        closed = true;
+    }
+    window_add(w, status, now_us);
+    return closed;
+}
+
+bool status_aggregator_flush(int64_t now_us, int64_t window_us, StatusAggregate *summary) {
+    for (size_t i = 0; i < STATUS_AGGREGATOR_MAX_PACKS; i++) {
+        StatusAggregate *w = &slots[i].window;
+        if (slots[i].used && w->samples && now_us - w->start_us >= window_us) {
+            *summary = *w;
+            w->samples = 0;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,77 @@
+/**
+ * The software was developed by Stanislav Lakhtin (lakhtin.stanislav@gmail.com)
+ * You can use it or parts of it freely in any non-commercial projects.
+ * In case of use in commercial projects, please kindly contact the author.
+ */
+#ifndef STATUS_AGGREGATOR_H
+#define STATUS_AGGREGATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pylon_packet.h"
+#include "uart_listener.h"
+
+/*
+ * Per-pack time-window aggregation of battery status frames.
+ *
+ * Every frame of a pack updates running min/max/sum/last of a few values;
+ * when a frame arrives after the window of that pack has elapsed, the
+ * finished window is handed out as one summary and a new one starts.
+ * Windows of packs that went silent are handed out by status_aggregator_flush.
+ */
+
+#define STATUS_AGGREGATOR_MAX_PACKS (16 * PYLON_BUS_COUNT)
+
+/*
+ * Aggregated values. Per-cell and per-sensor arrays are reduced to the
+ * lowest and highest element of every frame so the extremes survive.
+ */
+#define STATUS_AGGREGATE_VALUES(X) \
+    X(current_mA) \
+    X(total_voltage_mV) \
+    X(remaining_capacity_ah) \
+    X(cell_min_mV) \
+    X(cell_max_mV) \
+    X(temperature_min) \
+    X(temperature_max)
+
+typedef struct {
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    int32_t last;
+} AggregateStat;
+
+#define STATUS_AGGREGATE_FIELD(name) AggregateStat name;
+
+typedef struct {
+    uint8_t bus;
+    uint8_t address; // адрес модуля на шине
+    uint8_t user_defined_number;
+    uint8_t cell_count;
+    uint8_t temperature_count;
+    uint32_t samples; // кадров в окне
+    int64_t start_us; // время первого кадра окна
+    int64_t end_us; // время последнего кадра окна
+    STATUS_AGGREGATE_VALUES(STATUS_AGGREGATE_FIELD)
+} StatusAggregate;
+
+/**
+ * Add a status frame of the pack at address on bus received at now_us.
+ * Returns true when the frame closed a window of window_us or longer; the
+ * finished window is then copied to summary and the frame opens the next one.
+ */
+bool status_aggregator_add(uint8_t bus, uint8_t address, const PylonBatteryStatus *status, int64_t now_us,
+                           int64_t window_us, StatusAggregate *summary);
+
+/**
+ * Take out one window that elapsed by now_us without a frame to close it, false if there
+ * is none left. The pack starts a new window with its next frame.
+ */
+bool status_aggregator_flush(int64_t now_us, int64_t window_us, StatusAggregate *summary);
+
+static inline int32_t aggregate_mean(const AggregateStat *stat, uint32_t samples) {
+    return samples ? (int32_t) (stat->sum / (int64_t) samples) : 0;
+}
+
+#endif // STATUS_AGGREGATOR_H
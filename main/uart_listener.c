@@ -4,201 +4,606 @@
  * In case of use in commercial projects, please kindly contact the author.
  */
 #include "uart_listener.h"
+#include "pylon_stream.h"
+#include "probe_diag.h"
+#include "hot_log.h"
+#include "bus_capture.h"
+#include "bus_recorder.h"
+#include "pylon_synth.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "driver/uart.h"
-#include "soc/uart_struct.h"
-#include "soc/uart_periph.h"
-#include "esp_intr_alloc.h"
 #include "sample_data.h"
 #include "esp_timer.h"
+#include "nvs.h"
+#include "esp_partition.h"
 #include <string.h>
-
-#include "esp_random.h"
+#include <stdatomic.h>
 
 static const char *TAG = "pylon_uart";
 static const bool MOCK_UART = CONFIG_PROBE_EMULATE_UART;
 
-static PylonRxBuffer rx_buffers[PYLON_RX_BUFFER_COUNT];
+_Static_assert((PYLON_RX_FRAME_SLOTS & (PYLON_RX_FRAME_SLOTS - 1)) == 0, "PYLON_RX_FRAME_SLOTS must be a power of two");
+_Static_assert(PYLON_UART_RX_CHUNK_SIZE <= BUS_CAPTURE_MAX_CHUNK, "a receive chunk must fit one capture record");
+
+/*
+ * Receive side of one RS-485 bus. Everything but the ring indices and the
+ * counters is owned by the task receiving the bus (UART or replay).
+ *
+ * slots is a single-producer/single-consumer ring. The receiving task
+ * decodes straight into slots[head] and publishes it by advancing head; the
+ * dispatch task consumes slots[tail] in place and frees it by advancing tail.
+ * head and tail run freely and are masked on access, head - tail is the
+ * number of frames waiting.
+ */
+typedef struct {
+    uint8_t index; // frame->bus of its frames
+    PylonBusPort port;
+    PylonRxBuffer slots[PYLON_RX_FRAME_SLOTS];
+    atomic_uint head; // written by the receiving task only
+    atomic_uint tail; // written by the dispatch task only
+    PylonRxBuffer *active_buffer;
+    PylonStreamDecoder decoder;
+    QueueHandle_t event_queue;
+    uint32_t baudrate;
+    int64_t char_time_us; // 8N1 character on the wire
+    uint32_t errors_since_frame; // broken frames since the last good one, for auto-baud
+    atomic_uint frames;
+    atomic_uint dropped;
+    atomic_uint overruns;
+} PylonBus;
+
+static PylonBus buses[PYLON_BUS_COUNT];
+static const PylonBusPort bus_ports[] = PYLON_BUS_PORTS;
 static pylon_packet_callback_t user_callback = NULL;
-static intr_handle_t uart_intr_handle = NULL;
-static QueueHandle_t pylon_rx_queue = NULL;
-static uart_port_t uart_port = UART_NUM_2;
-
-static uart_dev_t *get_uart_dev(uart_port_t port) {
-    switch (port) {
-        case UART_NUM_0: return &UART0;
-        case UART_NUM_1: return &UART1;
-        case UART_NUM_2: return &UART2;
-        default: return NULL;
-    }
-}
-
-static PylonRxBuffer *get_free_buffer(void) {
-    for (int i = 0; i < PYLON_RX_BUFFER_COUNT; i++) {
-        if (rx_buffers[i].state == PYLON_RXBUF_FREE) {
-            rx_buffers[i].state = PYLON_RXBUF_RECEIVING;
-            rx_buffers[i].length = 0;
-            memset(rx_buffers[i].data, 0, PYLON_MAX_PACKET_SIZE);
-            return &rx_buffers[i];
-        }
+static pylon_tick_callback_t tick_callback = NULL;
+static TaskHandle_t dispatch_task_handle = NULL;
+
+_Static_assert(PYLON_BUS_COUNT >= 1 && PYLON_BUS_COUNT <= sizeof(bus_ports) / sizeof(bus_ports[0]),
+               "PYLON_BUS_PORTS has no UART for every bus");
+
+/**
+ * Slot at head if the ring has room, NULL if the dispatcher is PYLON_RX_FRAME_SLOTS frames behind
+ */
+static PylonRxBuffer *rx_ring_claim(PylonBus *bus) {
+    unsigned head = atomic_load_explicit(&bus->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&bus->tail, memory_order_acquire);
+    if (head - tail >= PYLON_RX_FRAME_SLOTS) {
+        return NULL;
     }
-    return NULL;
+    return &bus->slots[head & (PYLON_RX_FRAME_SLOTS - 1)];
 }
 
-static void uart_isr_handler(void *arg) {
-    uart_dev_t *dev = get_uart_dev(uart_port);
-    if (!dev) return;
+static void rx_ring_publish(PylonBus *bus) {
+    unsigned head = atomic_load_explicit(&bus->head, memory_order_relaxed);
+    atomic_store_explicit(&bus->head, head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&bus->frames, 1, memory_order_relaxed);
+    probe_diag_count(DIAG_RX_FRAMES, 1);
+    if (dispatch_task_handle) {
+        xTaskNotifyGive(dispatch_task_handle);
+    }
+}
 
-    static PylonRxBuffer *active_buffer = NULL;
+/**
+ * Oldest published frame or NULL, stays valid until rx_ring_release
+ */
+static PylonRxBuffer *rx_ring_peek(PylonBus *bus) {
+    unsigned tail = atomic_load_explicit(&bus->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&bus->head, memory_order_acquire);
+    if (tail == head) {
+        return NULL;
+    }
+    return &bus->slots[tail & (PYLON_RX_FRAME_SLOTS - 1)];
+}
 
-    while (dev->status.rxfifo_cnt) {
-        uint8_t byte = (uint8_t) (dev->fifo.rw_byte);
+static void rx_ring_release(PylonBus *bus) {
+    unsigned tail = atomic_load_explicit(&bus->tail, memory_order_relaxed);
+    atomic_store_explicit(&bus->tail, tail + 1, memory_order_release);
+}
 
-        if (!active_buffer) {
-            if (byte == 0x7E) {
-                // SOI
-                active_buffer = get_free_buffer();
-                if (active_buffer) {
-                    active_buffer->data[0] = byte;
-                    active_buffer->length = 1;
-                }
+static void set_char_time(PylonBus *bus, int64_t char_time_us) {
+    bus->char_time_us = char_time_us ? char_time_us : 1;
+}
+
+static const ProbeDiagCounter stream_error_counters[] = {
+    [PYLON_STREAM_ERR_BAD_CHAR] = DIAG_ERR_BAD_CHAR,
+    [PYLON_STREAM_ERR_LENGTH_CHECKSUM] = DIAG_ERR_LENGTH_CHECKSUM,
+    [PYLON_STREAM_ERR_LENGTH] = DIAG_ERR_LENGTH,
+    [PYLON_STREAM_ERR_CHECKSUM] = DIAG_ERR_CHECKSUM,
+    [PYLON_STREAM_ERR_NO_EOI] = DIAG_ERR_NO_EOI,
+    [PYLON_STREAM_ERR_RESYNC] = DIAG_ERR_RESYNC,
+};
+
+/**
+ * Run one bus byte received at rx_us through the frame decoder and publish
+ * complete, validated frames to the dispatch task. The receiving slot is
+ * kept across broken frames and reused on the next SOI.
+ */
+static void rx_consume_byte(PylonBus *bus, uint8_t byte, int64_t rx_us) {
+    if (pylon_stream_idle(&bus->decoder)) {
+        if (byte != PYLON_SOI) return;
+        if (!bus->active_buffer) {
+            bus->active_buffer = rx_ring_claim(bus);
+            if (!bus->active_buffer) {
+                atomic_fetch_add_explicit(&bus->dropped, 1, memory_order_relaxed);
+                probe_diag_count(DIAG_RX_DROPPED, 1);
+                return;
             }
-            continue;
         }
+        bus->active_buffer->soi_us = rx_us;
+        pylon_stream_start(&bus->decoder, &bus->active_buffer->packet);
+        return;
+    }
 
-        if (active_buffer->length < PYLON_MAX_PACKET_SIZE) {
-            active_buffer->data[active_buffer->length++] = byte;
-
-            if (byte == 0x0D) {
-                // EOI
-                active_buffer->state = PYLON_RXBUF_READY;
-                PylonRxBuffer *to_send = active_buffer;
-                BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-                xQueueSendFromISR(pylon_rx_queue, &to_send, &xHigherPriorityTaskWoken);
-                active_buffer = NULL;
-                if (xHigherPriorityTaskWoken) {
-                    portYIELD_FROM_ISR();
-                }
+    PylonStreamResult result = pylon_stream_feed(&bus->decoder, byte);
+    if (result != PYLON_STREAM_FRAME) {
+        if (result == PYLON_STREAM_ERROR) {
+            bus->errors_since_frame++;
+            probe_diag_count(stream_error_counters[bus->decoder.error], 1);
+            if (bus->decoder.error == PYLON_STREAM_ERR_RESYNC) {
+                bus->active_buffer->soi_us = rx_us;
             }
-        } else {
-            // Buffer overflow, discard
-            active_buffer->state = PYLON_RXBUF_FREE;
-            active_buffer = NULL;
         }
+        return;
     }
 
-    dev->int_clr.rxfifo_full = 1;
-    dev->int_clr.rxfifo_tout = 1;
+    bus->errors_since_frame = 0;
+    probe_diag_frame(bus->index, bus->active_buffer->packet.address);
+    bus->active_buffer->eoi_us = rx_us;
+    bus->active_buffer = NULL;
+    rx_ring_publish(bus);
 }
 
-static void mock_uart_task(void *param) {
-    ESP_LOGI(TAG, "Mock UART task running");
-    static PylonRxBuffer *active_buffer = NULL;
+/**
+ * Frame the bytes of one UART_DATA event. The driver hands them over in
+ * chunks, so the receive time of every byte is estimated back from the time
+ * the last one arrived: one character time per byte, and the RX timeout
+ * when the chunk was flushed by the line going idle.
+ */
+static void rx_consume_chunk(PylonBus *bus, const uint8_t *data, size_t len, int64_t last_rx_us) {
+    int64_t start = esp_timer_get_time();
+    probe_diag_count(DIAG_RX_BYTES, len);
+    for (size_t i = 0; i < len; i++) {
+        rx_consume_byte(bus, data[i], last_rx_us - (int64_t) (len - 1 - i) * bus->char_time_us);
+    }
+    probe_diag_time(DIAG_TIME_RX_CHUNK, (uint32_t) (esp_timer_get_time() - start));
+}
 
-    while (1) {
-        for (size_t i = 0;; i = (i + 1) % mock_data_lines_count) {
-            const char *line = mock_data_lines[i];
-            size_t len = strlen(line);
-
-            for (size_t j = 0; j < len; j++) {
-                uint8_t byte = (uint8_t) line[j];
-                if (!active_buffer) {
-                    if (byte == 0x7E) {
-                        // SOI
-                        active_buffer = get_free_buffer();
-                        if (active_buffer) {
-                            active_buffer->data[0] = byte;
-                            active_buffer->length = 1;
-                        } else {
-                            ESP_LOGE(TAG, "No free buffers");
-                        }
-                    }
-                    continue;
-                }
+#ifdef CONFIG_PROBE_UART_AUTOBAUD
+static void set_baudrate(PylonBus *bus, uint32_t baud) {
+    bus->baudrate = baud;
+    set_char_time(bus, 10 * 1000000LL / baud);
+    ESP_ERROR_CHECK(uart_set_baudrate(bus->port.port, baud));
+    uart_flush_input(bus->port.port);
+    xQueueReset(bus->event_queue);
+    pylon_stream_init(&bus->decoder);
+    bus->errors_since_frame = 0;
+}
 
-                if (active_buffer->length < PYLON_MAX_PACKET_SIZE) {
-                    active_buffer->data[active_buffer->length++] = byte;
-                    if (j == len-1) {
-                        active_buffer->data[active_buffer->length++] = 0x0D; // EOI
-                        active_buffer->state = PYLON_RXBUF_READY;
-                        PylonRxBuffer *to_send = active_buffer;
-                        xQueueSend(pylon_rx_queue, &to_send, portMAX_DELAY);
-                        active_buffer = NULL;
-                    }
-                } else {
-                    ESP_LOGI(TAG, "wrong mock data too long, discarding");
-                    active_buffer->state = PYLON_RXBUF_FREE;
-                    active_buffer = NULL;
-                }
+#define AUTOBAUD_NVS_NAMESPACE "pylon_uart"
+#define AUTOBAUD_NVS_KEY "baud" // of the first bus, "baud2" of the second
+
+static void autobaud_nvs_key(const PylonBus *bus, char key[6]) {
+    memcpy(key, AUTOBAUD_NVS_KEY, sizeof(AUTOBAUD_NVS_KEY));
+    if (bus->index) {
+        key[4] = (char) ('1' + bus->index);
+        key[5] = '\0';
+    }
+}
+
+static uint32_t load_baudrate(const PylonBus *bus) {
+    nvs_handle_t nvs;
+    uint32_t baud = 0;
+    char key[6];
+    autobaud_nvs_key(bus, key);
+    if (nvs_open(AUTOBAUD_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_u32(nvs, key, &baud);
+        nvs_close(nvs);
+    }
+    return baud;
+}
+
+static void store_baudrate(const PylonBus *bus, uint32_t baud) {
+    nvs_handle_t nvs;
+    char key[6];
+    autobaud_nvs_key(bus, key);
+    if (nvs_open(AUTOBAUD_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot open NVS to store baud rate");
+        return;
+    }
+    if (nvs_set_u32(nvs, key, baud) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot store baud rate %lu of UART%d", (unsigned long) baud, bus->port.port);
+    }
+    nvs_close(nvs);
+}
+
+/**
+ * Listen at the current rate for up to one probe window and count frames
+ * that pass both checksums. Garbage at a wrong rate almost never does.
+ */
+static bool autobaud_probe(PylonBus *bus, uint8_t *chunk, size_t chunk_size) {
+    static PylonPacketRaw scratch[PYLON_BUS_COUNT];
+    PylonStreamDecoder dec;
+    pylon_stream_init(&dec);
+    int frames = 0;
+    int64_t deadline = esp_timer_get_time() + CONFIG_PROBE_AUTOBAUD_WINDOW_MS * 1000LL;
 
-                // Небольшая случайная задержка (5–40 мс)
-                uint32_t delay_ms = 5 + esp_random() % 35;
-                vTaskDelay(pdMS_TO_TICKS(delay_ms));
+    while (esp_timer_get_time() < deadline) {
+        int n = uart_read_bytes(bus->port.port, chunk, chunk_size, pdMS_TO_TICKS(50));
+        for (int i = 0; i < n; i++) {
+            if (pylon_stream_idle(&dec)) {
+                if (chunk[i] == PYLON_SOI) pylon_stream_start(&dec, &scratch[bus->index]);
+            } else if (pylon_stream_feed(&dec, chunk[i]) == PYLON_STREAM_FRAME &&
+                       ++frames >= PYLON_AUTOBAUD_MIN_FRAMES) {
+                return true;
             }
         }
     }
+    return false;
 }
 
-static void pylon_dispatch_task(void *param) {
-    PylonRxBuffer *msg;
+/**
+ * Cycle through the candidate rates, the last known good one first, until
+ * one of them yields valid frames. Blocks while the bus is silent.
+ */
+static void autobaud_lock(PylonBus *bus, uint8_t *chunk, size_t chunk_size) {
+    static const uint32_t candidates[] = PYLON_AUTOBAUD_CANDIDATES;
+    uint32_t stored = load_baudrate(bus);
+    uint32_t first = stored ? stored : bus->baudrate;
+
+    for (int round = 0;; round++) {
+        for (int i = -1; i < (int) (sizeof(candidates) / sizeof(candidates[0])); i++) {
+            uint32_t baud = i < 0 ? first : candidates[i];
+            if (i >= 0 && baud == first) continue;
+            set_baudrate(bus, baud);
+            ESP_LOGI(TAG, "Auto-baud: listening at %lu baud on UART%d", (unsigned long) baud, bus->port.port);
+            if (autobaud_probe(bus, chunk, chunk_size)) {
+                ESP_LOGI(TAG, "Auto-baud: locked at %lu baud on UART%d", (unsigned long) baud, bus->port.port);
+                if (baud != stored) store_baudrate(bus, baud);
+                set_baudrate(bus, baud);
+                return;
+            }
+        }
+        if (round == 0) {
+            ESP_LOGW(TAG, "Auto-baud: no valid frames at any rate on UART%d, bus idle or not Pylon", bus->port.port);
+        }
+    }
+}
+#endif
+
+static void uart_rx_task(void *param) {
+    static uint8_t chunks[PYLON_BUS_COUNT][PYLON_UART_RX_CHUNK_SIZE];
+    PylonBus *bus = param;
+    uint8_t *chunk = chunks[bus->index];
+    uart_port_t port = bus->port.port;
+    uart_event_t event;
+
+#ifdef CONFIG_PROBE_UART_AUTOBAUD
+    autobaud_lock(bus, chunk, PYLON_UART_RX_CHUNK_SIZE);
+#endif
+
     while (1) {
-        if (xQueueReceive(pylon_rx_queue, &msg, portMAX_DELAY)) {
-            if (user_callback && msg->state == PYLON_RXBUF_READY) {
-                ESP_LOGI(TAG, "Dispatching packet of length %zu", msg->length);
-                user_callback(msg->data, msg->length);
-                msg->state = PYLON_RXBUF_FREE;
+#ifdef CONFIG_PROBE_UART_AUTOBAUD
+        if (bus->errors_since_frame >= PYLON_AUTOBAUD_RELOCK_ERRORS) {
+            ESP_LOGW(TAG, "%lu broken frames in a row at %lu baud on UART%d, detecting the rate again",
+                     (unsigned long) bus->errors_since_frame, (unsigned long) bus->baudrate, port);
+            autobaud_lock(bus, chunk, PYLON_UART_RX_CHUNK_SIZE);
+        }
+#endif
+
+        if (xQueueReceive(bus->event_queue, &event, pdMS_TO_TICKS(BUS_RECORDER_FLUSH_MS)) != pdTRUE) {
+            if (bus->index == 0) bus_recorder_idle(esp_timer_get_time());
+            continue;
+        }
+        switch (event.type) {
+            case UART_DATA: {
+                int64_t now = esp_timer_get_time();
+                int64_t last_rx_us =
+                        event.timeout_flag ? now - PYLON_UART_RX_TIMEOUT_SYMBOLS * bus->char_time_us : now;
+                size_t pending = event.size;
+                while (pending) {
+                    int n = uart_read_bytes(port, chunk,
+                                            pending < PYLON_UART_RX_CHUNK_SIZE ? pending : PYLON_UART_RX_CHUNK_SIZE, 0);
+                    if (n <= 0) break;
+                    pending -= n;
+                    int64_t chunk_rx_us = last_rx_us - (int64_t) pending * bus->char_time_us;
+                    // a capture holds one bus, the first
+                    if (bus->index == 0) bus_recorder_chunk(chunk, n, chunk_rx_us, bus->baudrate);
+                    rx_consume_chunk(bus, chunk, n, chunk_rx_us);
+                }
+                break;
             }
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // bytes were lost, whatever frame was in progress is broken
+                probe_diag_count(DIAG_RX_OVERRUNS, 1);
+                ESP_LOGW(TAG, "UART%d RX overrun (%s), %lu so far", port,
+                         event.type == UART_FIFO_OVF ? "FIFO" : "ring buffer",
+                         (unsigned long) (atomic_fetch_add_explicit(&bus->overruns, 1, memory_order_relaxed) + 1));
+                uart_flush_input(port);
+                xQueueReset(bus->event_queue);
+                pylon_stream_init(&bus->decoder);
+                break;
+            case UART_FRAME_ERR:
+            case UART_PARITY_ERR:
+                ESP_LOGD(TAG, "UART%d line error %d", port, event.type);
+                bus->errors_since_frame++; // typical of a wrong baud rate
+                probe_diag_count(DIAG_ERR_LINE, 1);
+                break;
+            default:
+                break;
         }
-        vTaskDelay(1); // минимальная уступка планировщику
     }
 }
 
-void pylon_uart_init(uart_port_t port, pylon_packet_callback_t callback) {
-    ESP_LOGI(TAG, "PylonTech battery protocol messages queue initializing");
-    user_callback = callback;
-    pylon_rx_queue = xQueueCreate(PYLON_RX_BUFFER_COUNT, sizeof(PylonRxBuffer *));
-    xTaskCreatePinnedToCore(pylon_dispatch_task, "pylon_dispatch", 8192, NULL, 10, NULL, 1);
-    ESP_LOGI(TAG, "PylonTech battery protocol messages queue initialized");
+/*
+ * Emulation replays recorded bus traffic through the same framing as the UART
+ * task. Receive times come from the recording, scaled by the replay speed,
+ * rather than from when the replay task gets to run, so every replay of a
+ * capture yields the same frames with the same timing.
+ */
+typedef struct {
+    bool started;
+    int64_t capture_start_us; // first chunk on the timeline of the recording
+    int64_t replay_start_us; // esp_timer time it was replayed at
+} ReplayClock;
 
-    if (MOCK_UART) {
-        ESP_LOGI(TAG, "Starting mock UART emulation");
-        xTaskCreatePinnedToCore(mock_uart_task, "mock_uart", 8192, NULL, 10, NULL, 1);
-        return;
+static void replay_chunk(PylonBus *bus, ReplayClock *clock, const uint8_t *data, size_t len, int64_t capture_us) {
+    if (!clock->started) {
+        clock->started = true;
+        clock->capture_start_us = capture_us;
+        clock->replay_start_us = esp_timer_get_time();
     }
+    int64_t due_us = clock->replay_start_us + (capture_us - clock->capture_start_us) / PYLON_REPLAY_SPEED;
+    int64_t wait_ms = (due_us - esp_timer_get_time()) / 1000;
+    if (wait_ms > 0) vTaskDelay(pdMS_TO_TICKS(wait_ms));
+    rx_consume_chunk(bus, data, len, due_us);
+}
 
-    uart_port = port;
-    ESP_LOGI(TAG, "Low-level UART ISR handler initializing on UART%d", port);
+typedef struct {
+    const esp_partition_t *partition;
+    size_t offset;
+} PartitionSource;
 
-    uart_config_t uart_config = RS485_UART_CONFIG(RS485_UART_BAUDRATE);
-    ESP_ERROR_CHECK(uart_param_config(port, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(port, RS485_UART_TXD, RS485_UART_RXD, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+static size_t partition_read(void *ctx, uint8_t *buf, size_t size) {
+    PartitionSource *src = ctx;
+    size_t left = src->partition->size - src->offset;
+    if (size > left) size = left;
+    if (!size || esp_partition_read(src->partition, src->offset, buf, size) != ESP_OK) return 0;
+    src->offset += size;
+    return size;
+}
 
+/**
+ * One pass over the capture on the partition, false if it holds none
+ */
+static bool replay_capture(PylonBus *bus, const esp_partition_t *partition) {
+    static BusCaptureReader reader;
+    PartitionSource src = {.partition = partition};
+    ReplayClock clock = {0};
+    BusCaptureChunk chunk;
+    uint32_t chunks = 0;
+
+    bus_capture_reader_init(&reader, partition_read, &src);
+    while (bus_capture_next(&reader, &chunk)) {
+        set_char_time(bus, chunk.char_time_us / PYLON_REPLAY_SPEED);
+        replay_chunk(bus, &clock, chunk.data, chunk.length, chunk.last_us);
+        chunks++;
+    }
+    if (chunks) ESP_LOGI(TAG, "Replayed %lu receive events from the capture", (unsigned long) chunks);
+    return chunks > 0;
+}
+
+/**
+ * One line as the UART driver would deliver it at the configured rate: in
+ * receive threshold chunks, PYLON_MOCK_LINE_GAP_US after the previous line
+ * ended at t. Returns the time of its last byte.
+ */
+static int64_t replay_line(PylonBus *bus, ReplayClock *clock, int64_t t, const char *line, size_t len,
+                           bool add_eoi) {
+    uint8_t chunk[PYLON_UART_RX_FULL_THRESHOLD];
+    int64_t line_char_us = 10 * 1000000LL / RS485_UART_BAUDRATE;
+    size_t total = add_eoi ? len + 1 : len;
 
-    uart_dev_t *dev = get_uart_dev(port);
-    if (!dev) {
-        ESP_LOGE(TAG, "Failed to get UART device for port %d", port);
+    t += PYLON_MOCK_LINE_GAP_US;
+    for (size_t pos = 0; pos < total;) {
+        size_t n = total - pos < sizeof(chunk) ? total - pos : sizeof(chunk);
+        for (size_t k = 0; k < n; k++) {
+            chunk[k] = pos + k < len ? (uint8_t) line[pos + k] : PYLON_EOI;
+        }
+        pos += n;
+        t += (int64_t) n * line_char_us;
+        replay_chunk(bus, clock, chunk, n, t);
+    }
+    return t;
+}
+
+#if !PYLON_EMULATE_SYNTH_PACKS
+/**
+ * One pass over the mock lines, which are stored without EOI
+ */
+static void replay_mock_lines(PylonBus *bus) {
+    ReplayClock clock = {0};
+    int64_t t = 0;
+
+    set_char_time(bus, 10 * 1000000LL / RS485_UART_BAUDRATE / PYLON_REPLAY_SPEED);
+    for (size_t i = 0; i < mock_data_lines_count; i++) {
+        t = replay_line(bus, &clock, t, mock_data_lines[i], strlen(mock_data_lines[i]), true);
+    }
+}
+#else
+/**
+ * One poll cycle of the synthetic packs, paced like the mock lines
+ */
+static void replay_synth(PylonBus *bus, PylonSynth *synth) {
+    char frame[PYLON_SYNTH_MAX_FRAME];
+    ReplayClock clock = {0};
+    int64_t t = 0;
+    uint32_t cycle = synth->cycles;
+
+    set_char_time(bus, 10 * 1000000LL / RS485_UART_BAUDRATE / PYLON_REPLAY_SPEED);
+    while (synth->cycles == cycle) {
+        size_t len = pylon_synth_next(synth, frame);
+        t = replay_line(bus, &clock, t, frame, len, false);
+    }
+}
+#endif
+
+/**
+ * The capture, which holds the first bus, is replayed on the first bus only;
+ * every bus replays the mock lines or its own synthetic packs.
+ */
+static void replay_task(void *param) {
+    PylonBus *bus = param;
+    const esp_partition_t *capture = NULL;
+    if (bus->index == 0) {
+        capture = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                           BUS_CAPTURE_PARTITION_LABEL);
+    }
+#if PYLON_EMULATE_SYNTH_PACKS
+    static PylonSynth synths[PYLON_BUS_COUNT];
+    PylonSynth *synth = &synths[bus->index];
+    const PylonSynthConfig synth_config = {
+        .packs = PYLON_EMULATE_SYNTH_PACKS,
+        .cells = PYLON_EMULATE_SYNTH_CELLS,
+        .temperatures = PYLON_EMULATE_SYNTH_TEMPS,
+        .corrupt_per_mille = PYLON_EMULATE_SYNTH_CORRUPT,
+        .seed = (uint32_t) esp_timer_get_time() + bus->index,
+    };
+    if (!pylon_synth_init(synth, &synth_config)) {
+        ESP_LOGE(TAG, "Bad synthetic traffic configuration");
+        vTaskDelete(NULL);
         return;
     }
+    const char *fallback = "synthetic traffic";
+#else
+    const char *fallback = "the mock lines";
+#endif
+    ESP_LOGI(TAG, "Replaying bus %u at %dx", bus->index + 1, PYLON_REPLAY_SPEED);
+
+    while (1) {
+        if (capture && replay_capture(bus, capture)) continue;
+        if (capture) {
+            ESP_LOGI(TAG, "No capture on the \"%s\" partition, replaying %s", BUS_CAPTURE_PARTITION_LABEL, fallback);
+            capture = NULL;
+        }
+#if PYLON_EMULATE_SYNTH_PACKS
+        replay_synth(bus, synth);
+#else
+        replay_mock_lines(bus);
+#endif
+    }
+}
+
+static void dispatch_frame(const PylonBus *bus, const PylonRxBuffer *msg) {
+    HOT_LOG(HOT_LOG_DISPATCH, msg->packet.cid1, msg->packet.cid2, msg->packet.address, msg->packet.data_length);
+    int64_t start = esp_timer_get_time();
+    PylonFrameView frame = pylon_frame_view(&msg->packet);
+    frame.soi_us = msg->soi_us;
+    frame.eoi_us = msg->eoi_us;
+    frame.bus = bus->index;
+    user_callback(&frame);
+    probe_diag_time(DIAG_TIME_DISPATCH, (uint32_t) (esp_timer_get_time() - start));
+}
+
+/**
+ * One task serves every bus, so the router keeps a single consumer. The rings
+ * are taken a frame at a time in turn, a busy bus does not hold up the others.
+ * The tick runs on the same task, between frames.
+ */
+static void pylon_dispatch_task(void *param) {
+    int64_t next_tick_us = 0;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PYLON_DISPATCH_TICK_MS));
+        bool dispatched;
+        do {
+            dispatched = false;
+            for (size_t b = 0; b < PYLON_BUS_COUNT; b++) {
+                PylonBus *bus = &buses[b];
+                PylonRxBuffer *msg = rx_ring_peek(bus);
+                if (!msg) continue;
+                if (user_callback) dispatch_frame(bus, msg);
+                rx_ring_release(bus);
+                dispatched = true;
+            }
+        } while (dispatched);
+
+        int64_t now = esp_timer_get_time();
+        if (tick_callback && now >= next_tick_us) {
+            tick_callback(now);
+            next_tick_us = now + PYLON_DISPATCH_TICK_MS * 1000LL;
+        }
+    }
+}
+
+bool pylon_uart_get_stats(uint8_t bus_index, PylonRxStats *out) {
+    if (bus_index >= PYLON_BUS_COUNT) return false;
+    PylonBus *bus = &buses[bus_index];
+    unsigned head = atomic_load_explicit(&bus->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&bus->tail, memory_order_relaxed);
+    out->frames = atomic_load_explicit(&bus->frames, memory_order_relaxed);
+    out->dropped = atomic_load_explicit(&bus->dropped, memory_order_relaxed);
+    out->overruns = atomic_load_explicit(&bus->overruns, memory_order_relaxed);
+    out->queued = head - tail;
+    return true;
+}
+
+static void bus_uart_start(PylonBus *bus) {
+    uart_port_t port = bus->port.port;
+    ESP_LOGI(TAG, "Bus %u: UART%d receiver initializing", bus->index + 1, port);
+
+    uart_config_t uart_config = RS485_UART_CONFIG(bus->baudrate);
+    ESP_ERROR_CHECK(uart_driver_install(port, PYLON_UART_RX_RING_SIZE, 0, PYLON_UART_EVENT_QUEUE_SIZE,
+                                        &bus->event_queue, PYLON_UART_INTR_FLAGS));
+    ESP_ERROR_CHECK(uart_param_config(port, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(port, bus->port.txd, bus->port.rxd, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    // The driver ISR moves the hardware FIFO into its ring buffer in bulk
+    ESP_ERROR_CHECK(uart_set_rx_full_threshold(port, PYLON_UART_RX_FULL_THRESHOLD));
+    ESP_ERROR_CHECK(uart_set_rx_timeout(port, PYLON_UART_RX_TIMEOUT_SYMBOLS));
 
-    dev->int_ena.val = 0;
-    dev->int_clr.val = ~0;
-    dev->int_ena.rxfifo_full = 1;
-    dev->int_ena.rxfifo_tout = 1;
+    char name[] = "pylon_uart_rx1";
+    name[sizeof(name) - 2] += bus->index;
+    xTaskCreatePinnedToCore(uart_rx_task, name, 4096, bus, 12, NULL, 1);
 
-    ESP_ERROR_CHECK(esp_intr_alloc(
-        uart_periph_signal[port].irq,
-        ESP_INTR_FLAG_SHARED,
-        uart_isr_handler,
-        (void *)(intptr_t)port,
-        &uart_intr_handle
-    ));
+#ifdef CONFIG_PROBE_UART_AUTOBAUD
+    ESP_LOGI(TAG, "Bus %u: UART%d receiver initialized, detecting baud rate", bus->index + 1, port);
+#else
+    ESP_LOGI(TAG, "Bus %u: UART%d receiver initialized, %lu baud", bus->index + 1, port,
+             (unsigned long) bus->baudrate);
+#endif
+}
+
+void pylon_uart_init(pylon_packet_callback_t callback, pylon_tick_callback_t tick) {
+    ESP_LOGI(TAG, "PylonTech battery protocol messages queue initializing");
+    user_callback = callback;
+    tick_callback = tick;
+    for (size_t b = 0; b < PYLON_BUS_COUNT; b++) {
+        PylonBus *bus = &buses[b];
+        bus->index = (uint8_t) b;
+        bus->port = bus_ports[b];
+        bus->baudrate = RS485_UART_BAUDRATE;
+        set_char_time(bus, 10 * 1000000LL / RS485_UART_BAUDRATE);
+        pylon_stream_init(&bus->decoder);
+    }
+    xTaskCreatePinnedToCore(pylon_dispatch_task, "pylon_dispatch", 4096, NULL, 10, &dispatch_task_handle, 1);
+    ESP_LOGI(TAG, "PylonTech battery protocol messages queue initialized, %d bus(es)", PYLON_BUS_COUNT);
 
-    ESP_LOGI(TAG, "Low-level UART ISR handler initialized on UART%d", port);
+    for (size_t b = 0; b < PYLON_BUS_COUNT; b++) {
+        if (MOCK_UART) {
+            char name[] = "pylon_replay1";
+            name[sizeof(name) - 2] += b;
+            ESP_LOGI(TAG, "Starting UART emulation of bus %u", (unsigned) b + 1);
+            xTaskCreatePinnedToCore(replay_task, name, 4096, &buses[b], 10, NULL, 1);
+        } else {
+            bus_uart_start(&buses[b]);
+        }
+    }
 }
 
-void pylon_uart_input_byte(uint8_t byte) {
-    // Заглушка для тестирования
+void pylon_uart_input_byte(uint8_t bus, uint8_t byte) {
+    if (bus >= PYLON_BUS_COUNT) return;
+    probe_diag_count(DIAG_RX_BYTES, 1);
+    rx_consume_byte(&buses[bus], byte, esp_timer_get_time());
 }
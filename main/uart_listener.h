@@ -10,17 +10,81 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "driver/uart.h"
+#include "esp_intr_alloc.h"
 #include "hal/uart_hal.h"
 #include "hal/gpio_types.h"
+#include "pylon_packet.h"
 
-#define PYLON_MAX_PACKET_SIZE 4608
-#define PYLON_RX_BUFFER_COUNT 2
+#include "sdkconfig.h"
+
+// Decoded frames waiting for the dispatch task, a power of two
+#define PYLON_RX_FRAME_SLOTS CONFIG_PROBE_RX_FRAME_SLOTS
+// Period of the dispatch task tick, which also runs while the buses are silent
+#define PYLON_DISPATCH_TICK_MS 1000
+
+// RS-485 buses tapped at once, each with its own UART, receive slots and framing
+#define PYLON_BUS_COUNT CONFIG_PROBE_BUS_COUNT
 
 #define RS485_UART_NUM     UART_NUM_2
-#define RS485_UART_BAUDRATE 9600
+#define RS485_UART_BAUDRATE CONFIG_PROBE_UART_BAUDRATE
 #define RS485_UART_TXD     GPIO_NUM_16
 #define RS485_UART_RXD     GPIO_NUM_17
 
+// Second bus; the default pins of UART1 are taken by the flash
+#define RS485_BUS2_UART_NUM UART_NUM_1
+#define RS485_BUS2_UART_TXD GPIO_NUM_25
+#define RS485_BUS2_UART_RXD GPIO_NUM_26
+
+// UART and pins of every bus, in bus order
+#define PYLON_BUS_PORTS { \
+    {RS485_UART_NUM, RS485_UART_TXD, RS485_UART_RXD}, \
+    {RS485_BUS2_UART_NUM, RS485_BUS2_UART_TXD, RS485_BUS2_UART_RXD}, \
+}
+
+// IDF driver receive path: the ISR empties the hardware FIFO into a ring
+// buffer once PYLON_UART_RX_FULL_THRESHOLD bytes are waiting or the line has
+// been idle for PYLON_UART_RX_TIMEOUT_SYMBOLS characters; uart_rx_task frames the bytes
+#define PYLON_UART_RX_RING_SIZE 4096
+// The ISR runs from IRAM (CONFIG_UART_ISR_IN_IRAM), so it keeps emptying the FIFO while
+// erasing or writing flash for the offline store or the capture stops the cache. The
+// ring then holds the bus until uart_rx_task runs again, about 350 ms at 115200 baud.
+#define PYLON_UART_INTR_FLAGS ESP_INTR_FLAG_IRAM
+#define PYLON_UART_RX_FULL_THRESHOLD 64 // of the 128-byte FIFO, leaves 64 characters of ISR latency headroom
+#define PYLON_UART_RX_TIMEOUT_SYMBOLS 3
+#define PYLON_UART_RX_CHUNK_SIZE 256
+#define PYLON_UART_EVENT_QUEUE_SIZE 32
+
+// Auto-baud: rates tried after the last stored one, valid frames needed to
+// lock, and broken frames in a row that make the receiver search again
+#define PYLON_AUTOBAUD_CANDIDATES {9600, 115200, 1200, 19200, 38400, 57600, 2400, 4800}
+#define PYLON_AUTOBAUD_MIN_FRAMES 2
+#define PYLON_AUTOBAUD_RELOCK_ERRORS 32
+
+// Emulation: multiple of the recorded pace a capture is replayed at, and the
+// silence between mock lines, about the poll turnaround of a master
+#ifdef CONFIG_PROBE_REPLAY_SPEED
+#define PYLON_REPLAY_SPEED CONFIG_PROBE_REPLAY_SPEED
+#else
+#define PYLON_REPLAY_SPEED 1
+#endif
+#define PYLON_MOCK_LINE_GAP_US 50000
+
+// Synthetic traffic replayed instead of the mock lines, see main/pylon_synth.h;
+// 0 packs keeps the mock lines
+#ifdef CONFIG_PROBE_SYNTH_PACKS
+#define PYLON_EMULATE_SYNTH_PACKS CONFIG_PROBE_SYNTH_PACKS
+#else
+#define PYLON_EMULATE_SYNTH_PACKS 0
+#endif
+#ifdef CONFIG_PROBE_SYNTH_CELLS
+#define PYLON_EMULATE_SYNTH_CELLS CONFIG_PROBE_SYNTH_CELLS
+#define PYLON_EMULATE_SYNTH_CORRUPT CONFIG_PROBE_SYNTH_CORRUPT_PER_MILLE
+#else
+#define PYLON_EMULATE_SYNTH_CELLS 16
+#define PYLON_EMULATE_SYNTH_CORRUPT 0
+#endif
+#define PYLON_EMULATE_SYNTH_TEMPS 6
+
 #define RS485_UART_CONFIG(baudrate)            \
     {                                          \
         .baud_rate = baudrate,                 \
@@ -31,22 +95,51 @@
         .source_clk = UART_SCLK_APB,           \
     }
 
-typedef enum {
-    PYLON_RXBUF_FREE,
-    PYLON_RXBUF_RECEIVING,
-    PYLON_RXBUF_READY
-} PylonRxBufferState;
+typedef struct {
+    uart_port_t port;
+    gpio_num_t txd;
+    gpio_num_t rxd;
+} PylonBusPort;
 
 typedef struct {
-    PylonRxBufferState state;
-    char data[PYLON_MAX_PACKET_SIZE];
-    size_t length;
+    int64_t soi_us; // esp_timer time of SOI
+    int64_t eoi_us; // esp_timer time of EOI
+    PylonPacketRaw packet; // decoded while receiving, valid once published to the dispatch task
 } PylonRxBuffer;
 
-typedef void (*pylon_packet_callback_t)(const char *packet, size_t len);
+typedef struct {
+    uint32_t frames; // valid frames handed to the dispatch task
+    uint32_t dropped; // frames skipped because every slot was waiting for dispatch
+    uint32_t overruns; // UART FIFO or driver ring buffer overflows
+    uint32_t queued; // frames waiting for dispatch right now
+} PylonRxStats;
 
-void pylon_uart_init(uart_port_t port, pylon_packet_callback_t callback);
+/**
+ * Called from the dispatch task, which serves every bus; frame->bus tells
+ * which one the frame came from. The frame view points into the RX buffer
+ * and is only valid for the duration of the call.
+ */
+typedef void (*pylon_packet_callback_t)(const PylonFrameView *frame);
 
-void pylon_uart_input_byte(uint8_t byte);
+/**
+ * Called from the dispatch task between frames about every PYLON_DISPATCH_TICK_MS,
+ * for work that must not wait for the next frame
+ */
+typedef void (*pylon_tick_callback_t)(int64_t now_us);
+
+/**
+ * Start receiving on the PYLON_BUS_COUNT first PYLON_BUS_PORTS; tick may be NULL
+ */
+void pylon_uart_init(pylon_packet_callback_t callback, pylon_tick_callback_t tick);
+
+/**
+ * Feed one byte received on bus from task context
+ */
+void pylon_uart_input_byte(uint8_t bus, uint8_t byte);
+
+/**
+ * Receive counters of one bus, false if there is no such bus
+ */
+bool pylon_uart_get_stats(uint8_t bus, PylonRxStats *out);
 
 #endif // PYLON_UART_HANDLER_H